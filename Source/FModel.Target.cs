@@ -33,6 +33,9 @@ public class FModelTarget : TargetRules
         bUseLoggingInShipping = true;
         bCompileWithPluginSupport = false;
 
+        // FModel stat scopes show up in Unreal Insights with -trace=cpu
+        bEnableTrace = true;
+
         GlobalDefinitions.Add("USE_IO_DISPATCHER=1");
 	}
 }
@@ -14,6 +14,7 @@ public class FModel : ModuleRules
 				"Core",
 				"EditorStyle",
 				"HTTP",
+				"Json",
 				"OutputLog",
 				"PakFile",
 				"Projects",
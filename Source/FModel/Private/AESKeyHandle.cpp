@@ -0,0 +1,149 @@
+#include "AESKeyHandle.h"
+
+#if PLATFORM_CPU_X86_FAMILY && (PLATFORM_WINDOWS || PLATFORM_LINUX || PLATFORM_MAC)
+#define FMODEL_AESNI 1
+#else
+#define FMODEL_AESNI 0
+#endif
+
+#if FMODEL_AESNI
+#include <wmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define FMODEL_AESNI_TARGET
+#else
+#include <cpuid.h>
+// The module isn't built with -maes, only these functions may use the instructions
+#define FMODEL_AESNI_TARGET __attribute__((target("aes,sse2")))
+#endif
+
+namespace AESNI
+{
+	static bool IsSupported()
+	{
+		// CPUID leaf 1, ECX bit 25
+#if defined(_MSC_VER) && !defined(__clang__)
+		int32 Info[4];
+		__cpuid(Info, 1);
+		return (Info[2] & (1 << 25)) != 0;
+#else
+		uint32 Eax, Ebx, Ecx, Edx;
+		return __get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx) && (Ecx & (1u << 25)) != 0;
+#endif
+	}
+
+	FMODEL_AESNI_TARGET static __m128i PrefixXor(__m128i Value)
+	{
+		__m128i Shifted = _mm_slli_si128(Value, 4);
+		Value = _mm_xor_si128(Value, Shifted);
+		Shifted = _mm_slli_si128(Shifted, 4);
+		Value = _mm_xor_si128(Value, Shifted);
+		Shifted = _mm_slli_si128(Shifted, 4);
+		return _mm_xor_si128(Value, Shifted);
+	}
+
+	/** AES-256 schedule words Index and Index + 1, the round constant has to be an immediate */
+	template <int32 Rcon>
+	FMODEL_AESNI_TARGET static void ExpandPair(__m128i* Keys, int32 Index)
+	{
+		Keys[Index] = _mm_xor_si128(PrefixXor(Keys[Index - 2]), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(Keys[Index - 1], Rcon), 0xff));
+		if (Index < FAESKeyHandle::NumRounds)
+		{
+			Keys[Index + 1] = _mm_xor_si128(PrefixXor(Keys[Index - 1]), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(Keys[Index], 0), 0xaa));
+		}
+	}
+
+	FMODEL_AESNI_TARGET static void ExpandDecryptionKeys(const uint8* Key, uint8 (*OutRoundKeys)[16])
+	{
+		__m128i Keys[FAESKeyHandle::NumRounds + 1];
+		Keys[0] = _mm_loadu_si128((const __m128i*)Key);
+		Keys[1] = _mm_loadu_si128((const __m128i*)(Key + 16));
+		ExpandPair<0x01>(Keys, 2);
+		ExpandPair<0x02>(Keys, 4);
+		ExpandPair<0x04>(Keys, 6);
+		ExpandPair<0x08>(Keys, 8);
+		ExpandPair<0x10>(Keys, 10);
+		ExpandPair<0x20>(Keys, 12);
+		ExpandPair<0x40>(Keys, 14);
+
+		// Equivalent inverse cipher: reversed order, InvMixColumns on all but the outer round keys
+		_mm_store_si128((__m128i*)OutRoundKeys[0], Keys[FAESKeyHandle::NumRounds]);
+		for (int32 Round = 1; Round < FAESKeyHandle::NumRounds; ++Round)
+		{
+			_mm_store_si128((__m128i*)OutRoundKeys[Round], _mm_aesimc_si128(Keys[FAESKeyHandle::NumRounds - Round]));
+		}
+		_mm_store_si128((__m128i*)OutRoundKeys[FAESKeyHandle::NumRounds], Keys[0]);
+	}
+
+	FMODEL_AESNI_TARGET static void Decrypt(const uint8 (*RoundKeys)[16], uint8* Data, uint64 NumBlocks)
+	{
+		constexpr int32 NumRounds = FAESKeyHandle::NumRounds;
+		__m128i Keys[NumRounds + 1];
+		for (int32 Round = 0; Round <= NumRounds; ++Round)
+		{
+			Keys[Round] = _mm_load_si128((const __m128i*)RoundKeys[Round]);
+		}
+
+		__m128i* Blocks = (__m128i*)Data;
+		uint64 BlockIndex = 0;
+		// ECB blocks are independent, four at a time keep the AES unit's pipeline busy
+		for (; BlockIndex + 4 <= NumBlocks; BlockIndex += 4)
+		{
+			__m128i B0 = _mm_xor_si128(_mm_loadu_si128(Blocks + BlockIndex + 0), Keys[0]);
+			__m128i B1 = _mm_xor_si128(_mm_loadu_si128(Blocks + BlockIndex + 1), Keys[0]);
+			__m128i B2 = _mm_xor_si128(_mm_loadu_si128(Blocks + BlockIndex + 2), Keys[0]);
+			__m128i B3 = _mm_xor_si128(_mm_loadu_si128(Blocks + BlockIndex + 3), Keys[0]);
+			for (int32 Round = 1; Round < NumRounds; ++Round)
+			{
+				B0 = _mm_aesdec_si128(B0, Keys[Round]);
+				B1 = _mm_aesdec_si128(B1, Keys[Round]);
+				B2 = _mm_aesdec_si128(B2, Keys[Round]);
+				B3 = _mm_aesdec_si128(B3, Keys[Round]);
+			}
+			_mm_storeu_si128(Blocks + BlockIndex + 0, _mm_aesdeclast_si128(B0, Keys[NumRounds]));
+			_mm_storeu_si128(Blocks + BlockIndex + 1, _mm_aesdeclast_si128(B1, Keys[NumRounds]));
+			_mm_storeu_si128(Blocks + BlockIndex + 2, _mm_aesdeclast_si128(B2, Keys[NumRounds]));
+			_mm_storeu_si128(Blocks + BlockIndex + 3, _mm_aesdeclast_si128(B3, Keys[NumRounds]));
+		}
+		for (; BlockIndex < NumBlocks; ++BlockIndex)
+		{
+			__m128i Block = _mm_xor_si128(_mm_loadu_si128(Blocks + BlockIndex), Keys[0]);
+			for (int32 Round = 1; Round < NumRounds; ++Round)
+			{
+				Block = _mm_aesdec_si128(Block, Keys[Round]);
+			}
+			_mm_storeu_si128(Blocks + BlockIndex, _mm_aesdeclast_si128(Block, Keys[NumRounds]));
+		}
+	}
+}
+#endif
+
+static_assert(FAES::FAESKey::KeySize == 32, "Round keys are laid out for AES-256");
+
+FAESKeyHandle::FAESKeyHandle(const FGuid& InGuid, const FAES::FAESKey& InKey, bool bAllowAESNI)
+	: Guid(InGuid)
+	, Key(InKey)
+{
+	FMemory::Memzero(RoundKeys, sizeof(RoundKeys));
+#if FMODEL_AESNI
+	static const bool bAESNISupported = AESNI::IsSupported();
+	if (bAESNISupported && bAllowAESNI)
+	{
+		AESNI::ExpandDecryptionKeys(Key.Key, RoundKeys);
+		bExpanded = true;
+	}
+#endif
+}
+
+void FAESKeyHandle::DecryptData(uint8* Data, uint64 Size) const
+{
+	checkf((Size & (FAES::AESBlockSize - 1)) == 0, TEXT("Decryption size %llu is not a multiple of the AES block size"), Size);
+#if FMODEL_AESNI
+	if (bExpanded)
+	{
+		AESNI::Decrypt(RoundKeys, Data, Size / FAES::AESBlockSize);
+		return;
+	}
+#endif
+	FAES::DecryptData(Data, Size, Key);
+}
@@ -0,0 +1 @@
+#include "BulkExporter.h"
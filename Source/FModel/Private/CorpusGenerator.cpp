@@ -0,0 +1,13 @@
+#include "CorpusGenerator.h"
+
+/**
+ * -GenerateCorpus [-CorpusOut=Dir] [-CorpusFiles=N] [-CorpusFormat=Pak|IoStore|Mixed] [-CorpusCompression=Zlib,LZ4,None] ...
+ *
+ * See FCorpusSettings for the rest. Point -Paks= at the output directory and pass the logged -AES= to mount the result.
+ */
+int RunCorpusGenerator(const TCHAR* CommandLine)
+{
+	const FCorpusSettings Settings(CommandLine);
+	FCorpusGenerator Generator(Settings);
+	return Generator.Run() ? 0 : 1;
+}
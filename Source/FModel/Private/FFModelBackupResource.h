@@ -1,55 +1,163 @@
 ﻿#pragma once
 
 #include "FModel.h"
+#include "LZ4Frame.h"
 #include "Serialization/Archive.h"
-#include "Compression/lz4.h"
-#include "Serialization/MemoryReader.h"
 
-#define IS_LZ4 0x184D2204
+/** Start of backups FModel itself writes, older ones go straight into records */
+#define FMODEL_BACKUP_MAGIC 0x4B424D46
+#define FMODEL_BACKUP_VERSION_LATEST 1
 
+/** One archive entry as recorded in a backup */
+struct FFModelBackupEntry
+{
+	FString Path;
+	int64 Offset = 0;
+	int64 Size = 0;
+	int64 UncompressedSize = 0;
+	int32 StructSize = 0;
+	int32 CompressionMethodIndex = 0;
+	/** SHA1 the archive stores for the entry, zero in backups without one */
+	uint8 Hash[20] = {};
+	bool bEncrypted = false;
+};
+
+/**
+ * Reader of .fbkp backups, LZ4 frame compressed or not. Records are decoded and parsed one at a time as Next asks for
+ * them, so memory stays at the frame reader's buffers and one record however large the backup is.
+ *
+ * Records are written the way .NET's BinaryWriter did for the original FModel: int64 Offset, Size and UncompressedSize,
+ * a one byte bool, int32 StructSize, the path as a 7-bit encoded byte length and UTF-8, then int32 compression method.
+ * Version 1 backups start with FMODEL_BACKUP_MAGIC and the version, and add the 20 byte hash to each record.
+ */
 class FFModelBackupResource
 {
 public:
 	FFModelBackupResource(FArchive& InAr)
+		: Ar(&InAr)
 	{
-		uint32 Magic;
-		InAr << Magic;
-		FArchive* ArToUse;
-		if (Magic == IS_LZ4)
+		uint32 Magic = 0;
+		if (InAr.TotalSize() >= sizeof(Magic))
 		{
-			TArray<uint8> Compressed;
-			Compressed.SetNumUninitialized(InAr.TotalSize());
+			InAr << Magic;
 			InAr.Seek(0);
-			InAr.Serialize(Compressed.GetData(), InAr.TotalSize());
-			TArray<uint8> Uncompressed;
-			LZ4_streamDecode_t* Stream = LZ4_createStreamDecode();
-			uint64 TotalDecompressed = 0;
-			while (true)
+		}
+		if (Magic == LZ4_FRAME_MAGIC || (Magic & LZ4_SKIPPABLE_FRAME_MASK) == LZ4_SKIPPABLE_FRAME_MAGIC)
+		{
+			Decoder = MakeUnique<FLZ4FrameReader>(InAr);
+			Ar = Decoder.Get();
+		}
+
+		// Legacy backups have no header, what was read is then the low half of the first record's offset
+		if (!Ar->AtEnd())
+		{
+			uint32 First = 0;
+			*Ar << First;
+			if (First == FMODEL_BACKUP_MAGIC)
 			{
-				Uncompressed.SetNumUninitialized(Uncompressed.Num() + 8192);
-				int32 DecompressedSize = LZ4_decompress_safe_continue(Stream, reinterpret_cast<const char*>(Compressed.GetData()), reinterpret_cast<char*>(Uncompressed.GetData() + TotalDecompressed), Compressed.Num(), 8192);
-				check(DecompressedSize >= 0);
-				if (DecompressedSize == 0)
+				*Ar << Version;
+				if (Version < 1 || Version > FMODEL_BACKUP_VERSION_LATEST)
 				{
-					break;
+					UE_LOG(LogFModel, Warning, TEXT("Unsupported backup version %d in %s"), Version, *InAr.GetArchiveName());
+					Ar->SetError();
 				}
-				TotalDecompressed += DecompressedSize;
 			}
-			Uncompressed.SetNumUninitialized(TotalDecompressed);
-			LZ4_freeStreamDecode(Stream);
-			ArToUse = new FMemoryReader(Uncompressed);
+			else
+			{
+				PendingOffsetLow = First;
+				bPendingOffset = true;
+			}
 		}
-		else
+	}
+
+	/** Parses the next record into OutEntry, reusing its allocations. False at the end of the backup or on an error. */
+	bool Next(FFModelBackupEntry& OutEntry)
+	{
+		if (Ar->IsError() || (!bPendingOffset && Ar->AtEnd()))
 		{
-			ArToUse = &InAr;
+			return false;
 		}
 
-		FArchive& Ar = *ArToUse;
-		while (!Ar.AtEnd())
+		if (bPendingOffset)
+		{
+			uint32 OffsetHigh = 0;
+			*Ar << OffsetHigh;
+			OutEntry.Offset = (int64)(((uint64)OffsetHigh << 32) | PendingOffsetLow);
+			bPendingOffset = false;
+		}
+		else
+		{
+			*Ar << OutEntry.Offset;
+		}
+		*Ar << OutEntry.Size;
+		*Ar << OutEntry.UncompressedSize;
+		uint8 bEncrypted = 0;
+		*Ar << bEncrypted;
+		OutEntry.bEncrypted = bEncrypted != 0;
+		*Ar << OutEntry.StructSize;
+		if (!SerializePath(OutEntry.Path))
 		{
+			return false;
+		}
+		*Ar << OutEntry.CompressionMethodIndex;
+		if (Version >= 1)
+		{
+			Ar->Serialize(OutEntry.Hash, sizeof(OutEntry.Hash));
+		}
+		else
+		{
+			FMemory::Memzero(OutEntry.Hash);
+		}
+		return !Ar->IsError();
+	}
+
+	bool IsError() const { return Ar->IsError(); }
 
+	/** 0 for backups written before the header existed */
+	int32 GetVersion() const { return Version; }
+
+private:
+	bool SerializePath(FString& OutPath)
+	{
+		// 7-bit encoded length, low groups first, at most five bytes for an int32
+		uint32 Length = 0;
+		for (int32 Shift = 0; ; Shift += 7)
+		{
+			uint8 Byte = 0;
+			*Ar << Byte;
+			if (Ar->IsError() || Shift > 28)
+			{
+				Ar->SetError();
+				return false;
+			}
+			Length |= (uint32)(Byte & 0x7F) << Shift;
+			if (!(Byte & 0x80))
+			{
+				break;
+			}
+		}
+		if (Length > MaxPathLength)
+		{
+			UE_LOG(LogFModel, Warning, TEXT("Backup record path of %u bytes, the backup is corrupt"), Length);
+			Ar->SetError();
+			return false;
 		}
 
-		delete ArToUse;
+		PathBuffer.SetNumUninitialized(Length, false);
+		Ar->Serialize(PathBuffer.GetData(), Length);
+		const FUTF8ToTCHAR Converted((const ANSICHAR*)PathBuffer.GetData(), Length);
+		OutPath.Reset(Converted.Length() + 1);
+		OutPath.AppendChars(Converted.Get(), Converted.Length());
+		return !Ar->IsError();
 	}
+
+	static constexpr uint32 MaxPathLength = 64 * 1024;
+
+	FArchive* Ar;
+	TUniquePtr<FLZ4FrameReader> Decoder;
+	/** UTF-8 path of the current record, reused across records */
+	TArray<uint8> PathBuffer;
+	int32 Version = 0;
+	uint32 PendingOffsetLow = 0;
+	bool bPendingOffset = false;
 };
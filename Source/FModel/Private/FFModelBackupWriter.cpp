@@ -0,0 +1 @@
+#include "FFModelBackupWriter.h"
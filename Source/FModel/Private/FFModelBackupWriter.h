@@ -0,0 +1,167 @@
+#pragma once
+
+#include "FModel.h"
+#include "FFModelBackupResource.h"
+#include "FModelApp.h"
+#include "LZ4Frame.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * Writes a backup of every entry the mount snapshot holds, in the format FFModelBackupResource reads. Records come
+ * straight out of the archive indices, no archive is read. Archives are serialized and compressed in parallel, a
+ * window of them at a time, each into independent LZ4 blocks the frame writer splices in archive order; memory is that
+ * window's compressed output plus one uncompressed block per worker.
+ */
+class FFModelBackupWriter
+{
+public:
+	explicit FFModelBackupWriter(const FVfsPlatformFile& Provider)
+		: Snapshot(Provider.GetSnapshot())
+	{
+	}
+
+	/** Writes to a temporary file next to Filename and moves it over Filename once complete */
+	bool Write(const FString& Filename)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		const FString TempFilename = Filename + TEXT(".tmp");
+		{
+			TUniquePtr<FArchive> File(IFileManager::Get().CreateFileWriter(*TempFilename));
+			if (!File.IsValid())
+			{
+				UE_LOG(LogFModel, Error, TEXT("Couldn't create backup %s"), *TempFilename);
+				return false;
+			}
+
+			FLZ4FrameWriter Frame(*File);
+			uint32 Magic = FMODEL_BACKUP_MAGIC;
+			uint32 Version = FMODEL_BACKUP_VERSION_LATEST;
+			Frame << Magic;
+			Frame << Version;
+
+			const TArray<FVfs>& Archives = Snapshot->Archives;
+			const int32 WindowSize = FMath::Max(FPlatformMisc::NumberOfCoresIncludingHyperthreads(), 1) * 2;
+			TArray<FArchiveOutput> Outputs;
+			for (int32 WindowStart = 0; WindowStart < Archives.Num(); WindowStart += WindowSize)
+			{
+				Outputs.SetNum(FMath::Min(WindowSize, Archives.Num() - WindowStart));
+				ParallelFor(Outputs.Num(), [&](int32 Index)
+				{
+					WriteArchive(Archives[WindowStart + Index], Frame.GetBlockMaxSize(), Outputs[Index]);
+				});
+				for (const FArchiveOutput& Output : Outputs)
+				{
+					Frame.AppendBlocks(Output.Blocks, Output.DecodedSize);
+					NumEntries += Output.NumEntries;
+				}
+			}
+			Frame.Close();
+			BytesWritten = File->Tell();
+			if (!File->Close())
+			{
+				UE_LOG(LogFModel, Error, TEXT("Couldn't write backup %s"), *TempFilename);
+				IFileManager::Get().Delete(*TempFilename);
+				return false;
+			}
+		}
+
+		if (!IFileManager::Get().Move(*Filename, *TempFilename))
+		{
+			UE_LOG(LogFModel, Error, TEXT("Couldn't move backup to %s"), *Filename);
+			IFileManager::Get().Delete(*TempFilename);
+			return false;
+		}
+		Seconds = FPlatformTime::Seconds() - StartTime;
+		return true;
+	}
+
+	int64 GetNumEntries() const { return NumEntries; }
+	int64 GetBytesWritten() const { return BytesWritten; }
+	double GetSeconds() const { return Seconds; }
+
+private:
+	/** One archive's records as frame blocks, reused across windows */
+	struct FArchiveOutput
+	{
+		TArray<uint8> Blocks;
+		int64 DecodedSize = 0;
+		int64 NumEntries = 0;
+	};
+
+	static void WriteArchive(const FVfs& Vfs, int64 BlockMaxSize, FArchiveOutput& Output)
+	{
+		Output.Blocks.Reset();
+		Output.DecodedSize = 0;
+		Output.NumEntries = 0;
+		if (!Vfs.Index.IsValid())
+		{
+			return;
+		}
+
+		const FVfsArchiveIndex& Index = *Vfs.Index;
+		const bool bPak = Vfs.Type == EVfsType::Pak;
+		const int32 PakVersion = bPak ? Vfs.PakFile->GetInfo().Version : 0;
+		// IoStore chunks are encrypted as a whole container, pak entries each carry the flag
+		const bool bContainerEncrypted = !bPak && Vfs.IsEncrypted();
+		FPakEntry PakEntry;
+		TArray<uint8> Records;
+		Records.Reserve(BlockMaxSize + 1024);
+		for (int32 EntryIndex = 0; EntryIndex < Index.Num(); ++EntryIndex)
+		{
+			const FVfsIndexEntry& Entry = Index.GetEntry(EntryIndex);
+			int32 StructSize = 0;
+			if (bPak)
+			{
+				// Only what the serialized size depends on, the blocks array keeps its allocation between entries
+				PakEntry.CompressionMethodIndex = Entry.CompressionMethodIndex;
+				PakEntry.Flags = Entry.Flags;
+				PakEntry.CompressionBlocks.SetNumUninitialized(Entry.NumBlocks, false);
+				StructSize = (int32)PakEntry.GetSerializedSize(PakVersion);
+			}
+			const uint8 bEncrypted = bPak ? (Entry.Flags & FPakEntry::Flag_Encrypted) != 0 : bContainerEncrypted;
+			// The index keeps the TOC entry index for IoStore, the backup carries where the chunk sits in the container
+			const int64 Offset = bPak ? Entry.Offset : (int64)Vfs.IoStoreToc->ChunkOffsetLengths[Entry.Offset].GetOffset();
+			AppendRecord(Records, Entry, Offset, Index.GetPathView(EntryIndex), bEncrypted, StructSize);
+
+			// Compress whole blocks as they fill, the tail carries over
+			if (Records.Num() >= BlockMaxSize)
+			{
+				FLZ4FrameWriter::CompressBlocks(Records.GetData(), BlockMaxSize, BlockMaxSize, Output.Blocks);
+				Output.DecodedSize += BlockMaxSize;
+				Records.RemoveAt(0, BlockMaxSize, false);
+			}
+		}
+		FLZ4FrameWriter::CompressBlocks(Records.GetData(), Records.Num(), BlockMaxSize, Output.Blocks);
+		Output.DecodedSize += Records.Num();
+		Output.NumEntries = Index.Num();
+	}
+
+	/** Same layout as FFModelBackupResource::Next, little endian like every platform FModel runs on */
+	static void AppendRecord(TArray<uint8>& Out, const FVfsIndexEntry& Entry, int64 Offset, FAnsiStringView Path, uint8 bEncrypted, int32 StructSize)
+	{
+		auto Append = [&Out](const void* Data, int32 Size) { Out.Append((const uint8*)Data, Size); };
+		Append(&Offset, sizeof(Offset));
+		Append(&Entry.Size, sizeof(Entry.Size));
+		Append(&Entry.UncompressedSize, sizeof(Entry.UncompressedSize));
+		Append(&bEncrypted, sizeof(bEncrypted));
+		Append(&StructSize, sizeof(StructSize));
+		for (uint32 Length = Path.Len(); ; Length >>= 7)
+		{
+			const uint8 Byte = (Length & 0x7F) | (Length > 0x7F ? 0x80 : 0);
+			Out.Add(Byte);
+			if (Length <= 0x7F)
+			{
+				break;
+			}
+		}
+		Append(Path.GetData(), Path.Len());
+		const int32 CompressionMethodIndex = Entry.CompressionMethodIndex;
+		Append(&CompressionMethodIndex, sizeof(CompressionMethodIndex));
+		Append(Entry.Hash, sizeof(Entry.Hash));
+	}
+
+	TRefCountPtr<const FVfsMountSnapshot> Snapshot;
+	int64 NumEntries = 0;
+	int64 BytesWritten = 0;
+	double Seconds = 0.0;
+};
@@ -14,6 +14,16 @@
 #include "Widgets/Testing/SStarshipSuite.h"
 #include "Widgets/Testing/STestSuite.h"
 
+/** Set by FModelBenchmark.Target.cs, which builds this module to run the microbenchmark suite only */
+#ifndef FMODEL_BENCHMARK
+#define FMODEL_BENCHMARK 0
+#endif
+
+/** Set by FModelTests.Target.cs, the only target the automation tests are compiled into */
+#ifndef FMODEL_TESTS
+#define FMODEL_TESTS 0
+#endif
+
 IMPLEMENT_APPLICATION(FModel, "FModel");
 DEFINE_LOG_CATEGORY(LogFModel);
 
@@ -24,6 +34,16 @@ namespace WorkspaceMenu
 	TSharedRef<FWorkspaceItem> DeveloperMenu = FWorkspaceItem::NewGroup(LOCTEXT("DeveloperMenu", "Developer"));
 }
 
+/** -StatsOut=Path: read path totals for offline comparison of runs */
+static void SaveStatsOnExit(const TCHAR* CommandLine)
+{
+	FString StatsPath;
+	if (FParse::Value(CommandLine, TEXT("StatsOut="), StatsPath, false) && !FFModelStats::Get().Dump(StatsPath))
+	{
+		UE_LOG(LogFModel, Error, TEXT("Failed to write stats to %s"), *StatsPath);
+	}
+}
+
 int RunApplication(const TCHAR* CommandLine)
 {
 	FTaskTagScope TaskTagScope(ETaskTag::EGameThread);
@@ -39,6 +59,20 @@ int RunApplication(const TCHAR* CommandLine)
 	// Tell the module manager it may now process newly-loaded UObjects when new C++ modules are loaded
 	FModuleManager::Get().StartProcessingNewlyLoadedObjects();
 
+	// Scripts and build servers: no renderer, styles or tabs, just the provider
+	const bool bBenchmarkSuite = FMODEL_BENCHMARK || FParse::Param(CommandLine, TEXT("BenchSuite"));
+	const bool bGenerateCorpus = FParse::Param(CommandLine, TEXT("GenerateCorpus"));
+	const bool bRunTests = FMODEL_TESTS || FParse::Param(CommandLine, TEXT("RunTests"));
+	if (bBenchmarkSuite || bGenerateCorpus || bRunTests || FParse::Param(CommandLine, TEXT("Headless")))
+	{
+		const int32 ExitCode = bBenchmarkSuite ? RunBenchmarkSuite(CommandLine) : bGenerateCorpus ? RunCorpusGenerator(CommandLine) : bRunTests ? RunTests(CommandLine) : RunHeadless(CommandLine);
+		SaveStatsOnExit(CommandLine);
+		FCoreDelegates::OnExit.Broadcast();
+		FModuleManager::Get().UnloadModulesAtShutdown();
+		GEngineLoop.AppPreExit();
+		GEngineLoop.AppExit();
+		return ExitCode;
+	}
 
 	// crank up a normal Slate application using the platform's standalone renderer
 	FSlateApplication::InitializeAsStandaloneApplication(GetStandardStandaloneRenderer());
@@ -108,6 +142,7 @@ int RunApplication(const TCHAR* CommandLine)
 		GFrameCounter++;
 	}
 
+	SaveStatsOnExit(CommandLine);
 	FCoreDelegates::OnExit.Broadcast();
 	FSlateApplication::Shutdown();
 	FModuleManager::Get().UnloadModulesAtShutdown();
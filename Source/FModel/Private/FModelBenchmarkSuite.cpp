@@ -0,0 +1,603 @@
+#include "FModelApp.h"
+#include "Algo/RandomShuffle.h"
+#include "Async/Async.h"
+#include "Math/RandomStream.h"
+#include "Misc/DateTime.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Policies/PrettyJsonPrintPolicy.h"
+#include "Serialization/JsonWriter.h"
+
+namespace FModelBenchmarkSuite
+{
+	/**
+	 * Times one operation call by call until both a minimum duration and sample count are reached, so percentiles are
+	 * those of single calls. Each sample includes reading the timer, measured once and saved with the results.
+	 * Scaling cases run the operation on several threads instead and only record throughput.
+	 */
+	class FRecorder
+	{
+	public:
+		explicit FRecorder(double InMinSeconds)
+			: MinSeconds(InMinSeconds)
+		{
+			TArray<double> Overheads;
+			for (int32 Index = 0; Index < 1024; ++Index)
+			{
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+				Overheads.Add(FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) * 1e9);
+			}
+			Overheads.Sort();
+			TimerOverheadNs = Overheads[Overheads.Num() / 2];
+			UE_LOG(LogFModel, Display, TEXT("Timer overhead %.0f ns per sample"), TimerOverheadNs);
+		}
+
+		/** Op returns the bytes it processed, 0 if throughput means nothing for it */
+		void Measure(const FString& Name, TFunctionRef<int64()> Op)
+		{
+			Op();
+
+			FResult& Result = Results.AddDefaulted_GetRef();
+			Result.Name = Name;
+			const double StartTime = FPlatformTime::Seconds();
+			while (Result.SampleNs.Num() < MinSamples || (Result.SampleNs.Num() < MaxSamples && FPlatformTime::Seconds() - StartTime < MinSeconds))
+			{
+				const uint64 StartCycles = FPlatformTime::Cycles64();
+				const int64 Bytes = Op();
+				const double SampleNs = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) * 1e9;
+				Result.SampleNs.Add(SampleNs);
+				Result.TotalNs += SampleNs;
+				Result.TotalBytes += Bytes;
+			}
+			Result.NumOps = Result.SampleNs.Num();
+			Result.SampleNs.Sort();
+
+			UE_LOG(LogFModel, Display, TEXT("%-40s %12.0f ns/op %10.2f MB/s  p50 %10.0f  p99 %10.0f"),
+				*Name, Result.GetNsPerOp(), Result.GetMBPerSecond(), Result.GetPercentileNs(50), Result.GetPercentileNs(99));
+		}
+
+		/** Runs Op in a loop on NumThreads threads for MinSeconds, each thread with its own random stream */
+		void MeasureThroughput(const FString& Name, int32 NumThreads, TFunctionRef<void(FRandomStream&)> Op)
+		{
+			TAtomic<bool> bStop(false);
+			TArray<TFuture<int64>> Workers;
+			for (int32 ThreadIndex = 0; ThreadIndex < NumThreads; ++ThreadIndex)
+			{
+				Workers.Add(Async(EAsyncExecution::Thread, [&Op, &bStop, ThreadIndex]() -> int64
+				{
+					FRandomStream Random(ThreadIndex);
+					int64 NumOps = 0;
+					while (!bStop)
+					{
+						for (int32 Index = 0; Index < 256; ++Index)
+						{
+							Op(Random);
+						}
+						NumOps += 256;
+					}
+					return NumOps;
+				}));
+			}
+			const double StartTime = FPlatformTime::Seconds();
+			FPlatformProcess::Sleep(MinSeconds);
+			bStop = true;
+
+			FResult& Result = Results.AddDefaulted_GetRef();
+			Result.Name = Name;
+			Result.NumThreads = NumThreads;
+			for (TFuture<int64>& Worker : Workers)
+			{
+				Result.NumOps += Worker.Get();
+			}
+			Result.TotalNs = (FPlatformTime::Seconds() - StartTime) * 1e9 * NumThreads;
+
+			UE_LOG(LogFModel, Display, TEXT("%-40s %12.0f ns/op %10.2f M ops/s on %d threads"),
+				*Name, Result.GetNsPerOp(), Result.GetOpsPerSecond() / 1e6, NumThreads);
+		}
+
+		/** Case specific value, such as cache hits, saved with the last measured case */
+		void AddValue(const FString& Key, double Value)
+		{
+			Results.Last().Values.Emplace(Key, Value);
+		}
+
+		bool Save(const FString& Path) const
+		{
+			FString Json;
+			TSharedRef<TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&Json);
+			Writer->WriteObjectStart();
+			Writer->WriteValue(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+			Writer->WriteValue(TEXT("engine"), FEngineVersion::Current().ToString());
+			Writer->WriteValue(TEXT("platform"), FPlatformProperties::IniPlatformName());
+			Writer->WriteValue(TEXT("cpu"), FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+			Writer->WriteValue(TEXT("cores"), FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+			Writer->WriteValue(TEXT("timer_overhead_ns"), TimerOverheadNs);
+			Writer->WriteArrayStart(TEXT("results"));
+			for (const FResult& Result : Results)
+			{
+				Writer->WriteObjectStart();
+				Writer->WriteValue(TEXT("name"), Result.Name);
+				Writer->WriteValue(TEXT("threads"), Result.NumThreads);
+				Writer->WriteValue(TEXT("ops"), Result.NumOps);
+				Writer->WriteValue(TEXT("bytes_per_op"), Result.TotalBytes / Result.NumOps);
+				Writer->WriteValue(TEXT("ns_per_op"), Result.GetNsPerOp());
+				Writer->WriteValue(TEXT("ops_per_s"), Result.GetOpsPerSecond());
+				Writer->WriteValue(TEXT("mb_per_s"), Result.GetMBPerSecond());
+				if (Result.SampleNs.Num())
+				{
+					Writer->WriteValue(TEXT("p50_ns"), Result.GetPercentileNs(50));
+					Writer->WriteValue(TEXT("p90_ns"), Result.GetPercentileNs(90));
+					Writer->WriteValue(TEXT("p99_ns"), Result.GetPercentileNs(99));
+					Writer->WriteValue(TEXT("max_ns"), Result.SampleNs.Last());
+				}
+				for (const TPair<FString, double>& Value : Result.Values)
+				{
+					Writer->WriteValue(Value.Key, Value.Value);
+				}
+				Writer->WriteObjectEnd();
+			}
+			Writer->WriteArrayEnd();
+			Writer->WriteObjectEnd();
+			Writer->Close();
+			return FFileHelper::SaveStringToFile(Json, *Path);
+		}
+
+	private:
+		static constexpr int32 MinSamples = 32;
+		/** Nanosecond-scale ops stop here before MinSeconds, 8 MiB of samples per case */
+		static constexpr int32 MaxSamples = 1 << 20;
+
+		struct FResult
+		{
+			FString Name;
+			int32 NumThreads = 1;
+			int64 NumOps = 0;
+			int64 TotalBytes = 0;
+			/** Time spent in the op, summed over threads */
+			double TotalNs = 0.0;
+			/** Time of each call, sorted once measured, empty for throughput cases */
+			TArray<double> SampleNs;
+			TArray<TPair<FString, double>> Values;
+
+			double GetNsPerOp() const
+			{
+				return TotalNs / NumOps;
+			}
+
+			double GetOpsPerSecond() const
+			{
+				return NumOps * NumThreads / TotalNs * 1e9;
+			}
+
+			double GetPercentileNs(int32 Percentile) const
+			{
+				return SampleNs[FMath::Min(SampleNs.Num() * Percentile / 100, SampleNs.Num() - 1)];
+			}
+
+			double GetMBPerSecond() const
+			{
+				return TotalBytes * NumThreads / TotalNs * 1e3;
+			}
+		};
+
+		double MinSeconds;
+		double TimerOverheadNs = 0.0;
+		TArray<FResult> Results;
+	};
+
+	/** Word soup with a small vocabulary, compresses roughly like text assets do */
+	static TArray<uint8> MakeCompressibleData(int64 Size)
+	{
+		static const ANSICHAR* Words[] = { "Texture", "Material", "/Game/", "Mesh", "Athena", "Skeletal", "_LOD0", "Default", "\0\0\0\0", "Package" };
+		FRandomStream Random(Size);
+		TArray<uint8> Data;
+		Data.Reserve(Size + 16);
+		while (Data.Num() < Size)
+		{
+			const ANSICHAR* Word = Words[Random.RandHelper(UE_ARRAY_COUNT(Words))];
+			Data.Append((const uint8*)Word, FMath::Max<int32>(FCStringAnsi::Strlen(Word), 4));
+			Data.Add((uint8)Random.RandHelper(256));
+		}
+		Data.SetNum(Size);
+		return Data;
+	}
+
+	static void RunUncompress(FRecorder& Recorder)
+	{
+		const int64 BlockSize = 64 * 1024;
+		const TArray<uint8> Uncompressed = MakeCompressibleData(BlockSize);
+		TArray<uint8> Output;
+		Output.SetNumUninitialized(BlockSize);
+		for (FName Codec : { NAME_Zlib, NAME_Gzip, NAME_LZ4, FName(TEXT("Oodle")) })
+		{
+			if (!FCompression::IsFormatValid(Codec))
+			{
+				UE_LOG(LogFModel, Display, TEXT("uncompress/%s skipped, codec not available"), *Codec.ToString());
+				continue;
+			}
+			TArray<uint8> Compressed;
+			int32 CompressedSize = FCompression::CompressMemoryBound(Codec, BlockSize);
+			Compressed.SetNumUninitialized(CompressedSize);
+			if (!FCompression::CompressMemory(Codec, Compressed.GetData(), CompressedSize, Uncompressed.GetData(), BlockSize))
+			{
+				continue;
+			}
+			Recorder.Measure(FString::Printf(TEXT("uncompress/%s/%lld"), *Codec.ToString(), BlockSize), [&]() -> int64
+			{
+				FCompression::UncompressMemory(Codec, Output.GetData(), BlockSize, Compressed.GetData(), CompressedSize);
+				return BlockSize;
+			});
+		}
+	}
+
+	static void RunDecrypt(FRecorder& Recorder)
+	{
+		FAES::FAESKey Key;
+		FRandomStream Random(0);
+		for (uint8& Byte : Key.Key)
+		{
+			Byte = (uint8)Random.RandHelper(256);
+		}
+		FAESKeyHandlePtr Handle = new FAESKeyHandle(FGuid(), Key);
+		UE_LOG(LogFModel, Display, TEXT("decrypt: key handle %s"), Handle->IsExpanded() ? TEXT("uses AES-NI") : TEXT("falls back to FAES"));
+		TArray<uint8> Data;
+		Data.SetNumZeroed(64 * 1024);
+		for (int64 Size : { (int64)FAES::AESBlockSize * 4, (int64)4 * 1024, (int64)64 * 1024 })
+		{
+			Recorder.Measure(FString::Printf(TEXT("decrypt/FAES/%lld"), Size), [&]() -> int64
+			{
+				FAES::DecryptData(Data.GetData(), Size, Key);
+				return Size;
+			});
+			Recorder.Measure(FString::Printf(TEXT("decrypt/DecryptBlock/%lld"), Size), [&]() -> int64
+			{
+				FPakSimpleEncryption::DecryptBlock(Data.GetData(), Size, *Handle);
+				return Size;
+			});
+		}
+	}
+
+	struct FPakCandidate
+	{
+		const FVfs* Vfs;
+		FPakEntry Entry;
+	};
+
+	/** The MaxEntries largest compressed pak entries of at least MinBlocks blocks, pointing into Snapshot */
+	static TArray<FPakCandidate> GetLargestCompressedEntries(const FVfsMountSnapshot& Snapshot, int32 MinBlocks, int32 MaxEntries)
+	{
+		TArray<FPakCandidate> Candidates;
+		for (const FVfs& Vfs : Snapshot.Archives)
+		{
+			if (Vfs.Type != EVfsType::Pak)
+			{
+				continue;
+			}
+			for (int32 EntryIndex = 0; EntryIndex < Vfs.Index->Num(); ++EntryIndex)
+			{
+				const FVfsIndexEntry& IndexEntry = Vfs.Index->GetEntry(EntryIndex);
+				if (IndexEntry.CompressionMethodIndex != 0 && IndexEntry.NumBlocks >= MinBlocks)
+				{
+					FPakCandidate& Candidate = Candidates.Add_GetRef({ &Vfs });
+					Vfs.Index->GetPakEntry(EntryIndex, Candidate.Entry);
+				}
+			}
+		}
+		Candidates.Sort([](const FPakCandidate& A, const FPakCandidate& B) { return A.Entry.UncompressedSize > B.Entry.UncompressedSize; });
+		Candidates.SetNum(FMath::Min(Candidates.Num(), MaxEntries));
+		return Candidates;
+	}
+
+	/** Reads the whole entry into Buffer, returns the bytes read */
+	static int64 ReadWhole(IFileHandle* RawHandle, TArray<uint8>& Buffer)
+	{
+		TUniquePtr<IFileHandle> Handle(RawHandle);
+		Buffer.SetNumUninitialized(Handle->Size(), false);
+		return Handle->Read(Buffer.GetData(), Buffer.Num()) ? Buffer.Num() : 0;
+	}
+
+	/** Seek and read through FPakCompressedReaderPolicy, rotating over many blocks so no read lands on the one the last decoded */
+	static void RunSerialize(FRecorder& Recorder, FVfsPlatformFile& Provider)
+	{
+		TRefCountPtr<const FVfsMountSnapshot> Snapshot = Provider.GetSnapshot();
+		const TArray<FPakCandidate> Candidates = GetLargestCompressedEntries(*Snapshot, 8, 16);
+		if (!Candidates.Num())
+		{
+			UE_LOG(LogFModel, Display, TEXT("serialize skipped, no compressed pak entries of 8+ blocks mounted (-Paks=, -AES=)"));
+			return;
+		}
+
+		TArray<TUniquePtr<IFileHandle>> Handles;
+		for (const FPakCandidate& Candidate : Candidates)
+		{
+			// Measures decoding, not copying out of the block cache
+			Handles.Emplace(FPakUtils::CreatePakFileHandle(Provider.LowerLevel, Candidate.Vfs->PakFile, &Candidate.Entry, false));
+		}
+
+		TArray<uint8> Buffer;
+		for (int64 ReadSize : { (int64)4 * 1024, (int64)64 * 1024, (int64)1024 * 1024 })
+		{
+			for (bool bAligned : { true, false })
+			{
+				struct FRead
+				{
+					IFileHandle* Handle;
+					int64 Offset;
+				};
+				TArray<FRead> Reads;
+				for (int32 HandleIndex = 0; HandleIndex < Handles.Num(); ++HandleIndex)
+				{
+					const FPakEntry& Entry = Candidates[HandleIndex].Entry;
+					const int64 BlockSize = Entry.CompressionBlockSize;
+					for (int64 Offset = bAligned ? 0 : BlockSize / 2 + 7; Offset + ReadSize <= Entry.UncompressedSize && Reads.Num() < 64 * (HandleIndex + 1); Offset += FMath::Max(BlockSize, Align(ReadSize, BlockSize)))
+					{
+						Reads.Add({ Handles[HandleIndex].Get(), Offset });
+					}
+				}
+				if (!Reads.Num())
+				{
+					continue;
+				}
+				Buffer.SetNumUninitialized(ReadSize, false);
+				int32 NextRead = 0;
+				Recorder.Measure(FString::Printf(TEXT("serialize/%lld/%s"), ReadSize, bAligned ? TEXT("aligned") : TEXT("unaligned")), [&]() -> int64
+				{
+					const FRead& Read = Reads[NextRead++ % Reads.Num()];
+					Read.Handle->Seek(Read.Offset);
+					return Read.Handle->Read(Buffer.GetData(), ReadSize) ? ReadSize : 0;
+				});
+			}
+		}
+	}
+
+	/**
+	 * Whole-entry reads of the largest compressed pak entries with the one-task double buffering, with coalesced reads,
+	 * with 1, 2, 4.. decompression tasks in flight and through the block cache. Each case opens its handles with its
+	 * own FPakReadSettings, so nothing else reading meanwhile is affected.
+	 */
+	static void RunDecompress(FRecorder& Recorder, FVfsPlatformFile& Provider)
+	{
+		TRefCountPtr<const FVfsMountSnapshot> Snapshot = Provider.GetSnapshot();
+		const TArray<FPakCandidate> Candidates = GetLargestCompressedEntries(*Snapshot, 2, 64);
+		if (!Candidates.Num())
+		{
+			UE_LOG(LogFModel, Display, TEXT("decompress skipped, no multi-block compressed pak entries mounted (-Paks=, -AES=)"));
+			return;
+		}
+
+		TArray<uint8> Buffer;
+		auto MeasureReads = [&](const FString& Name, const FPakReadSettings& Settings, bool bUseBlockCache)
+		{
+			int32 NextCandidate = 0;
+			Recorder.Measure(Name, [&]() -> int64
+			{
+				const FPakCandidate& Candidate = Candidates[NextCandidate++ % Candidates.Num()];
+				return ReadWhole(FPakUtils::CreatePakFileHandle(Provider.LowerLevel, Candidate.Vfs->PakFile, &Candidate.Entry, bUseBlockCache, Settings), Buffer);
+			});
+		};
+
+		// Warm the OS file cache so every case below measures decompression
+		for (const FPakCandidate& Candidate : Candidates)
+		{
+			ReadWhole(FPakUtils::CreatePakFileHandle(Provider.LowerLevel, Candidate.Vfs->PakFile, &Candidate.Entry, false), Buffer);
+		}
+
+		FPakReadSettings Settings = FPakReadSettings::GetDefault();
+		Settings.ParallelDecompressMinBlocks = 0;
+		Settings.MaxCoalescedReadSize = 0;
+		MeasureReads(TEXT("decompress/double_buffered"), Settings, false);
+		Settings.MaxCoalescedReadSize = FPakReadSettings::GetDefault().MaxCoalescedReadSize;
+		MeasureReads(TEXT("decompress/coalesced"), Settings, false);
+		Settings.ParallelDecompressMinBlocks = 2;
+		for (int32 InFlight = 1; InFlight <= FPlatformMisc::NumberOfCoresIncludingHyperthreads(); InFlight *= 2)
+		{
+			Settings.MaxDecompressTasksInFlight = InFlight;
+			MeasureReads(FString::Printf(TEXT("decompress/parallel/%d"), InFlight), Settings, false);
+		}
+
+		if (FPakBlockCache::Get().IsEnabled())
+		{
+			for (const FPakCandidate& Candidate : Candidates)
+			{
+				ReadWhole(FPakUtils::CreatePakFileHandle(Provider.LowerLevel, Candidate.Vfs->PakFile, &Candidate.Entry, true), Buffer);
+			}
+			FPakBlockCache::Get().ResetStats();
+			MeasureReads(TEXT("decompress/block_cache"), FPakReadSettings::GetDefault(), true);
+			const FPakBlockCacheStats Stats = FPakBlockCache::Get().GetStats();
+			Recorder.AddValue(TEXT("cache_hits"), Stats.Hits);
+			Recorder.AddValue(TEXT("cache_misses"), Stats.Misses);
+			Recorder.AddValue(TEXT("cache_evictions"), Stats.Evictions);
+		}
+	}
+
+	/**
+	 * Whole-entry reads of the largest plain and compressed unencrypted pak entries through the pak reader, through a
+	 * mapping and, for plain ones, as in-place views. Saves how much resident memory each case added.
+	 */
+	static void RunMapped(FRecorder& Recorder, FVfsPlatformFile& Provider)
+	{
+		struct FCandidate
+		{
+			const FVfs* Vfs;
+			FMappedPakFilePtr Mapping;
+			FPakEntry Entry;
+		};
+		TRefCountPtr<const FVfsMountSnapshot> Snapshot = Provider.GetSnapshot();
+		TArray<FCandidate> Plain;
+		TArray<FCandidate> Compressed;
+		for (const FVfs& Vfs : Snapshot->Archives)
+		{
+			if (Vfs.Type != EVfsType::Pak)
+			{
+				continue;
+			}
+			// Mapping is only set up at mount with -MapPaks, the benchmark maps on its own otherwise
+			FMappedPakFilePtr Mapping = Vfs.Mapping.IsValid() ? Vfs.Mapping : FMappedPakFile::Open(Provider.LowerLevel, Vfs.Path);
+			if (!Mapping.IsValid())
+			{
+				continue;
+			}
+			for (int32 EntryIndex = 0; EntryIndex < Vfs.Index->Num(); ++EntryIndex)
+			{
+				FCandidate Candidate { &Vfs, Mapping };
+				Vfs.Index->GetPakEntry(EntryIndex, Candidate.Entry);
+				if (!Candidate.Entry.IsEncrypted())
+				{
+					(Candidate.Entry.CompressionMethodIndex == 0 ? Plain : Compressed).Add(MoveTemp(Candidate));
+				}
+			}
+		}
+		for (TArray<FCandidate>* Candidates : { &Plain, &Compressed })
+		{
+			Candidates->Sort([](const FCandidate& A, const FCandidate& B) { return A.Entry.UncompressedSize > B.Entry.UncompressedSize; });
+			Candidates->SetNum(FMath::Min(Candidates->Num(), 64));
+		}
+		if (!Plain.Num() && !Compressed.Num())
+		{
+			UE_LOG(LogFModel, Display, TEXT("mapped skipped, no unencrypted pak entries mounted (-Paks=)"));
+			return;
+		}
+
+		TArray<uint8> Buffer;
+		auto MeasureReads = [&](const TCHAR* Name, const TArray<FCandidate>& Candidates, TFunctionRef<int64(const FCandidate&)> ReadOne)
+		{
+			if (!Candidates.Num())
+			{
+				return;
+			}
+			const uint64 UsedPhysicalBefore = FPlatformMemory::GetStats().UsedPhysical;
+			int32 NextCandidate = 0;
+			Recorder.Measure(Name, [&]() -> int64
+			{
+				return ReadOne(Candidates[NextCandidate++ % Candidates.Num()]);
+			});
+			Recorder.AddValue(TEXT("resident_delta_mib"), ((int64)FPlatformMemory::GetStats().UsedPhysical - (int64)UsedPhysicalBefore) / 1048576.0);
+		};
+		auto ReadThroughReader = [&](const FCandidate& Candidate)
+		{
+			return ReadWhole(FPakUtils::CreatePakFileHandle(Provider.LowerLevel, Candidate.Vfs->PakFile, &Candidate.Entry, false), Buffer);
+		};
+		auto ReadThroughMapping = [&](const FCandidate& Candidate)
+		{
+			return ReadWhole(new FMappedPakEntryHandle(Candidate.Mapping, *Candidate.Vfs->PakFile, Candidate.Entry, false), Buffer);
+		};
+
+		MeasureReads(TEXT("mapped/plain/pak_reader"), Plain, ReadThroughReader);
+		MeasureReads(TEXT("mapped/plain/mapped_copy"), Plain, ReadThroughMapping);
+		MeasureReads(TEXT("mapped/plain/mapped_view"), Plain, [](const FCandidate& Candidate) -> int64
+		{
+			FVfsEntryView View;
+			if (!FMappedPakEntryHandle::MakeView(Candidate.Mapping, *Candidate.Vfs->PakFile, Candidate.Entry, View))
+			{
+				return 0;
+			}
+			// Touch every page so the view is paid for like the copies are
+			uint64 Sum = 0;
+			for (int64 Offset = 0; Offset < View.Data.Num(); Offset += 4096)
+			{
+				Sum += View.Data[Offset];
+			}
+			return Sum == MAX_uint64 ? 0 : View.Data.Num();
+		});
+		MeasureReads(TEXT("mapped/compressed/pak_reader"), Compressed, ReadThroughReader);
+		MeasureReads(TEXT("mapped/compressed/mapped"), Compressed, ReadThroughMapping);
+	}
+
+	static void RunLookup(FRecorder& Recorder, FVfsPlatformFile& Provider)
+	{
+		TArray<FString> Paths;
+		TRefCountPtr<const FVfsMountSnapshot> Snapshot = Provider.GetSnapshot();
+		for (const FVfs& Vfs : Snapshot->Archives)
+		{
+			const int32 Stride = FMath::Max(1, Vfs.Index->Num() / 1000);
+			for (int32 EntryIndex = 0; EntryIndex < Vfs.Index->Num(); EntryIndex += Stride)
+			{
+				Paths.Add(Vfs.Index->GetPath(EntryIndex));
+			}
+		}
+		if (!Paths.Num())
+		{
+			UE_LOG(LogFModel, Display, TEXT("lookup skipped, nothing mounted"));
+			return;
+		}
+		Algo::RandomShuffle(Paths);
+		int32 NextPath = 0;
+		Recorder.Measure(TEXT("lookup/FileExists"), [&]() -> int64
+		{
+			Provider.FileExists(*Paths[NextPath++ % Paths.Num()]);
+			return 0;
+		});
+		Recorder.Measure(TEXT("lookup/Read"), [&]() -> int64
+		{
+			delete Provider.Read(Paths[NextPath++ % Paths.Num()]);
+			return 0;
+		});
+		Recorder.Measure(TEXT("lookup/Miss"), [&]() -> int64
+		{
+			Provider.FileExists(TEXT("FModel/Benchmark/Missing.uasset"));
+			return 0;
+		});
+
+		// Scaling over reader threads while a writer keeps republishing the mounted set, which costs the same as
+		// publishing a real mount batch
+		TAtomic<bool> bStopWriter(false);
+		TAtomic<int32> NumPublishes(0);
+		TFuture<void> Writer = Async(EAsyncExecution::Thread, [&]
+		{
+			while (!bStopWriter)
+			{
+				Provider.PublishSnapshot([](FVfsMountSnapshot&) {});
+				++NumPublishes;
+			}
+		});
+		for (int32 NumThreads = 1; NumThreads <= FPlatformMisc::NumberOfCoresIncludingHyperthreads(); NumThreads *= 2)
+		{
+			const int32 PublishesBefore = NumPublishes;
+			Recorder.MeasureThroughput(FString::Printf(TEXT("lookup/threads/%d"), NumThreads), NumThreads, [&](FRandomStream& Random)
+			{
+				Provider.FileExists(*Paths[Random.RandHelper(Paths.Num())]);
+			});
+			Recorder.AddValue(TEXT("snapshots_published"), NumPublishes - PublishesBefore);
+		}
+		bStopWriter = true;
+		Writer.Get();
+	}
+}
+
+/**
+ * FModelBenchmark target, or -BenchSuite: microbenchmarks of the read hot path, from single block decodes to lookup
+ * scaling over threads. Writes ns/op, MB/s and per-call percentiles as JSON to -BenchOut= (default Saved/Benchmarks).
+ * -BenchSeconds= sets the minimum time per case. Cases needing mounted archives are skipped without them.
+ */
+int RunBenchmarkSuite(const TCHAR* CommandLine)
+{
+	double MinSeconds = 1.0;
+	FParse::Value(CommandLine, TEXT("BenchSeconds="), MinSeconds);
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / FString::Printf(TEXT("FModelBenchmark-%s.json"), *FDateTime::Now().ToString());
+	FParse::Value(CommandLine, TEXT("BenchOut="), OutputPath, false);
+
+	FModelBenchmarkSuite::FRecorder Recorder(MinSeconds);
+	FModelBenchmarkSuite::RunUncompress(Recorder);
+	FModelBenchmarkSuite::RunDecrypt(Recorder);
+
+	FVfsPlatformFile& Provider = *FFModelApp::Get().Provider;
+	Provider.Mount();
+	FString KeysValue;
+	TMap<FGuid, FAES::FAESKey> Keys;
+	if (FParse::Value(CommandLine, TEXT("AES="), KeysValue, false) && ParseAESKeys(KeysValue, Keys))
+	{
+		Provider.SubmitKeys(Keys);
+	}
+	FModelBenchmarkSuite::RunSerialize(Recorder, Provider);
+	FModelBenchmarkSuite::RunDecompress(Recorder, Provider);
+	FModelBenchmarkSuite::RunMapped(Recorder, Provider);
+	FModelBenchmarkSuite::RunLookup(Recorder, Provider);
+
+	if (!Recorder.Save(OutputPath))
+	{
+		UE_LOG(LogFModel, Error, TEXT("Failed to write %s"), *OutputPath);
+		return 1;
+	}
+	UE_LOG(LogFModel, Display, TEXT("Benchmark results written to %s"), *OutputPath);
+	return 0;
+}
@@ -0,0 +1,105 @@
+#include "FModelApp.h"
+#include "BulkExporter.h"
+
+/**
+ * -Headless [-Paks=Dir;Dir] [-AES=Key|Guid:Key,...] [-List=Filter;...] [-Export=Filter;... -Out=Dir]
+ *
+ * Filters are wildcards or file/directory paths, see FVfsMountSnapshot::ForEachMatch. A key without a GUID is for
+ * archives encrypted with the zero GUID. Returns non-zero if a key is malformed or rejected by its archives, a filter
+ * matches nothing or anything fails to export.
+ */
+int RunHeadless(const TCHAR* CommandLine)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	int32 ExitCode = 0;
+	FVfsPlatformFile& Provider = *FFModelApp::Get().Provider;
+	Provider.Mount();
+
+	FString KeysValue;
+	if (FParse::Value(CommandLine, TEXT("AES="), KeysValue, false))
+	{
+		TMap<FGuid, FAES::FAESKey> Keys;
+		if (!ParseAESKeys(KeysValue, Keys))
+		{
+			ExitCode = 1;
+		}
+		TArray<FGuid> Rejected;
+		Provider.SubmitKeys(Keys, nullptr, &Rejected);
+		for (const FGuid& Guid : Rejected)
+		{
+			UE_LOG(LogFModel, Error, TEXT("The key given for %s was rejected"), *Guid.ToString());
+			ExitCode = 1;
+		}
+	}
+
+	TRefCountPtr<const FVfsMountSnapshot> Snapshot = Provider.GetSnapshot();
+	UE_LOG(LogFModel, Display, TEXT("%d archives mounted, %d paths (%.2fs)"), Snapshot->Archives.Num(), Snapshot->PathIndex.Num(), FPlatformTime::Seconds() - StartTime);
+
+	FString ListValue;
+	if (FParse::Value(CommandLine, TEXT("List="), ListValue, false))
+	{
+		TArray<FString> Filters;
+		ListValue.ParseIntoArray(Filters, TEXT(";"));
+		// Paths go to stdout without log decoration so scripts can consume them, in batches to keep the output calls few
+		FString Batch;
+		int32 NumListed = 0;
+		for (const FString& Filter : Filters)
+		{
+			const int32 NumListedBefore = NumListed;
+			Snapshot->ForEachMatch(Filter, [&](const FVfsPathLocation& Location)
+			{
+				Batch += Snapshot->Archives[Location.VfsSlot].Index->GetPath(Location.EntryIndex);
+				Batch += LINE_TERMINATOR;
+				++NumListed;
+				if (Batch.Len() > 64 * 1024)
+				{
+					FPlatformMisc::LocalPrint(*Batch);
+					Batch.Reset();
+				}
+			});
+			if (NumListed == NumListedBefore)
+			{
+				UE_LOG(LogFModel, Warning, TEXT("Nothing mounted matches %s"), *Filter);
+				ExitCode = 1;
+			}
+		}
+		FPlatformMisc::LocalPrint(*Batch);
+		UE_LOG(LogFModel, Display, TEXT("Listed %d paths"), NumListed);
+	}
+
+	FString ExportValue;
+	if (FParse::Value(CommandLine, TEXT("Export="), ExportValue, false))
+	{
+		FString OutputDirectory = FPaths::ProjectSavedDir() / TEXT("Exports");
+		FParse::Value(CommandLine, TEXT("Out="), OutputDirectory, false);
+		TArray<FString> Filters;
+		ExportValue.ParseIntoArray(Filters, TEXT(";"));
+		FBulkExporter Exporter(Provider, OutputDirectory);
+		for (const FString& Filter : Filters)
+		{
+			if (!Exporter.Add(Filter))
+			{
+				UE_LOG(LogFModel, Warning, TEXT("Nothing mounted matches %s"), *Filter);
+				ExitCode = 1;
+			}
+		}
+		double NextReport = 1.0;
+		const FBulkExportProgress Result = Exporter.Run([&NextReport](const FBulkExportProgress& Progress)
+		{
+			if (Progress.Seconds >= NextReport)
+			{
+				UE_LOG(LogFModel, Display, TEXT("Exporting: %d/%d files, %.0f files/s, %.2f MB/s"),
+					Progress.NumExported, Progress.NumToExport, Progress.GetFilesPerSecond(), Progress.GetMBPerSecond());
+				NextReport = Progress.Seconds + 1.0;
+			}
+			return true;
+		});
+		if (Result.NumFailed)
+		{
+			ExitCode = 1;
+		}
+	}
+
+	UE_LOG(LogFModel, Display, TEXT("Headless run finished in %.2fs"), FPlatformTime::Seconds() - StartTime);
+	return ExitCode;
+}
@@ -0,0 +1 @@
+#include "FModelStats.h"
@@ -0,0 +1,53 @@
+#include "FModelApp.h"
+#include "Misc/AutomationTest.h"
+
+/**
+ * FModelTests [-TestFilter=FModel.SubmitKeys], or -RunTests on any target built with the automation tests
+ *
+ * Runs the automation tests whose full path starts with the filter, FModel. by default, and logs every error they
+ * report. Returns non-zero if any of them fails or none matches.
+ */
+int RunTests(const TCHAR* CommandLine)
+{
+#if WITH_DEV_AUTOMATION_TESTS
+	FString Filter = TEXT("FModel.");
+	FParse::Value(CommandLine, TEXT("TestFilter="), Filter);
+
+	FAutomationTestFramework& Framework = FAutomationTestFramework::Get();
+	Framework.SetRequestedTestFilter(EAutomationTestFlags::EngineFilter);
+	TArray<FAutomationTestInfo> TestInfos;
+	Framework.GetValidTestNames(TestInfos);
+
+	int32 NumRun = 0;
+	int32 NumFailed = 0;
+	for (const FAutomationTestInfo& TestInfo : TestInfos)
+	{
+		if (!TestInfo.GetFullTestPath().StartsWith(Filter))
+		{
+			continue;
+		}
+		const double StartTime = FPlatformTime::Seconds();
+		Framework.StartTestByName(TestInfo.GetTestName(), 0);
+		while (!Framework.ExecuteLatentCommands())
+		{
+		}
+		FAutomationTestExecutionInfo ExecutionInfo;
+		const bool bPassed = Framework.StopTest(ExecutionInfo);
+		for (const FAutomationExecutionEntry& Entry : ExecutionInfo.GetEntries())
+		{
+			if (Entry.Event.Type == EAutomationEventType::Error)
+			{
+				UE_LOG(LogFModel, Error, TEXT("%s: %s"), *TestInfo.GetFullTestPath(), *Entry.ToString());
+			}
+		}
+		UE_LOG(LogFModel, Display, TEXT("%s %s (%.2fs)"), *TestInfo.GetFullTestPath(), bPassed ? TEXT("passed") : TEXT("failed"), FPlatformTime::Seconds() - StartTime);
+		++NumRun;
+		NumFailed += bPassed ? 0 : 1;
+	}
+	UE_LOG(LogFModel, Display, TEXT("%d of %d tests matching %s passed"), NumRun - NumFailed, NumRun, *Filter);
+	return NumRun && !NumFailed ? 0 : 1;
+#else
+	UE_LOG(LogFModel, Error, TEXT("Automation tests are not compiled into this build, build the FModelTests target"));
+	return 1;
+#endif
+}
@@ -0,0 +1 @@
+#include "FileTree.h"
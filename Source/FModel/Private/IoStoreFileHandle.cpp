@@ -0,0 +1 @@
+#include "IoStoreFileHandle.h"
@@ -0,0 +1 @@
+#include "LZ4Frame.h"
@@ -0,0 +1,7 @@
+#include "FModelApp.h"
+#include "UnixCommonStartup.h"
+
+int main(int argc, char* argv[])
+{
+	return CommonUnixMain(argc, argv, &RunApplication);
+}
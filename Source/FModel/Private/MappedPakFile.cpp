@@ -0,0 +1 @@
+#include "MappedPakFile.h"
@@ -0,0 +1 @@
+#include "PakBlockCache.h"
@@ -1 +1,20 @@
 ﻿#include "Paks.h"
+
+template <typename Tag, typename Tag::FType Member>
+struct TPrivateMemberAccessor
+{
+	friend typename Tag::FType GetPrivateMember(Tag) { return Member; }
+};
+
+// Explicit instantiations may name private members
+template struct TPrivateMemberAccessor<FPakFileLoadIndexAccess, &FPakFile::LoadIndex>;
+
+bool FPakUtils::LoadIndex(FPakFile& PakFile, IPlatformFile* LowerLevel)
+{
+	FSharedPakReader Reader = PakFile.GetSharedReader(LowerLevel);
+	if (!Reader)
+	{
+		return false;
+	}
+	return (PakFile.*GetPrivateMember(FPakFileLoadIndexAccess()))(Reader.GetArchive());
+}
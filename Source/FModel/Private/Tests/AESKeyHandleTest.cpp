@@ -0,0 +1,84 @@
+#include "AESKeyHandle.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace AESKeyHandleTest
+{
+	/** FIPS-197 appendix C.3, AES-256 */
+	static const uint8 FipsKey[32] =
+	{
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+		0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	};
+	static const uint8 FipsPlaintext[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+	static const uint8 FipsCiphertext[16] = { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 };
+
+	/** Sizes around the four-block stride of the AES-NI path, the last one leaves a three-block tail */
+	static const int32 BufferSizes[] = { 16, 64, 4096, 4096 + 48 };
+
+	static void TestHandle(FAutomationTestBase& Test, const TCHAR* Name, const FAESKeyHandle& Handle)
+	{
+		uint8 Block[16];
+		FMemory::Memcpy(Block, FipsCiphertext, sizeof(Block));
+		Handle.DecryptData(Block, sizeof(Block));
+		Test.TestTrue(FString::Printf(TEXT("%s decrypts the FIPS-197 vector"), Name), FMemory::Memcmp(Block, FipsPlaintext, sizeof(Block)) == 0);
+
+		FRandomStream Random(17);
+		FAES::FAESKey Key;
+		for (uint8& Byte : Key.Key)
+		{
+			Byte = (uint8)Random.RandHelper(256);
+		}
+		const FAESKeyHandle RandomKeyHandle(FGuid(), Key, Handle.IsExpanded());
+		for (int32 Size : BufferSizes)
+		{
+			TArray<uint8> Plaintext;
+			Plaintext.SetNumUninitialized(Size);
+			for (uint8& Byte : Plaintext)
+			{
+				Byte = (uint8)Random.RandHelper(256);
+			}
+
+			// Round trip through the engine's encryption
+			TArray<uint8> Buffer = Plaintext;
+			FAES::EncryptData(Buffer.GetData(), Size, Key);
+			RandomKeyHandle.DecryptData(Buffer.GetData(), Size);
+			Test.TestTrue(FString::Printf(TEXT("%s undoes FAES::EncryptData on %d bytes"), Name, Size), Buffer == Plaintext);
+
+			// Same output as the engine's decryption on arbitrary input
+			TArray<uint8> Expected = Plaintext;
+			FAES::DecryptData(Expected.GetData(), Size, Key);
+			Buffer = Plaintext;
+			RandomKeyHandle.DecryptData(Buffer.GetData(), Size);
+			Test.TestTrue(FString::Printf(TEXT("%s matches FAES::DecryptData on %d bytes"), Name, Size), Buffer == Expected);
+		}
+	}
+
+	static FAES::FAESKey GetFipsKey()
+	{
+		FAES::FAESKey Key;
+		FMemory::Memcpy(Key.Key, FipsKey, sizeof(FipsKey));
+		return Key;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAESKeyHandleKnownAnswerTest, "FModel.AESKeyHandle.KnownAnswer", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FAESKeyHandleKnownAnswerTest::RunTest(const FString& Parameters)
+{
+	const FAESKeyHandle Handle(FGuid(), AESKeyHandleTest::GetFipsKey());
+	if (!Handle.IsExpanded())
+	{
+		AddInfo(TEXT("No AES-NI on this CPU, only the fallback is covered"));
+	}
+	AESKeyHandleTest::TestHandle(*this, Handle.IsExpanded() ? TEXT("AES-NI") : TEXT("Fallback"), Handle);
+
+	const FAESKeyHandle Fallback(FGuid(), AESKeyHandleTest::GetFipsKey(), false);
+	TestFalse(TEXT("Fallback handle skips AES-NI"), Fallback.IsExpanded());
+	AESKeyHandleTest::TestHandle(*this, TEXT("Fallback"), Fallback);
+	return true;
+}
+
+#endif
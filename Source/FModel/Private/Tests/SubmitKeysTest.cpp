@@ -0,0 +1,193 @@
+#include "FModelApp.h"
+#include "CorpusGenerator.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SubmitKeysTest
+{
+	/**
+	 * One pak of encrypted entries under a plaintext index, seeded per test so each gets a key GUID of its own. Zlib
+	 * entries are checked by decompressing their first block, uncompressed ones by the package tag of a .uasset.
+	 */
+	static bool WriteCorpus(FAutomationTestBase& Test, int32 Seed, FString& OutDirectory, FCorpusKey& OutKey, TMap<FString, TArray<uint8>>& OutContents, const TCHAR* Compression = TEXT("Zlib"))
+	{
+		OutDirectory = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("SubmitKeysTest"));
+		const FCorpusSettings Settings(*FString::Printf(TEXT("-CorpusOut=\"%s\" -CorpusSeed=%d -CorpusFiles=64 -CorpusArchives=1 -CorpusEncrypted=1 -CorpusPlainIndex -CorpusCompression=%s"), *OutDirectory, Seed, Compression));
+		FCorpusGenerator Generator(Settings);
+		if (!Test.TestTrue(TEXT("Corpus written"), Generator.Run()))
+		{
+			return false;
+		}
+		OutKey = Generator.GetKeys()[0];
+		OutContents = Generator.GetExpectedContents();
+		return true;
+	}
+
+	static FAES::FAESKey MakeWrongKey(const FAES::FAESKey& Key)
+	{
+		FAES::FAESKey WrongKey = Key;
+		for (uint8& Byte : WrongKey.Key)
+		{
+			Byte ^= 0x5A;
+		}
+		return WrongKey;
+	}
+
+	static bool IsRegistered(const FGuid& Guid, const FAES::FAESKey& Key)
+	{
+		FAESKeyHandlePtr Registered = FAESKeyRegistry::Get().Find(Guid);
+		return Registered.IsValid() && FMemory::Memcmp(Registered->GetKey().Key, Key.Key, FAES::FAESKey::KeySize) == 0;
+	}
+
+	/** Every entry reads back in full through the key the registry resolves, byte for byte what the generator wrote */
+	static void TestReadAll(FAutomationTestBase& Test, FVfsPlatformFile& Provider, const TMap<FString, TArray<uint8>>& Contents)
+	{
+		TRefCountPtr<const FVfsMountSnapshot> Snapshot = Provider.GetSnapshot();
+		if (!Test.TestEqual(TEXT("Archives in the snapshot"), Snapshot->Archives.Num(), 1))
+		{
+			return;
+		}
+		const FVfsArchiveIndex& Index = *Snapshot->Archives[0].Index;
+		TArray<uint8> Buffer;
+		for (int32 EntryIndex = 0; EntryIndex < Index.Num(); ++EntryIndex)
+		{
+			const FString Path = Index.GetPath(EntryIndex);
+			TUniquePtr<IFileHandle> Handle(Provider.Read(Path));
+			if (!Test.TestTrue(FString::Printf(TEXT("%s opens"), *Path), Handle.IsValid()))
+			{
+				return;
+			}
+			Buffer.SetNumUninitialized(Handle->Size());
+			Test.TestEqual(FString::Printf(TEXT("%s size"), *Path), Handle->Size(), Index.GetEntry(EntryIndex).UncompressedSize);
+			if (!Test.TestTrue(FString::Printf(TEXT("%s reads"), *Path), Handle->Read(Buffer.GetData(), Buffer.Num())))
+			{
+				continue;
+			}
+			const TArray<uint8>* Expected = Contents.Find(Path);
+			if (Test.TestNotNull(FString::Printf(TEXT("%s was generated"), *Path), Expected))
+			{
+				// A wrong key still reads an uncompressed entry "successfully", only the bytes tell
+				Test.TestTrue(FString::Printf(TEXT("%s content"), *Path), Buffer == *Expected);
+			}
+		}
+		Test.TestEqual(TEXT("Entries in the archive"), Index.Num(), Contents.Num());
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSubmitKeysPlaintextIndexTest, "FModel.SubmitKeys.PlaintextIndex", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSubmitKeysPlaintextIndexTest::RunTest(const FString& Parameters)
+{
+	FString Directory;
+	FCorpusKey Key;
+	TMap<FString, TArray<uint8>> Contents;
+	if (!SubmitKeysTest::WriteCorpus(*this, 18, Directory, Key, Contents))
+	{
+		return false;
+	}
+	{
+		FVfsPlatformFile Provider(Directory);
+		Provider.Initialize(&FPlatformFileManager::Get().GetPlatformFile(), TEXT(""));
+		if (TestEqual(TEXT("Archives found"), Provider.UnloadedVfs.Num(), 1))
+		{
+			TestFalse(TEXT("Index is plaintext"), Provider.UnloadedVfs.Array()[0].IsEncrypted());
+			TestEqual(TEXT("Encrypted entries name their key"), Provider.UnloadedVfs.Array()[0].GetEncryptionKeyGuid(), Key.Guid);
+		}
+
+		// The index has nothing to check the key against, the encrypted entries do
+		TMap<FGuid, FAES::FAESKey> Keys;
+		Keys.Add(Key.Guid, Key.Key);
+		TestEqual(TEXT("Archives mounted by SubmitKeys"), Provider.SubmitKeys(Keys), 1);
+		TestTrue(TEXT("Key registered"), FAESKeyRegistry::Get().Find(Key.Guid).IsValid());
+		SubmitKeysTest::TestReadAll(*this, Provider, Contents);
+	}
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSubmitKeysAfterMountTest, "FModel.SubmitKeys.PlaintextIndexAfterMount", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSubmitKeysAfterMountTest::RunTest(const FString& Parameters)
+{
+	FString Directory;
+	FCorpusKey Key;
+	TMap<FString, TArray<uint8>> Contents;
+	if (!SubmitKeysTest::WriteCorpus(*this, 19, Directory, Key, Contents))
+	{
+		return false;
+	}
+	{
+		// Headless and the benchmark suite mount plaintext indices before any key is submitted
+		FVfsPlatformFile Provider(Directory);
+		Provider.Initialize(&FPlatformFileManager::Get().GetPlatformFile(), TEXT(""));
+		TestEqual(TEXT("Archives mounted without a key"), Provider.Mount(), 1);
+		TestFalse(TEXT("Key not registered yet"), FAESKeyRegistry::Get().Find(Key.Guid).IsValid());
+
+		TMap<FGuid, FAES::FAESKey> Keys;
+		Keys.Add(Key.Guid, Key.Key);
+		TestEqual(TEXT("Nothing left to mount"), Provider.SubmitKeys(Keys), 0);
+		TestTrue(TEXT("Key registered for the mounted archive"), FAESKeyRegistry::Get().Find(Key.Guid).IsValid());
+		SubmitKeysTest::TestReadAll(*this, Provider, Contents);
+	}
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSubmitKeysWrongKeyAfterRightKeyTest, "FModel.SubmitKeys.WrongKeyAfterRightKey", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSubmitKeysWrongKeyAfterRightKeyTest::RunTest(const FString& Parameters)
+{
+	FString Directory;
+	FCorpusKey Key;
+	TMap<FString, TArray<uint8>> Contents;
+	if (!SubmitKeysTest::WriteCorpus(*this, 20, Directory, Key, Contents))
+	{
+		return false;
+	}
+	{
+		FVfsPlatformFile Provider(Directory);
+		Provider.Initialize(&FPlatformFileManager::Get().GetPlatformFile(), TEXT(""));
+		TestEqual(TEXT("Archives mounted by SubmitKeys"), Provider.SubmitKey(Key.Guid, Key.Key), 1);
+		TestTrue(TEXT("Right key registered"), SubmitKeysTest::IsRegistered(Key.Guid, Key.Key));
+
+		// Decompressing the block the wrong key decrypted fails, the engine logs that as an error
+		AddExpectedError(TEXT("uncompress"), EAutomationExpectedErrorFlags::Contains, 0);
+		TMap<FGuid, FAES::FAESKey> WrongKeys;
+		WrongKeys.Add(Key.Guid, SubmitKeysTest::MakeWrongKey(Key.Key));
+		TArray<FGuid> Rejected;
+		Provider.SubmitKeys(WrongKeys, nullptr, &Rejected);
+		TestTrue(TEXT("Wrong key reported as rejected"), Rejected.Num() == 1 && Rejected[0] == Key.Guid);
+		TestTrue(TEXT("Right key still registered after a wrong one"), SubmitKeysTest::IsRegistered(Key.Guid, Key.Key));
+		SubmitKeysTest::TestReadAll(*this, Provider, Contents);
+	}
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSubmitKeysUncompressedTest, "FModel.SubmitKeys.PlaintextIndexUncompressed", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSubmitKeysUncompressedTest::RunTest(const FString& Parameters)
+{
+	FString Directory;
+	FCorpusKey Key;
+	TMap<FString, TArray<uint8>> Contents;
+	if (!SubmitKeysTest::WriteCorpus(*this, 21, Directory, Key, Contents, TEXT("None")))
+	{
+		return false;
+	}
+	{
+		FVfsPlatformFile Provider(Directory);
+		Provider.Initialize(&FPlatformFileManager::Get().GetPlatformFile(), TEXT(""));
+		Provider.SubmitKey(Key.Guid, SubmitKeysTest::MakeWrongKey(Key.Key));
+		TestFalse(TEXT("Wrong key rejected by the package tag"), FAESKeyRegistry::Get().Find(Key.Guid).IsValid());
+
+		Provider.SubmitKey(Key.Guid, Key.Key);
+		TestTrue(TEXT("Right key registered"), SubmitKeysTest::IsRegistered(Key.Guid, Key.Key));
+		SubmitKeysTest::TestReadAll(*this, Provider, Contents);
+	}
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return true;
+}
+
+#endif
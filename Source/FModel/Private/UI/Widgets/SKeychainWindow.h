@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include "EditorStyleSet.h"
+#include "FModelApp.h"
+#include "Async/Async.h"
 #include "HttpModule.h"
 #include "Interfaces/IHttpResponse.h"
 #include "Misc/KeyChainUtilities.h"
@@ -18,10 +20,12 @@
 struct FKeyChainEntry
 {
 	FString Name, Key;
+	FGuid Guid;
 
-	FKeyChainEntry(const FString& Name, const FString& Key)
+	FKeyChainEntry(const FString& Name, const FString& Key, const FGuid& Guid = FGuid())
 		: Name(Name),
-		  Key(Key)
+		  Key(Key),
+		  Guid(Guid)
 	{
 	}
 };
@@ -165,7 +169,9 @@ public:
 					FString FileName = SecondaryKey->GetStringField("fileName");
 					FString Key = SecondaryKey->GetStringField("key");
 					int32 ChunkId = FPlatformMisc::GetPakchunkIndexFromPakFile(FileName);
-					Entries.Add(MakeShared<FKeyChainEntry>(FString::Printf(TEXT("Chunk %d"), ChunkId), Key));
+					FGuid KeyGuid;
+					FGuid::Parse(Guid, KeyGuid);
+					Entries.Add(MakeShared<FKeyChainEntry>(FString::Printf(TEXT("Chunk %d"), ChunkId), Key, KeyGuid));
 				}
 				Grid_EncryptionKeys->ClearChildren();
 				for (int32 i = 0; i < Entries.Num(); ++i)
@@ -185,6 +191,7 @@ public:
 						.Font(FCoreStyle::GetDefaultFontStyle("Mono", 10))
 						.MinDesiredWidth(540)
 						.Text(FText::FromString(Entry->Key))
+						.OnTextChanged_Lambda([Entry](const FText& NewText) { Entry->Key = NewText.ToString(); })
 					];
 				}
 			}
@@ -195,6 +202,22 @@ public:
 
 	FReply OnApply()
 	{
+		TMap<FGuid, FAES::FAESKey> KeysToSubmit;
+		for (const TSharedPtr<FKeyChainEntry>& Entry : Entries)
+		{
+			FAES::FAESKey Key;
+			if (!ParseAESKey(Entry->Key, Key))
+			{
+				UE_LOG(LogFModel, Warning, TEXT("Skipping malformed key for %s"), *Entry->Name);
+				continue;
+			}
+			KeysToSubmit.Add(Entry->Guid, Key);
+		}
+		// Mounting happens off the game thread, the main window picks up the new archives through OnMounted
+		Async(EAsyncExecution::Thread, [KeysToSubmit]
+		{
+			FFModelApp::Get().Provider->SubmitKeys(KeysToSubmit);
+		});
 		return FReply::Handled();
 	}
 };
@@ -1,6 +1,10 @@
 ﻿#include "SMainWindow.h"
 
+#include "BulkExporter.h"
+#include "FFModelBackupWriter.h"
 #include "FModelApp.h"
+#include "SStatsView.h"
+#include "Async/Async.h"
 #include "Brushes/SlateImageBrush.h"
 #include "Framework/Docking/TabManager.h"
 #include "HAL/FileManagerGeneric.h"
@@ -12,6 +16,7 @@
 #include "Widgets/Input/SButton.h"
 #include "Widgets/Input/SMultiLineEditableTextBox.h"
 #include "Widgets/Input/STextComboBox.h"
+#include "Widgets/Notifications/SProgressBar.h"
 #include "Widgets/Navigation/SBreadcrumbTrail.h"
 #include "Widgets/Views/STreeView.h"
 
@@ -33,7 +38,7 @@ void SMainWindow::MakeDirectoryMenu(FMenuBuilder& MenuBuilder)
 		INVTEXT("Backup"),
 		FText::GetEmpty(),
 		FSlateIcon(),
-		FUIAction()
+		FUIAction(FExecuteAction::CreateSP(this, &SMainWindow::WriteBackup))
 	);
 	MenuBuilder.AddMenuEntry(
 		INVTEXT("Archives Info"),
@@ -62,7 +67,7 @@ void SMainWindow::MakeAssetsMenu(FMenuBuilder& MenuBuilder)
 		INVTEXT("Export Raw Data"),
 		FText::GetEmpty(),
 		FSlateIcon(),
-		FUIAction()
+		FUIAction(FExecuteAction::CreateSP(this, &SMainWindow::ExportSelectedFiles))
 	);
 	MenuBuilder.AddMenuEntry(
 		INVTEXT("Save Property"),
@@ -92,6 +97,12 @@ void SMainWindow::MakeToolsMenu(FMenuBuilder& MenuBuilder)
 		FSlateIcon(),
 		FUIAction()
 	);
+	MenuBuilder.AddMenuEntry(
+		INVTEXT("Stats"),
+		FText::GetEmpty(),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateLambda([this] { TabManager->TryInvokeTab(FName("Stats")); }))
+	);
 }
 
 void SMainWindow::MakeHelpMenu(FMenuBuilder& MenuBuilder)
@@ -137,54 +148,9 @@ void SMainWindow::MakeHelpMenu(FMenuBuilder& MenuBuilder)
 	);
 }
 
-void FFileTreeNode::AddEntry(const FString& sEntry, int wBegIndex)
-{
-	if (wBegIndex < sEntry.Len())
-	{
-		int32 wEndIndex = sEntry.Find(TEXT("/"), ESearchCase::CaseSensitive, ESearchDir::FromStart, wBegIndex);
-		if (wEndIndex == -1)
-		{
-			wEndIndex = sEntry.Len();
-		}
-		FString sKey = sEntry.Mid(wBegIndex, wEndIndex - wBegIndex);
-		if (!sKey.IsEmpty())
-		{
-			TSharedPtr<FFileTreeNode>& oItem = Entries.FindOrAdd(sKey);
-			if (!oItem.IsValid())
-			{
-				oItem = MakeShared<FFileTreeNode>();
-				oItem->Path = sEntry.Left(wEndIndex);
-				oItem->Parent = this;
-			}
-			oItem->AddEntry(sEntry, wEndIndex + 1);
-		}
-	}
-}
-
-TArray<TSharedPtr<FFileTreeNode>>* FFileTreeNode::GetEntries()
-{
-	if (EntriesList)
-	{
-		return EntriesList;
-	}
-	EntriesList = new TArray<TSharedPtr<FFileTreeNode>>();
-	Entries.GenerateValueArray(*EntriesList);
-	Algo::Sort(*EntriesList, [](const TSharedPtr<FFileTreeNode>& A, const TSharedPtr<FFileTreeNode>& B)
-	{
-		bool AIsFile = A->IsFile();
-		bool BIsFile = B->IsFile();
-		if (AIsFile != BIsFile)
-		{
-			return BIsFile;
-		}
-		return A->GetName() < B->GetName();
-	});;
-	return EntriesList;
-}
-
-TUniquePtr<FArchive> Read(const TSharedPtr<FFileTreeNode>& Item)
+TUniquePtr<FArchive> Read(const FString& Path)
 {
-	const TCHAR* Filename = *Item->Path;
+	const TCHAR* Filename = *Path;
 	if (IFileHandle* File = FFModelApp::Get().Provider->Read(Filename))
 	{
 		if (TUniquePtr<FArchive> Reader = MakeUnique<FArchiveFileReaderGeneric>(File, Filename, File->Size()))
@@ -230,18 +196,16 @@ TArray<FString> TextExtensions = {
 	"uproject"
 };
 
-TSharedRef<SWidget> PopulateTabContents(const TSharedPtr<FFileTreeNode>& Item)
+TSharedRef<SWidget> PopulateTabContents(const FString& Path)
 {
-	check(Item->IsFile());
-
-	TUniquePtr<FArchive> ArPtr = Read(Item);
+	TUniquePtr<FArchive> ArPtr = Read(Path);
 	if (!ArPtr)
 	{
 		return EmptyInTheMiddle(INVTEXT("Failed to load file"));
 	}
 
 	FArchive& Ar = *ArPtr;
-	FString Ext = FPaths::GetExtension(Item->Path).ToLower();
+	FString Ext = FPaths::GetExtension(Path).ToLower();
 	if (Ext == TEXT("uasset"))
 	{
 		return EmptyInTheMiddle(INVTEXT("Coming soon"));
@@ -249,7 +213,7 @@ TSharedRef<SWidget> PopulateTabContents(const TSharedPtr<FFileTreeNode>& Item)
 	else if (Ext == TEXT("locmeta"))
 	{
 		FTextLocalizationMetaDataResource LocMeta;
-		LocMeta.LoadFromArchive(Ar, Item->Path);
+		LocMeta.LoadFromArchive(Ar, Path);
 
 		FString JsonString;
 		TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&JsonString);
@@ -267,7 +231,7 @@ TSharedRef<SWidget> PopulateTabContents(const TSharedPtr<FFileTreeNode>& Item)
 	else if (Ext == TEXT("locres"))
 	{
 		FTextLocalizationResource LocRes;
-		LocRes.LoadFromArchive(Ar, FTextKey(Item->Path), 0);
+		LocRes.LoadFromArchive(Ar, FTextKey(Path), 0);
 
 		FString JsonString;
 		TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&JsonString);
@@ -338,6 +302,8 @@ void SMainWindow::Construct(const FArguments& Args)
 		FNewMenuDelegate::CreateSP(this, &SMainWindow::MakeHelpMenu)
 	);
 
+	FilesListState->bVirtual = FParse::Param(FCommandLine::Get(), TEXT("VirtualFileTree"));
+
 	const TSharedRef<SDockTab> DockTab = SNew(SDockTab).TabRole(MajorTab);
 	TabManager = FGlobalTabmanager::Get()->NewTabManager(DockTab);
 	TSharedRef<FWorkspaceItem> AppMenuGroup = TabManager->AddLocalWorkspaceMenuCategory(INVTEXT("FModel"));
@@ -396,17 +362,42 @@ void SMainWindow::Construct(const FArguments& Args)
 				[
 					SNew(SButton)
 					.HAlign(HAlign_Center)
-					.Text(INVTEXT("Load"))
+					.Text_Lambda([this] { return IsFilesListBusy() ? INVTEXT("Cancel") : INVTEXT("Load"); })
 					.OnClicked_Lambda([this]
 					{
-						FAES::FAESKey Key;
+						if (IsFilesListBusy())
+						{
+							CancelFilesList();
+							return FReply::Handled();
+						}
+						TMap<FGuid, FAES::FAESKey> KeysToSubmit;
+						FAES::FAESKey& Key = KeysToSubmit.Add(FGuid());
 						HexToBytes(TEXT("DAE1418B289573D4148C72F3C76ABC7E2DB9CAA618A3EAF2D8580EB3A1BB7A63"), Key.Key);
-						FFModelApp::Get().Provider->SubmitKey(FGuid(), Key);
-						BuildFilesList();
+						BuildFilesList(KeysToSubmit);
 						return FReply::Handled();
 					})
 				]
 				+ SVerticalBox::Slot()
+				.AutoHeight()
+				.Padding(4, 0, 4, 4)
+				[
+					SNew(SVerticalBox)
+					.Visibility_Lambda([this] { return IsFilesListBusy() ? EVisibility::Visible : EVisibility::Collapsed; })
+					+ SVerticalBox::Slot()
+					.AutoHeight()
+					[
+						SNew(SProgressBar)
+						.Percent(this, &SMainWindow::GetFilesListProgress)
+					]
+					+ SVerticalBox::Slot()
+					.AutoHeight()
+					.Padding(0, 2, 0, 0)
+					[
+						SNew(STextBlock)
+						.Text(this, &SMainWindow::GetFilesListProgressText)
+					]
+				]
+				+ SVerticalBox::Slot()
 				.FillHeight(1.0f)
 				[
 					SAssignNew(List_Archives, SListView<TSharedPtr<FVfsEntry>>)
@@ -458,38 +449,43 @@ void SMainWindow::Construct(const FArguments& Args)
 				+ SVerticalBox::Slot()
 				.FillHeight(1.0f)
 				[
-					SAssignNew(Tree_Files, STreeView<TSharedPtr<FFileTreeNode>>)
-					.TreeItemsSource(Files.GetEntries())
-					.OnGenerateRow_Lambda([](TSharedPtr<FFileTreeNode> InItem, const TSharedRef<STableViewBase>& InOwner) -> TSharedRef<ITableRow>
+					SAssignNew(Tree_Files, STreeView<FFileTreeNode*>)
+					.TreeItemsSource(Files.GetRootItems())
+					.OnGenerateRow_Lambda([](FFileTreeNode* InItem, const TSharedRef<STableViewBase>& InOwner) -> TSharedRef<ITableRow>
 					{
-						return SNew(STableRow<TSharedPtr<FFileTreeNode>>, InOwner)
+						return SNew(STableRow<FFileTreeNode*>, InOwner)
 						[
 							SNew(STextBlock).Text(FText::FromString(InItem->GetName()))
 						];
 					})
-					.OnGetChildren_Lambda([](TSharedPtr<FFileTreeNode> Item, TArray<TSharedPtr<FFileTreeNode>>& OutChildren)
+					.OnGetChildren_Lambda([this](FFileTreeNode* Item, TArray<FFileTreeNode*>& OutChildren)
 					{
-						OutChildren = *Item->GetEntries();
+						if (FilesListState->bVirtual && Item->bIsDirectory)
+						{
+							// Also asked for visible collapsed directories (to know whether they can expand), one level ahead is cheap
+							PopulateDirectory(Item);
+						}
+						OutChildren.Append(Files.GetChildren(Item));
 					})
-					.OnMouseButtonDoubleClick_Lambda([this](TSharedPtr<FFileTreeNode> Item)
+					.OnMouseButtonDoubleClick_Lambda([this](FFileTreeNode* Item)
 					{
-						if (Item.IsValid() && Item->IsFile())
+						if (Item && Item->IsFile())
 						{
 							TSharedRef<SDockTab> Tab = SNew(SDockTab)
 								.TabRole(DocumentTab)
 								.Label(FText::FromString(Item->GetName()))
 								[
-									PopulateTabContents(Item)
+									PopulateTabContents(Files.GetPath(Item))
 								];
 							TabManager->InsertNewDocumentTab("Document", FTabManager::ESearchPreference::RequireClosedTab, Tab);
 						}
 					})
-					.OnSelectionChanged_Lambda([this](TSharedPtr<FFileTreeNode> InItem, ESelectInfo::Type SelectInfo)
+					.OnSelectionChanged_Lambda([this](FFileTreeNode* InItem, ESelectInfo::Type SelectInfo)
 					{
 						Breadcrumb_Path->ClearCrumbs();
 						TArray<FFileTreeNode*> NodesToRoot;
-						FFileTreeNode* Current = InItem.Get();
-						while (Current && !Current->Path.IsEmpty())
+						FFileTreeNode* Current = InItem;
+						while (Current && Current->Parent)
 						{
 							NodesToRoot.Add(Current);
 							Current = Current->Parent;
@@ -504,6 +500,17 @@ void SMainWindow::Construct(const FArguments& Args)
 		return Tab;
 	}));
 
+	TabManager->RegisterTabSpawner("Stats", FOnSpawnTab::CreateLambda([](const FSpawnTabArgs& Args)
+	{
+		return SNew(SDockTab)
+			.Label(INVTEXT("Stats"))
+			[
+				SNew(SStatsView)
+			];
+	}))
+	.SetDisplayName(INVTEXT("Stats"))
+	.SetGroup(AppMenuGroup);
+
 	const TSharedRef<FTabManager::FLayout> Layout = FTabManager::NewLayout("FModel_v1.0")
 		->AddArea
 		(
@@ -530,9 +537,10 @@ void SMainWindow::Construct(const FArguments& Args)
 				->Split
 				(
 					FTabManager::NewStack()
-					->SetHideTabWell(true)
 					->SetSizeCoefficient(0.25f)
 					->AddTab("OutputLog", ETabState::OpenedTab)
+					->AddTab("Stats", ETabState::OpenedTab)
+					->SetForegroundTab(FName("OutputLog"))
 				)
 			)
 		);
@@ -552,6 +560,40 @@ void SMainWindow::Construct(const FArguments& Args)
 	);
 
 	// TabManager->TryInvokeTab(FName("WidgetReflector"));
+
+	// Runs on whichever thread mounted, only the shared state is touched there
+	OnMountedHandle = FFModelApp::Get().Provider->OnMounted.AddLambda([State = FilesListState, WeakWindow = TWeakPtr<SMainWindow>(StaticCastSharedRef<SMainWindow>(AsShared()))](const TArray<FVfs>& NewlyMounted)
+	{
+		const uint32 Generation = State->Generation.Load();
+		TArray<FVfs> NewArchives = FilterArchives((ELoadingMode)State->LoadingMode.Load(), NewlyMounted);
+		if (!NewArchives.Num())
+		{
+			return;
+		}
+		if (State->bVirtual)
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakWindow, Generation, NewArchives = MoveTemp(NewArchives)]
+			{
+				if (TSharedPtr<SMainWindow> Window = WeakWindow.Pin())
+				{
+					Window->AddVirtualTreeArchives(Generation, NewArchives);
+				}
+			});
+			return;
+		}
+		++State->NumPending;
+		ListArchives(State, Generation, MoveTemp(NewArchives), WeakWindow);
+		--State->NumPending;
+	});
+}
+
+SMainWindow::~SMainWindow()
+{
+	CancelFilesList();
+	if (FVfsPlatformFile* Provider = FFModelApp::Get().Provider)
+	{
+		Provider->OnMounted.Remove(OnMountedHandle);
+	}
 }
 
 void SMainWindow::BuildArchivesList()
@@ -588,42 +630,310 @@ void SMainWindow::BuildArchivesList()
 	});
 }
 
-void SMainWindow::BuildFilesList()
+void SMainWindow::BuildFilesList(const TMap<FGuid, FAES::FAESKey>& KeysToSubmit)
 {
+	// Nodes are about to be freed, nothing may keep pointing at them
+	Tree_Files->ClearSelection();
+	Tree_Files->ClearExpandedItems();
+	Breadcrumb_Path->ClearCrumbs();
 	Files.Reset();
-	TArray<FVfs> VfsToLoad;
-	ELoadingMode LoadingMode = *ComboBox_LoadingMode->GetSelectedItem();
-	auto Provider = FFModelApp::Get().Provider;
+	UpdateFilesList();
+
+	FFilesListState& State = *FilesListState;
+	const uint32 Generation = ++State.Generation;
+	const ELoadingMode LoadingMode = *ComboBox_LoadingMode->GetSelectedItem();
+	State.LoadingMode = (int32)LoadingMode;
+	State.bCancelled = false;
+	State.NumMounted = 0;
+	State.NumToMount = 0;
+	State.NumListed = 0;
+	State.NumToList = 0;
+
+	// Anything mounted from here on comes in through OnMounted, listing an archive twice is harmless
+	TArray<FVfs> VfsToList = FilterArchives(LoadingMode, FFModelApp::Get().Provider->GetSnapshot()->Archives);
+	VirtualTreeArchives.Reset();
+	if (State.bVirtual)
+	{
+		VirtualTreeArchives = MoveTemp(VfsToList);
+	}
+
+	++State.NumPending;
+	TWeakPtr<SMainWindow> WeakWindow = StaticCastSharedRef<SMainWindow>(AsShared());
+	Async(EAsyncExecution::Thread, [State = FilesListState, Generation, WeakWindow, KeysToSubmit, VfsToList = MoveTemp(VfsToList)]() mutable
+	{
+		if (KeysToSubmit.Num())
+		{
+			FFModelApp::Get().Provider->SubmitKeys(KeysToSubmit, [&State](int32 NumMounted, int32 NumToMount)
+			{
+				State->NumToMount = NumToMount;
+				State->NumMounted = NumMounted;
+				return !State->bCancelled.Load();
+			});
+		}
+		ListArchives(State, Generation, MoveTemp(VfsToList), WeakWindow);
+		--State->NumPending;
+		AsyncTask(ENamedThreads::GameThread, [Generation, WeakWindow]
+		{
+			if (TSharedPtr<SMainWindow> Window = WeakWindow.Pin())
+			{
+				Window->OnFilesListFinished(Generation);
+			}
+		});
+	});
+}
+
+TArray<FVfs> SMainWindow::FilterArchives(ELoadingMode LoadingMode, const TArray<FVfs>& Candidates)
+{
+	TArray<FVfs> Result;
 	if (LoadingMode == ELoadingMode::All)
 	{
-		for (const FVfs& Vfs : Provider->MountedVfs)
+		Result = Candidates;
+	}
+	return Result;
+}
+
+void SMainWindow::ListArchives(const TSharedRef<FFilesListState, ESPMode::ThreadSafe>& State, uint32 Generation, TArray<FVfs> VfsToList, const TWeakPtr<SMainWindow>& WeakWindow)
+{
+	if (!VfsToList.Num())
+	{
+		return;
+	}
+	// Biggest archives first so the first batches show most of the tree
+	VfsToList.Sort([](const FVfs& A, const FVfs& B) { return A.Index->Num() > B.Index->Num(); });
+	State->NumToList += VfsToList.Num();
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	const int32 BatchSize = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	int32 NumListed = 0;
+	for (int32 BatchStart = 0; BatchStart < VfsToList.Num(); BatchStart += BatchSize)
+	{
+		if (State->bCancelled.Load() || State->Generation.Load() != Generation)
+		{
+			break;
+		}
+		const int32 NumInBatch = FMath::Min(BatchSize, VfsToList.Num() - BatchStart);
+		TArray<FFileTree> PartialTrees;
+		PartialTrees.SetNum(NumInBatch);
+		ParallelFor(NumInBatch, [&](int32 Index)
+		{
+			const FVfsArchiveIndex& ArchiveIndex = *VfsToList[BatchStart + Index].Index;
+			for (int32 EntryIndex = 0; EntryIndex < ArchiveIndex.Num(); ++EntryIndex)
+			{
+				PartialTrees[Index].AddEntry(ArchiveIndex.GetPath(EntryIndex));
+			}
+		});
+		FFileTree::MergeAll(PartialTrees);
+		NumListed += NumInBatch;
+		State->NumListed += NumInBatch;
+
+		TSharedRef<FFileTree, ESPMode::ThreadSafe> Batch = MakeShared<FFileTree, ESPMode::ThreadSafe>(MoveTemp(PartialTrees[0]));
+		AsyncTask(ENamedThreads::GameThread, [Generation, WeakWindow, Batch]
+		{
+			if (TSharedPtr<SMainWindow> Window = WeakWindow.Pin())
+			{
+				Window->OnFilesListBatch(Generation, *Batch);
+			}
+		});
+	}
+	UE_LOG(LogFModel, Display, TEXT("Listed %d of %d archives in %.2fms"), NumListed, VfsToList.Num(),
+		FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+}
+
+void SMainWindow::AddDirectoryChildren(FFileTreeNode* Directory, const TArray<FVfs>& Sources)
+{
+	FString Path = Files.GetPath(Directory);
+	if (!Path.IsEmpty())
+	{
+		Path.AppendChar(TEXT('/'));
+	}
+	FTCHARToUTF8 Utf8Path(*Path, Path.Len());
+	const FAnsiStringView DirectoryView((const ANSICHAR*)Utf8Path.Get(), Utf8Path.Length());
+	for (const FVfs& Vfs : Sources)
+	{
+		Vfs.Index->ListDirectory(DirectoryView, [this, Directory](FAnsiStringView Name, bool bIsDirectory)
+		{
+			FUTF8ToTCHAR Converted(Name.GetData(), Name.Len());
+			Files.AddChild(Directory, FStringView(Converted.Get(), Converted.Length()), bIsDirectory);
+		});
+	}
+}
+
+void SMainWindow::PopulateDirectory(FFileTreeNode* Directory)
+{
+	if (Directory->bPopulated)
+	{
+		return;
+	}
+	Directory->bPopulated = true;
+	AddDirectoryChildren(Directory, VirtualTreeArchives);
+	// Only this directory is dirty, the sorted children stay cached on the node from now on
+	Files.Finalize();
+}
+
+void SMainWindow::AddVirtualTreeArchives(uint32 Generation, const TArray<FVfs>& NewArchives)
+{
+	if (Generation != FilesListState->Generation.Load())
+	{
+		return;
+	}
+	TArray<FVfs> Added;
+	for (const FVfs& Vfs : NewArchives)
+	{
+		if (!VirtualTreeArchives.Contains(Vfs))
 		{
-			VfsToLoad.Add(Vfs);
+			VirtualTreeArchives.Add(Vfs);
+			Added.Add(Vfs);
 		}
 	}
-	if (!VfsToLoad.Num())
+	if (!Added.Num() || !Files.GetRoot()->bPopulated)
 	{
-		UpdateFilesList();
 		return;
 	}
-	for (const FVfs& Vfs : VfsToLoad)
+
+	// Directories listed so far only need the new archives' children, the rest get them on first expansion
+	TArray<FFileTreeNode*> Populated;
+	Populated.Add(Files.GetRoot());
+	for (int32 Index = 0; Index < Populated.Num(); ++Index)
 	{
-		if (Vfs.Type != EVfsType::Pak) continue;
-		FPakFile& PakFile = *Vfs.PakFile;
-		for (FPakFile::FPakEntryIterator It(PakFile, false); It; ++It)
+		for (FFileTreeNode* Child : Files.GetChildren(Populated[Index]))
 		{
-			if (const FString* Filename = It.TryGetFilename())
+			if (Child->bPopulated)
 			{
-				Files.AddEntry(Vfs.GetMountPoint() / *Filename);
+				Populated.Add(Child);
 			}
 		}
 	}
+	for (FFileTreeNode* Directory : Populated)
+	{
+		AddDirectoryChildren(Directory, Added);
+	}
+	Files.Finalize();
 	UpdateFilesList();
 }
 
+void SMainWindow::CancelFilesList()
+{
+	// Mounting and listing stop at their next archive or batch, whatever was listed so far stays in the tree
+	FilesListState->bCancelled = true;
+}
+
+void SMainWindow::OnFilesListBatch(uint32 Generation, FFileTree& Batch)
+{
+	if (Generation != FilesListState->Generation.Load())
+	{
+		return;
+	}
+	if (!Files.Num())
+	{
+		// Nothing is displayed yet, so no widget holds on to the old nodes
+		Files = MoveTemp(Batch);
+	}
+	else
+	{
+		// Only the batch's entries are inserted and only directories that gained children get re-sorted,
+		// existing nodes keep their addresses so selection and expansion survive
+		Files.Merge(Batch);
+	}
+	Files.Finalize();
+	UpdateFilesList();
+}
+
+void SMainWindow::OnFilesListFinished(uint32 Generation)
+{
+	if (Generation != FilesListState->Generation.Load())
+	{
+		return;
+	}
+	if (FilesListState->bVirtual)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		PopulateDirectory(Files.GetRoot());
+		UpdateFilesList();
+		UE_LOG(LogFModel, Display, TEXT("Virtual file tree: listed the root of %d archives in %.2fms"),
+			VirtualTreeArchives.Num(), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+		return;
+	}
+	UE_LOG(LogFModel, Display, TEXT("File tree: %d nodes in %.2f MiB (the previous FFileTreeNode layout needed ~%.2f MiB)"),
+		Files.Num(), Files.GetAllocatedSize() / 1048576.0, Files.GetLegacyAllocatedSizeEstimate() / 1048576.0);
+}
+
+FText SMainWindow::GetFilesListProgressText() const
+{
+	const FFilesListState& State = *FilesListState;
+	if (State.NumListed.Load() < State.NumToList.Load())
+	{
+		return FText::Format(INVTEXT("Listing archives {0} / {1}"), State.NumListed.Load(), State.NumToList.Load());
+	}
+	return FText::Format(INVTEXT("Mounting archives {0} / {1}"), State.NumMounted.Load(), State.NumToMount.Load());
+}
+
+TOptional<float> SMainWindow::GetFilesListProgress() const
+{
+	const FFilesListState& State = *FilesListState;
+	const bool bListing = State.NumListed.Load() < State.NumToList.Load();
+	const int32 Done = bListing ? State.NumListed.Load() : State.NumMounted.Load();
+	const int32 Total = bListing ? State.NumToList.Load() : State.NumToMount.Load();
+	// Marquee until the total is known
+	return Total ? TOptional<float>((float)Done / Total) : TOptional<float>();
+}
+
 void SMainWindow::UpdateFilesList()
 {
-	Tree_Files->SetTreeItemsSource(Files.GetEntries());
+	Tree_Files->SetTreeItemsSource(Files.GetRootItems());
+	Tree_Files->RequestTreeRefresh();
 	// @todo: Empty text
 }
 
+void SMainWindow::ExportSelectedFiles()
+{
+	// Selected directories export their whole subtree, whether a virtual tree listed it yet or not
+	TArray<FString> Filters;
+	for (FFileTreeNode* Node : Tree_Files->GetSelectedItems())
+	{
+		Filters.Add(Files.GetPath(Node));
+	}
+	if (!Filters.Num())
+	{
+		UE_LOG(LogFModel, Warning, TEXT("Nothing selected to export"));
+		return;
+	}
+	FString OutputDirectory = FPaths::ProjectSavedDir() / TEXT("Exports");
+	FParse::Value(FCommandLine::Get(), TEXT("ExportDir="), OutputDirectory);
+
+	Async(EAsyncExecution::Thread, [Filters = MoveTemp(Filters), OutputDirectory]
+	{
+		FBulkExporter Exporter(*FFModelApp::Get().Provider, OutputDirectory);
+		for (const FString& Filter : Filters)
+		{
+			Exporter.Add(Filter);
+		}
+		double NextReport = 1.0;
+		Exporter.Run([&NextReport](const FBulkExportProgress& Progress)
+		{
+			if (Progress.Seconds >= NextReport)
+			{
+				UE_LOG(LogFModel, Display, TEXT("Exporting: %d/%d files, %.0f files/s, %.2f MB/s"),
+					Progress.NumExported, Progress.NumToExport, Progress.GetFilesPerSecond(), Progress.GetMBPerSecond());
+				NextReport = Progress.Seconds + 1.0;
+			}
+			return true;
+		});
+	});
+}
+
+void SMainWindow::WriteBackup()
+{
+	FString OutputDirectory = FPaths::ProjectSavedDir() / TEXT("Backups");
+	FParse::Value(FCommandLine::Get(), TEXT("BackupDir="), OutputDirectory);
+	const FString Filename = OutputDirectory / FString::Printf(TEXT("FModel-%s.fbkp"), *FDateTime::Now().ToString());
+
+	Async(EAsyncExecution::Thread, [Filename]
+	{
+		FFModelBackupWriter Writer(*FFModelApp::Get().Provider);
+		if (Writer.Write(Filename))
+		{
+			UE_LOG(LogFModel, Display, TEXT("Backup of %lld entries written to %s, %.2f MB in %.2fs"),
+				Writer.GetNumEntries(), *FPaths::ConvertRelativePathToFull(Filename), Writer.GetBytesWritten() / 1e6, Writer.GetSeconds());
+		}
+	});
+}
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "FModelApp.h"
+#include "FileTree.h"
 #include "SKeychainWindow.h"
 #include "Framework/MultiBox/MultiBoxBuilder.h"
 #include "PakFile/Public/IPlatformFilePak.h"
@@ -54,28 +55,6 @@ struct FVfsEntry
 	}
 };
 
-struct FFileTreeNode
-{
-	TMap<FString, TSharedPtr<FFileTreeNode>> Entries;
-	TArray<TSharedPtr<FFileTreeNode>>* EntriesList = nullptr;
-	FString Path;
-	FFileTreeNode* Parent = nullptr;
-
-	void AddEntry(const FString& sEntry, int wBegIndex = 0);
-
-	TArray<TSharedPtr<FFileTreeNode>>* GetEntries();
-
-	bool IsFile() const { return Entries.Num() == 0; }
-
-	FString GetName() const { return FPaths::GetCleanFilename(Path); }
-
-	void Reset()
-	{
-		Entries.Reset();
-		EntriesList = nullptr;
-	}
-};
-
 enum class ELoadingMode
 {
 	Single,
@@ -99,18 +78,40 @@ inline const TCHAR* LexToString(ELoadingMode Value)
 	}
 }
 
+/** Shared between the window and the threads mounting and listing archives for it */
+struct FFilesListState
+{
+	/** Bumped whenever the tree is rebuilt from scratch, batches of an older generation are dropped */
+	TAtomic<uint32> Generation { 0 };
+	TAtomic<bool> bCancelled { false };
+	TAtomic<int32> LoadingMode { (int32)ELoadingMode::All };
+	/** -VirtualFileTree: directories are listed from the archive indices on first expansion instead of up front */
+	bool bVirtual = false;
+	/** Mount jobs and listings in flight */
+	TAtomic<int32> NumPending { 0 };
+	TAtomic<int32> NumMounted { 0 };
+	TAtomic<int32> NumToMount { 0 };
+	TAtomic<int32> NumListed { 0 };
+	TAtomic<int32> NumToList { 0 };
+};
+
 class SMainWindow : public SWindow
 {
 protected:
 	TSharedPtr<FTabManager> TabManager;
 	TArray<TSharedPtr<ELoadingMode>> LoadingModeOptions;
 	TArray<TSharedPtr<FVfsEntry>> Archives;
-	FFileTreeNode Files;
+	FFileTree Files;
+	TSharedRef<FFilesListState, ESPMode::ThreadSafe> FilesListState = MakeShared<FFilesListState, ESPMode::ThreadSafe>();
+	/** Archives a virtual tree lists directories from */
+	TArray<FVfs> VirtualTreeArchives;
+	/** Listener Construct adds to FVfsPlatformFile::OnMounted, removed again with the window */
+	FDelegateHandle OnMountedHandle;
 
 	TSharedPtr<SComboBox<TSharedPtr<ELoadingMode>>> ComboBox_LoadingMode;
 	TSharedPtr<SListView<TSharedPtr<FVfsEntry>>> List_Archives;
 	TSharedPtr<SBreadcrumbTrail<FFileTreeNode*>> Breadcrumb_Path;
-	TSharedPtr<STreeView<TSharedPtr<FFileTreeNode>>> Tree_Files;
+	TSharedPtr<STreeView<FFileTreeNode*>> Tree_Files;
 
 public:
 	SLATE_BEGIN_ARGS(SMainWindow) { }
@@ -118,7 +119,7 @@ public:
 	SLATE_END_ARGS()
 
 	// SMainWindow();
-	// virtual	~SMainWindow();
+	virtual ~SMainWindow() override;
 
 	/** Widget constructor */
 	void Construct(const FArguments& Args);
@@ -129,7 +130,30 @@ public:
 	void MakeHelpMenu(FMenuBuilder& MenuBuilder);
 
 	void BuildArchivesList();
-	void BuildFilesList();
+	/**
+	 * Rebuilds the tree: lists the mounted archives and mounts the ones KeysToSubmit unlock in the background.
+	 * Tree_Files fills up in batches, archives mounted later from anywhere are added through FVfsPlatformFile::OnMounted.
+	 */
+	void BuildFilesList(const TMap<FGuid, FAES::FAESKey>& KeysToSubmit = TMap<FGuid, FAES::FAESKey>());
+	void CancelFilesList();
+	bool IsFilesListBusy() const { return FilesListState->NumPending.Load() > 0; }
 
 	void UpdateFilesList();
+
+	/** Extracts the selected files and directory subtrees to Saved/Exports, or -ExportDir=, in the background */
+	void ExportSelectedFiles();
+
+	/** Writes a backup of every mounted entry to Saved/Backups, or -BackupDir=, in the background */
+	void WriteBackup();
+
+private:
+	static TArray<FVfs> FilterArchives(ELoadingMode LoadingMode, const TArray<FVfs>& Candidates);
+	static void ListArchives(const TSharedRef<FFilesListState, ESPMode::ThreadSafe>& State, uint32 Generation, TArray<FVfs> VfsToList, const TWeakPtr<SMainWindow>& WeakWindow);
+	void AddDirectoryChildren(FFileTreeNode* Directory, const TArray<FVfs>& Sources);
+	void PopulateDirectory(FFileTreeNode* Directory);
+	void AddVirtualTreeArchives(uint32 Generation, const TArray<FVfs>& NewArchives);
+	void OnFilesListBatch(uint32 Generation, FFileTree& Batch);
+	void OnFilesListFinished(uint32 Generation);
+	FText GetFilesListProgressText() const;
+	TOptional<float> GetFilesListProgress() const;
 };
@@ -0,0 +1 @@
+﻿#include "SStatsView.h"
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "EditorStyleSet.h"
+#include "FModelStats.h"
+#include "Widgets/Input/SButton.h"
+#include "Widgets/SCompoundWidget.h"
+#include "Widgets/Text/STextBlock.h"
+#include "Widgets/Views/SListView.h"
+
+/** Live FFModelStats table, polled twice a second while the tab is visible */
+class SStatsView : public SCompoundWidget
+{
+	struct FRow
+	{
+		EFModelStat Stat;
+		FFModelStatValues Values;
+		double Utilization = 0.0;
+	};
+
+	TArray<TSharedPtr<FRow>> Rows;
+	TSharedPtr<SListView<TSharedPtr<FRow>>> List_Stats;
+	FText CacheText;
+
+	class SStatRow : public SMultiColumnTableRow<TSharedPtr<FRow>>
+	{
+		TSharedPtr<FRow> Row;
+
+	public:
+		SLATE_BEGIN_ARGS(SStatRow) { }
+		SLATE_END_ARGS()
+
+		void Construct(const FArguments& InArgs, const TSharedRef<STableViewBase>& InOwner, const TSharedPtr<FRow>& InRow)
+		{
+			Row = InRow;
+			SMultiColumnTableRow<TSharedPtr<FRow>>::Construct(FSuperRowType::FArguments().Padding(FMargin(6, 2)), InOwner);
+		}
+
+		virtual TSharedRef<SWidget> GenerateWidgetForColumn(const FName& ColumnName) override
+		{
+			// Read through Row on every paint, the view refreshes the values in place
+			TSharedRef<STextBlock> Text = SNew(STextBlock).Text_Lambda([Row = Row, ColumnName]
+			{
+				FNumberFormattingOptions Options;
+				Options.MaximumFractionalDigits = 2;
+				const FFModelStatValues& Values = Row->Values;
+				if (ColumnName == "Stat")			return FText::FromString(LexToString(Row->Stat));
+				if (ColumnName == "Count")			return FText::AsNumber(Values.Count);
+				if (ColumnName == "Bytes")			return FText::AsMemory(Values.Bytes, &Options);
+				if (ColumnName == "Throughput")		return FText::FromString(FString::Printf(TEXT("%.2f MB/s"), Values.GetMBPerSecond()));
+				if (ColumnName == "Average")		return FText::FromString(FString::Printf(TEXT("%.3f ms"), Values.GetAverageMs()));
+				if (ColumnName == "Max")			return FText::FromString(FString::Printf(TEXT("%.3f ms"), Values.GetMaxMs()));
+				if (ColumnName == "Utilization")	return FText::AsPercent(Row->Utilization, &Options);
+				return FText::GetEmpty();
+			});
+			return Text;
+		}
+	};
+
+public:
+	SLATE_BEGIN_ARGS(SStatsView) { }
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs)
+	{
+		for (int32 Index = 0; Index < (int32)EFModelStat::Count; ++Index)
+		{
+			TSharedPtr<FRow> Row = MakeShared<FRow>();
+			Row->Stat = (EFModelStat)Index;
+			Rows.Add(Row);
+		}
+		Refresh();
+
+		ChildSlot
+		[
+			SNew(SVerticalBox)
+			+ SVerticalBox::Slot()
+			.FillHeight(1.0f)
+			[
+				SAssignNew(List_Stats, SListView<TSharedPtr<FRow>>)
+				.ListItemsSource(&Rows)
+				.SelectionMode(ESelectionMode::None)
+				.OnGenerateRow_Lambda([](TSharedPtr<FRow> InItem, const TSharedRef<STableViewBase>& InOwner) -> TSharedRef<ITableRow>
+				{
+					return SNew(SStatRow, InOwner, InItem);
+				})
+				.HeaderRow
+				(
+					SNew(SHeaderRow)
+					+ SHeaderRow::Column("Stat").DefaultLabel(INVTEXT("Stat")).FillWidth(1.5f)
+					+ SHeaderRow::Column("Count").DefaultLabel(INVTEXT("Count")).FillWidth(1.0f)
+					+ SHeaderRow::Column("Bytes").DefaultLabel(INVTEXT("Bytes")).FillWidth(1.0f)
+					+ SHeaderRow::Column("Throughput").DefaultLabel(INVTEXT("Throughput")).FillWidth(1.0f)
+					+ SHeaderRow::Column("Average").DefaultLabel(INVTEXT("Average")).FillWidth(1.0f)
+					+ SHeaderRow::Column("Max").DefaultLabel(INVTEXT("Max")).FillWidth(1.0f)
+					+ SHeaderRow::Column("Utilization").DefaultLabel(INVTEXT("Cores Busy")).FillWidth(1.0f)
+				)
+			]
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			[
+				SNew(SBorder)
+				.BorderImage(FEditorStyle::GetBrush("ToolPanel.GroupBorder"))
+				.Padding(FMargin(8, 4))
+				[
+					SNew(SHorizontalBox)
+					+ SHorizontalBox::Slot()
+					.FillWidth(1)
+					.VAlign(VAlign_Center)
+					[
+						SNew(STextBlock).Text_Lambda([this] { return CacheText; })
+					]
+					+ SHorizontalBox::Slot()
+					.AutoWidth()
+					.Padding(4, 0, 0, 0)
+					[
+						SNew(SButton)
+						.Text(INVTEXT("Reset"))
+						.ToolTipText(INVTEXT("Starts the totals and the cache hit rate over. Cached blocks stay cached."))
+						.OnClicked_Lambda([this]
+						{
+							FFModelStats::Get().Reset();
+							FPakBlockCache::Get().ResetStats();
+							Refresh();
+							return FReply::Handled();
+						})
+					]
+					+ SHorizontalBox::Slot()
+					.AutoWidth()
+					.Padding(4, 0, 0, 0)
+					[
+						SNew(SButton)
+						.Text(INVTEXT("Save"))
+						.ToolTipText(INVTEXT("Writes the totals as JSON to Saved/Stats. Run with -trace=cpu -tracefile=Path for a per-call Unreal Insights trace."))
+						.OnClicked_Lambda([]
+						{
+							const FString Path = FPaths::ProjectSavedDir() / TEXT("Stats") / FString::Printf(TEXT("FModelStats-%s.json"), *FDateTime::Now().ToString());
+							if (FFModelStats::Get().Dump(Path))
+							{
+								UE_LOG(LogFModel, Display, TEXT("Stats written to %s"), *FPaths::ConvertRelativePathToFull(Path));
+							}
+							return FReply::Handled();
+						})
+					]
+				]
+			]
+		];
+
+		RegisterActiveTimer(0.5f, FWidgetActiveTimerDelegate::CreateLambda([this](double InCurrentTime, float InDeltaTime)
+		{
+			Refresh();
+			return EActiveTimerReturnType::Continue;
+		}));
+	}
+
+private:
+	void Refresh()
+	{
+		const FFModelStats& Stats = FFModelStats::Get();
+		for (const TSharedPtr<FRow>& Row : Rows)
+		{
+			Row->Values = Stats.GetValues(Row->Stat);
+			Row->Utilization = Stats.GetUtilization(Row->Values);
+		}
+
+		const FPakBlockCacheStats CacheStats = FPakBlockCache::Get().GetStats();
+		const uint64 Lookups = CacheStats.Hits + CacheStats.Misses;
+		FNumberFormattingOptions Options;
+		Options.MaximumFractionalDigits = 1;
+		CacheText = FText::Format(INVTEXT("Block cache: {0} hit rate, {1} of {2} in {3} blocks, {4} evictions"),
+			FText::AsPercent(Lookups ? (double)CacheStats.Hits / Lookups : 0.0, &Options),
+			FText::AsMemory(CacheStats.UsedBytes, &Options), FText::AsMemory(FPakBlockCache::Get().GetBudget(), &Options),
+			FText::AsNumber(CacheStats.NumBlocks), FText::AsNumber(CacheStats.Evictions));
+	}
+};
@@ -0,0 +1 @@
+#include "VfsIndexCache.h"
@@ -0,0 +1 @@
+#include "VfsPathIndex.h"
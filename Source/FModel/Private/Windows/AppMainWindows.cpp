@@ -6,6 +6,5 @@
  */
 int WINAPI WinMain( _In_ HINSTANCE hInInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR, _In_ int nCmdShow )
 {
-	RunApplication(GetCommandLineW());
-	return 0;
+	return RunApplication(GetCommandLineW());
 }
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "AtomicSnapshot.h"
+#include "Misc/AES.h"
+#include "Misc/ScopeLock.h"
+
+/**
+ * One AES-256 key with its decryption round keys expanded once, instead of on every FAES::DecryptData call. Immutable
+ * after construction, so any number of threads can decrypt with it. CPUs without AES-NI fall back to FAES::DecryptData.
+ */
+class FAESKeyHandle : public FThreadSafeRefCountedObject
+{
+public:
+	static constexpr int32 NumRounds = 14;
+
+	/** bAllowAESNI false keeps the FAES::DecryptData fallback even where AES-NI is available, for comparing the two */
+	FAESKeyHandle(const FGuid& InGuid, const FAES::FAESKey& InKey, bool bAllowAESNI = true);
+
+	const FGuid& GetGuid() const { return Guid; }
+	const FAES::FAESKey& GetKey() const { return Key; }
+	bool IsExpanded() const { return bExpanded; }
+
+	/** Decrypts in place, Size must be a multiple of FAES::AESBlockSize */
+	void DecryptData(uint8* Data, uint64 Size) const;
+
+private:
+	FGuid Guid;
+	FAES::FAESKey Key;
+	/** In decryption order: the last encryption round key first, the inner ones through InvMixColumns */
+	alignas(16) uint8 RoundKeys[NumRounds + 1][16];
+	bool bExpanded = false;
+};
+
+typedef TRefCountPtr<const FAESKeyHandle> FAESKeyHandlePtr;
+
+/** Parses a key written as 64 hex digits, with or without a 0x prefix */
+inline bool ParseAESKey(const FString& Text, FAES::FAESKey& OutKey)
+{
+	FString Hex = Text.TrimStartAndEnd();
+	Hex.RemoveFromStart(TEXT("0x"), ESearchCase::IgnoreCase);
+	if (Hex.Len() != FAES::FAESKey::KeySize * 2)
+	{
+		return false;
+	}
+	for (TCHAR Char : Hex)
+	{
+		if (!FChar::IsHexDigit(Char))
+		{
+			return false;
+		}
+	}
+	HexToBytes(Hex, OutKey.Key);
+	return true;
+}
+
+/** Parses "[Guid:]Key,[Guid:]Key...", a key without a GUID is for the zero GUID. False if any of them is malformed. */
+inline bool ParseAESKeys(const FString& Text, TMap<FGuid, FAES::FAESKey>& OutKeys)
+{
+	TArray<FString> KeyStrings;
+	Text.ParseIntoArray(KeyStrings, TEXT(","));
+	bool bAllParsed = true;
+	for (const FString& KeyString : KeyStrings)
+	{
+		FString GuidString, HexString = KeyString;
+		FGuid Guid;
+		FAES::FAESKey Key;
+		if (KeyString.Split(TEXT(":"), &GuidString, &HexString) && !FGuid::Parse(GuidString, Guid))
+		{
+			UE_LOG(LogFModel, Error, TEXT("Malformed key GUID %s"), *GuidString);
+			bAllParsed = false;
+		}
+		else if (!ParseAESKey(HexString, Key))
+		{
+			UE_LOG(LogFModel, Error, TEXT("Malformed key for %s, expected 64 hex digits"), *Guid.ToString());
+			bAllParsed = false;
+		}
+		else
+		{
+			OutKeys.Add(Guid, Key);
+		}
+	}
+	return bAllParsed;
+}
+
+struct FAESKeySet : public FThreadSafeRefCountedObject
+{
+	TMap<FGuid, FAESKeyHandlePtr> Handles;
+};
+
+/**
+ * Process-wide GUID to key handle map. Lookups pin the current set without locking, so decryption can resolve keys
+ * while another thread submits new ones. Readers that decrypt many blocks resolve their handle once and keep it.
+ */
+class FAESKeyRegistry
+{
+public:
+	static FAESKeyRegistry& Get()
+	{
+		static FAESKeyRegistry Instance;
+		return Instance;
+	}
+
+	/** Publishes Handle under its GUID, replacing the handle registered before. Holders of that one keep it alive. */
+	void Add(const FAESKeyHandlePtr& Handle)
+	{
+		FScopeLock Lock(&WriteLock);
+		FAESKeySet* NewSet = new FAESKeySet();
+		NewSet->Handles = Set.Get()->Handles;
+		NewSet->Handles.Add(Handle->GetGuid(), Handle);
+		Set.Publish(NewSet);
+	}
+
+	FAESKeyHandlePtr Find(const FGuid& Guid) const
+	{
+		TAtomicSnapshot<FAESKeySet>::FReadScope Current(Set);
+		const FAESKeyHandlePtr* Found = Current->Handles.Find(Guid);
+		return Found ? *Found : nullptr;
+	}
+
+private:
+	FCriticalSection WriteLock;
+	TAtomicSnapshot<FAESKeySet> Set;
+};
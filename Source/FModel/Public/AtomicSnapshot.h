@@ -0,0 +1,176 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/ScopeRWLock.h"
+#include "Templates/RefCounting.h"
+
+/** Index of the calling thread's pin slot, the same in every TAtomicSnapshot, given back when the thread exits */
+class FAtomicSnapshotThreadSlot
+{
+public:
+	static constexpr int32 MaxSlots = 256;
+
+	/** INDEX_NONE once every slot is taken, such threads go through TAtomicSnapshot's fallback lock */
+	static int32 Get()
+	{
+		thread_local FAtomicSnapshotThreadSlot Slot;
+		return Slot.Index;
+	}
+
+private:
+	FAtomicSnapshotThreadSlot()
+	{
+		TAtomic<bool>* Claimed = GetClaimed();
+		for (int32 Candidate = 0; Candidate < MaxSlots && Index == INDEX_NONE; ++Candidate)
+		{
+			bool bExpected = false;
+			if (!Claimed[Candidate].Load(EMemoryOrder::Relaxed) && Claimed[Candidate].CompareExchange(bExpected, true))
+			{
+				Index = Candidate;
+			}
+		}
+	}
+
+	~FAtomicSnapshotThreadSlot()
+	{
+		if (Index != INDEX_NONE)
+		{
+			GetClaimed()[Index] = false;
+		}
+	}
+
+	static TAtomic<bool>* GetClaimed()
+	{
+		static TAtomic<bool> Claimed[MaxSlots];
+		return Claimed;
+	}
+
+	int32 Index = INDEX_NONE;
+};
+
+/**
+ * Publishes immutable, ref-counted snapshots of some state. Readers never lock and never write a shared cache line:
+ * FReadScope announces the snapshot it is about to use in the thread's own pin slot and checks it is still current,
+ * which is enough to keep it alive for the scope. Get() does the same and adds a reference for holders that outlive a
+ * scope. Publish swaps in the new snapshot and waits only for slots still pinning the old one before releasing it;
+ * readers arriving after the swap pin the new one, so a writer cannot be starved by a steady stream of lookups.
+ *
+ * Threads past MaxSlots and scopes nested on one thread take a reference under a shared lock instead.
+ * Writers must be serialized by the caller and must not hold a FReadScope of the same snapshot while publishing.
+ */
+template <typename SnapshotType>
+class TAtomicSnapshot
+{
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FSlot
+	{
+		TAtomic<const SnapshotType*> Pinned { nullptr };
+	};
+
+public:
+	/** Keeps the current snapshot alive until the end of the scope, for lookups on the hot path */
+	class FReadScope
+	{
+	public:
+		explicit FReadScope(const TAtomicSnapshot& Owner)
+		{
+			const int32 SlotIndex = FAtomicSnapshotThreadSlot::Get();
+			if (SlotIndex != INDEX_NONE && !Owner.Slots[SlotIndex].Pinned.Load(EMemoryOrder::Relaxed))
+			{
+				Slot = &Owner.Slots[SlotIndex].Pinned;
+				Snapshot = Owner.Pin(*Slot);
+			}
+			else
+			{
+				Reference = Owner.GetLocked();
+				Snapshot = Reference.GetReference();
+			}
+		}
+
+		~FReadScope()
+		{
+			// Sequentially consistent, everything read through the snapshot has to be done before Publish sees the slot clear
+			if (Slot)
+			{
+				Slot->Store(nullptr);
+			}
+		}
+
+		FReadScope(const FReadScope&) = delete;
+		FReadScope& operator=(const FReadScope&) = delete;
+
+		const SnapshotType& operator*() const { return *Snapshot; }
+		const SnapshotType* operator->() const { return Snapshot; }
+
+	private:
+		TAtomic<const SnapshotType*>* Slot = nullptr;
+		const SnapshotType* Snapshot = nullptr;
+		TRefCountPtr<const SnapshotType> Reference;
+	};
+
+	TAtomicSnapshot()
+		: Current(new SnapshotType())
+	{
+		Current.Load()->AddRef();
+	}
+
+	~TAtomicSnapshot()
+	{
+		Current.Load()->Release();
+	}
+
+	TRefCountPtr<const SnapshotType> Get() const
+	{
+		FReadScope Scope(*this);
+		return TRefCountPtr<const SnapshotType>(&*Scope);
+	}
+
+	void Publish(SnapshotType* NewSnapshot)
+	{
+		NewSnapshot->AddRef();
+		const SnapshotType* OldSnapshot;
+		{
+			FRWScopeLock Lock(FallbackLock, SLT_Write);
+			OldSnapshot = Current.Exchange(NewSnapshot);
+		}
+		// Only readers that pinned OldSnapshot before the exchange are waited for, each is a lookup away from done
+		for (const FSlot& Slot : Slots)
+		{
+			while (Slot.Pinned.Load() == OldSnapshot)
+			{
+				FPlatformProcess::Yield();
+			}
+		}
+		OldSnapshot->Release();
+	}
+
+private:
+	/**
+	 * Hazard pointer style: the pin is stored before Current is read again, and Publish exchanges Current before it
+	 * reads the pins, so either Publish sees the pin or the reader sees the new snapshot and retries with that one.
+	 */
+	const SnapshotType* Pin(TAtomic<const SnapshotType*>& Slot) const
+	{
+		const SnapshotType* Snapshot = Current.Load(EMemoryOrder::Relaxed);
+		for (;;)
+		{
+			Slot.Store(Snapshot);
+			const SnapshotType* Validated = Current.Load();
+			if (Validated == Snapshot)
+			{
+				return Snapshot;
+			}
+			Snapshot = Validated;
+		}
+	}
+
+	TRefCountPtr<const SnapshotType> GetLocked() const
+	{
+		FRWScopeLock Lock(FallbackLock, SLT_ReadOnly);
+		return TRefCountPtr<const SnapshotType>(Current.Load());
+	}
+
+	TAtomic<SnapshotType*> Current;
+	mutable FSlot Slots[FAtomicSnapshotThreadSlot::MaxSlots];
+	mutable FRWLock FallbackLock;
+};
@@ -0,0 +1,433 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "FModelApp.h"
+#include "Async/Async.h"
+#include "HAL/Event.h"
+
+/**
+ * Tuning for bulk exports, parsed from the command line once.
+ */
+struct FBulkExportSettings
+{
+	/** Threads opening entries and reading them, decrypting and decompressing on the way */
+	int32 NumReaders = 4;
+	/** Threads writing finished files */
+	int32 NumWriters = 2;
+	/** Ceiling on file contents held between reading and writing */
+	int64 MaxBytesInFlight = 512 * 1024 * 1024;
+	/** Bigger files are streamed to disk by their reader in chunks of this size instead of being handed to a writer */
+	int64 StreamChunkSize = 16 * 1024 * 1024;
+
+	FBulkExportSettings()
+	{
+		NumReaders = FMath::Max(FPlatformMisc::NumberOfCores(), 1);
+		FParse::Value(FCommandLine::Get(), TEXT("ExportReaders="), NumReaders);
+		FParse::Value(FCommandLine::Get(), TEXT("ExportWriters="), NumWriters);
+		int64 MaxBytesInFlightMB = MaxBytesInFlight / (1024 * 1024);
+		FParse::Value(FCommandLine::Get(), TEXT("ExportMemoryMB="), MaxBytesInFlightMB);
+		NumReaders = FMath::Max(NumReaders, 1);
+		NumWriters = FMath::Max(NumWriters, 1);
+		MaxBytesInFlight = FMath::Max<int64>(MaxBytesInFlightMB, 1) * 1024 * 1024;
+		StreamChunkSize = FMath::Min(StreamChunkSize, MaxBytesInFlight);
+	}
+
+	static FBulkExportSettings& Get()
+	{
+		static FBulkExportSettings Settings;
+		return Settings;
+	}
+};
+
+struct FBulkExportProgress
+{
+	int32 NumExported = 0;
+	int32 NumFailed = 0;
+	int32 NumToExport = 0;
+	int64 BytesWritten = 0;
+	int64 BytesToExport = 0;
+	int64 PeakBytesInFlight = 0;
+	double Seconds = 0.0;
+
+	double GetFilesPerSecond() const { return Seconds > 0.0 ? NumExported / Seconds : 0.0; }
+	double GetMBPerSecond() const { return Seconds > 0.0 ? BytesWritten / Seconds / 1e6 : 0.0; }
+};
+
+/**
+ * Extracts files out of the mounted archives into a directory. Readers open entries and read them whole, which
+ * decrypts and decompresses them, then queue them for the writers. Queued bytes are bounded by a budget, so a slow
+ * disk stalls the readers instead of piling up memory. Entries go in archive and offset order to keep reads sequential.
+ */
+class FBulkExporter
+{
+public:
+	FBulkExporter(FVfsPlatformFile& InProvider, const FString& InOutputDirectory)
+		: Provider(InProvider)
+		, Snapshot(InProvider.GetSnapshot())
+		, OutputDirectory(InOutputDirectory)
+		, Settings(FBulkExportSettings::Get())
+	{
+	}
+
+	/**
+	 * Queues the files Filter names, see FVfsMountSnapshot::ForEachMatch. Returns the files added. Files whose path would
+	 * land outside the output directory are counted as failed instead.
+	 */
+	int32 Add(const FString& Filter)
+	{
+		int32 NumAdded = 0;
+		Snapshot->ForEachMatch(Filter, [this, &NumAdded](const FVfsPathLocation& Location)
+		{
+			bool bAlreadyQueued = false;
+			Queued.Add(((uint64)Location.VfsSlot << 32) | (uint32)Location.EntryIndex, &bAlreadyQueued);
+			FString OutputPath;
+			if (!bAlreadyQueued && !GetOutputPath(Location.VfsSlot, Location.EntryIndex, OutputPath))
+			{
+				++NumFailed;
+				UE_LOG(LogFModel, Warning, TEXT("Export skipped %s, it would be written outside %s"), *Snapshot->Archives[Location.VfsSlot].Index->GetPath(Location.EntryIndex), *OutputDirectory);
+			}
+			else if (!bAlreadyQueued)
+			{
+				const FVfsIndexEntry& Entry = Snapshot->Archives[Location.VfsSlot].Index->GetEntry(Location.EntryIndex);
+				Items.Add({ Location.VfsSlot, Location.EntryIndex, Entry.Offset, Entry.UncompressedSize });
+				++NumAdded;
+			}
+		});
+		return NumAdded;
+	}
+
+	int32 Num() const { return Items.Num(); }
+
+	/** Blocks until every queued file is written. OnProgress is called on this thread a few times a second, returning false cancels. */
+	FBulkExportProgress Run(TFunction<bool(const FBulkExportProgress&)> OnProgress = nullptr)
+	{
+		Items.Sort([](const FItem& A, const FItem& B) { return A.VfsSlot != B.VfsSlot ? A.VfsSlot < B.VfsSlot : A.Offset < B.Offset; });
+		BytesToExport = 0;
+		for (const FItem& Item : Items)
+		{
+			BytesToExport += Item.Size;
+		}
+		const double StartTime = FPlatformTime::Seconds();
+		QueueEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		BudgetEvent = FPlatformProcess::GetSynchEventFromPool(false);
+		NumReadersLeft = Settings.NumReaders;
+
+		TArray<TFuture<void>> Workers;
+		for (int32 ReaderIndex = 0; ReaderIndex < Settings.NumReaders; ++ReaderIndex)
+		{
+			Workers.Add(Async(EAsyncExecution::Thread, [this] { ReadLoop(); }));
+		}
+		for (int32 WriterIndex = 0; WriterIndex < Settings.NumWriters; ++WriterIndex)
+		{
+			Workers.Add(Async(EAsyncExecution::Thread, [this] { WriteLoop(); }));
+		}
+		for (TFuture<void>& Worker : Workers)
+		{
+			while (!Worker.WaitFor(FTimespan::FromMilliseconds(250)))
+			{
+				if (OnProgress && !OnProgress(GetProgress(FPlatformTime::Seconds() - StartTime)))
+				{
+					bCancelled = true;
+				}
+			}
+		}
+		FPlatformProcess::ReturnSynchEventToPool(QueueEvent);
+		FPlatformProcess::ReturnSynchEventToPool(BudgetEvent);
+		QueueEvent = BudgetEvent = nullptr;
+
+		const FBulkExportProgress Result = GetProgress(FPlatformTime::Seconds() - StartTime);
+		UE_LOG(LogFModel, Display, TEXT("Exported %d of %d files to %s in %.2fs (%.0f files/s, %.2f MB/s, %d failed, peak %.2f MiB in flight)%s"),
+			Result.NumExported, Result.NumToExport, *OutputDirectory, Result.Seconds, Result.GetFilesPerSecond(), Result.GetMBPerSecond(),
+			Result.NumFailed, Result.PeakBytesInFlight / 1048576.0, bCancelled.Load() ? TEXT(", cancelled") : TEXT(""));
+		return Result;
+	}
+
+private:
+	struct FItem
+	{
+		int32 VfsSlot;
+		int32 EntryIndex;
+		int64 Offset;
+		int64 Size;
+	};
+
+	struct FPendingWrite
+	{
+		int32 ItemIndex;
+		TArray<uint8> Data;
+	};
+
+	void ReadLoop()
+	{
+		TArray<uint8> StreamBuffer;
+		while (!bCancelled.Load())
+		{
+			const int32 ItemIndex = NextItem++;
+			if (ItemIndex >= Items.Num())
+			{
+				break;
+			}
+			const FItem& Item = Items[ItemIndex];
+			// Each block is read once, caching them would only push out the ones browsing keeps coming back to
+			TUniquePtr<IFileHandle> Source(Snapshot->Archives[Item.VfsSlot].OpenEntry(Provider.LowerLevel, Item.EntryIndex, false));
+			if (!Source.IsValid())
+			{
+				OnFailed(Item, TEXT("open"));
+				continue;
+			}
+
+			if (Item.Size > Settings.StreamChunkSize)
+			{
+				if (!AcquireBudget(Settings.StreamChunkSize))
+				{
+					break;
+				}
+				StreamBuffer.SetNumUninitialized(Settings.StreamChunkSize, false);
+				StreamToDisk(Item, *Source, StreamBuffer);
+				StreamBuffer.Empty();
+				ReleaseBudget(Settings.StreamChunkSize);
+				continue;
+			}
+
+			if (!AcquireBudget(Item.Size))
+			{
+				break;
+			}
+			FPendingWrite Write { ItemIndex };
+			Write.Data.SetNumUninitialized(Item.Size);
+			if (!Source->Read(Write.Data.GetData(), Item.Size))
+			{
+				ReleaseBudget(Item.Size);
+				OnFailed(Item, TEXT("read"));
+				continue;
+			}
+			{
+				FScopeLock Lock(&QueueLock);
+				Queue.Add(MoveTemp(Write));
+			}
+			QueueEvent->Trigger();
+		}
+		// Writers see zero only after this reader's last push
+		--NumReadersLeft;
+		QueueEvent->Trigger();
+	}
+
+	void WriteLoop()
+	{
+		for (;;)
+		{
+			FPendingWrite Write { INDEX_NONE };
+			{
+				FScopeLock Lock(&QueueLock);
+				if (Queue.Num())
+				{
+					Write = Queue.Pop(false);
+				}
+			}
+			if (Write.ItemIndex == INDEX_NONE)
+			{
+				if (NumReadersLeft.Load() == 0)
+				{
+					FScopeLock Lock(&QueueLock);
+					if (!Queue.Num())
+					{
+						break;
+					}
+					continue;
+				}
+				QueueEvent->Wait(10);
+				continue;
+			}
+
+			const FItem& Item = Items[Write.ItemIndex];
+			FString Path;
+			TUniquePtr<IFileHandle> Target(OpenOutput(Item, Path));
+			const bool bWritten = Target.IsValid() && CloseOutput(Target, Path, Target->Write(Write.Data.GetData(), Write.Data.Num()));
+			ReleaseBudget(Write.Data.Num());
+			if (bWritten)
+			{
+				BytesWritten += Item.Size;
+				++NumExported;
+			}
+			else
+			{
+				OnFailed(Item, TEXT("write"));
+			}
+		}
+	}
+
+	void StreamToDisk(const FItem& Item, IFileHandle& Source, TArray<uint8>& Buffer)
+	{
+		FString Path;
+		TUniquePtr<IFileHandle> Target(OpenOutput(Item, Path));
+		if (!Target.IsValid())
+		{
+			OnFailed(Item, TEXT("write"));
+			return;
+		}
+		for (int64 Offset = 0; Offset < Item.Size; Offset += Buffer.Num())
+		{
+			const int64 ChunkSize = FMath::Min<int64>(Buffer.Num(), Item.Size - Offset);
+			if (!Source.Read(Buffer.GetData(), ChunkSize) || !Target->Write(Buffer.GetData(), ChunkSize))
+			{
+				CloseOutput(Target, Path, false);
+				OnFailed(Item, TEXT("stream"));
+				return;
+			}
+			BytesWritten += ChunkSize;
+			if (bCancelled.Load())
+			{
+				CloseOutput(Target, Path, false);
+				return;
+			}
+		}
+		if (!CloseOutput(Target, Path, true))
+		{
+			OnFailed(Item, TEXT("write"));
+			return;
+		}
+		++NumExported;
+	}
+
+	/**
+	 * Where an entry goes under OutputDirectory. Archive paths are untrusted: ".." segments are collapsed, and paths that
+	 * still climb out, or are rooted or name a drive of their own, are refused.
+	 */
+	bool GetOutputPath(int32 VfsSlot, int32 EntryIndex, FString& OutPath) const
+	{
+		FString RelativePath = Snapshot->Archives[VfsSlot].Index->GetPath(EntryIndex);
+		RelativePath.ReplaceCharInline(TEXT('\\'), TEXT('/'));
+		while (RelativePath.StartsWith(TEXT("/")))
+		{
+			RelativePath.RemoveAt(0, 1, false);
+		}
+		if (RelativePath.Contains(TEXT(":")) || !FPaths::CollapseRelativeDirectories(RelativePath)
+			|| RelativePath.IsEmpty() || RelativePath == TEXT("..") || RelativePath.StartsWith(TEXT("../")) || RelativePath.StartsWith(TEXT("/")))
+		{
+			return false;
+		}
+		OutPath = OutputDirectory / RelativePath;
+		return true;
+	}
+
+	/**
+	 * Opens OutPath + ".tmp" for writing, CloseOutput moves it to OutPath once complete. A failed or cancelled export
+	 * never leaves a truncated file under the final name.
+	 */
+	IFileHandle* OpenOutput(const FItem& Item, FString& OutPath) const
+	{
+		IPlatformFile& PlatformFile = *Provider.LowerLevel;
+		if (!GetOutputPath(Item.VfsSlot, Item.EntryIndex, OutPath))
+		{
+			return nullptr;
+		}
+		const FString TempPath = OutPath + TEXT(".tmp");
+		IFileHandle* Handle = PlatformFile.OpenWrite(*TempPath);
+		if (!Handle)
+		{
+			// Directories are only created on the first miss, most files land in one that exists already
+			PlatformFile.CreateDirectoryTree(*FPaths::GetPath(OutPath));
+			Handle = PlatformFile.OpenWrite(*TempPath);
+		}
+		return Handle;
+	}
+
+	/** Closes Target and moves it over Path if bComplete, deletes it otherwise. Returns whether Path now holds it. */
+	bool CloseOutput(TUniquePtr<IFileHandle>& Target, const FString& Path, bool bComplete) const
+	{
+		IPlatformFile& PlatformFile = *Provider.LowerLevel;
+		const FString TempPath = Path + TEXT(".tmp");
+		bComplete = bComplete && Target->Flush();
+		Target.Reset();
+		if (bComplete)
+		{
+			// MoveFile does not replace an existing file on every platform
+			PlatformFile.DeleteFile(*Path);
+			if (PlatformFile.MoveFile(*Path, *TempPath))
+			{
+				return true;
+			}
+		}
+		PlatformFile.DeleteFile(*TempPath);
+		return false;
+	}
+
+	/** A file bigger than the whole budget still gets through on its own */
+	bool AcquireBudget(int64 Size)
+	{
+		for (;;)
+		{
+			{
+				FScopeLock Lock(&BudgetLock);
+				if (BytesInFlight == 0 || BytesInFlight + Size <= Settings.MaxBytesInFlight)
+				{
+					BytesInFlight += Size;
+					PeakBytesInFlight = FMath::Max(PeakBytesInFlight, BytesInFlight);
+					return true;
+				}
+			}
+			if (bCancelled.Load())
+			{
+				return false;
+			}
+			BudgetEvent->Wait(10);
+		}
+	}
+
+	void ReleaseBudget(int64 Size)
+	{
+		{
+			FScopeLock Lock(&BudgetLock);
+			BytesInFlight -= Size;
+		}
+		BudgetEvent->Trigger();
+	}
+
+	void OnFailed(const FItem& Item, const TCHAR* Stage)
+	{
+		++NumFailed;
+		UE_LOG(LogFModel, Warning, TEXT("Export failed to %s %s"), Stage, *Snapshot->Archives[Item.VfsSlot].Index->GetPath(Item.EntryIndex));
+	}
+
+	FBulkExportProgress GetProgress(double Seconds)
+	{
+		FBulkExportProgress Progress;
+		Progress.NumExported = NumExported.Load();
+		Progress.NumFailed = NumFailed.Load();
+		Progress.NumToExport = Items.Num();
+		Progress.BytesWritten = BytesWritten.Load();
+		Progress.BytesToExport = BytesToExport;
+		{
+			FScopeLock Lock(&BudgetLock);
+			Progress.PeakBytesInFlight = PeakBytesInFlight;
+		}
+		Progress.Seconds = Seconds;
+		return Progress;
+	}
+
+	FVfsPlatformFile& Provider;
+	/** Pinned for the whole export, slots and entry indices refer to it */
+	TRefCountPtr<const FVfsMountSnapshot> Snapshot;
+	FString OutputDirectory;
+	const FBulkExportSettings& Settings;
+	TArray<FItem> Items;
+	TSet<uint64> Queued;
+	int64 BytesToExport = 0;
+
+	TAtomic<int32> NextItem { 0 };
+	TAtomic<int32> NumReadersLeft { 0 };
+	TAtomic<bool> bCancelled { false };
+	TAtomic<int32> NumExported { 0 };
+	TAtomic<int32> NumFailed { 0 };
+	TAtomic<int64> BytesWritten { 0 };
+
+	FCriticalSection QueueLock;
+	TArray<FPendingWrite> Queue;
+	FEvent* QueueEvent = nullptr;
+
+	FCriticalSection BudgetLock;
+	int64 BytesInFlight = 0;
+	int64 PeakBytesInFlight = 0;
+	FEvent* BudgetEvent = nullptr;
+};
@@ -0,0 +1,645 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "IO/IoStore.h"
+#include "IPlatformFilePak.h"
+#include "Math/RandomStream.h"
+#include "Misc/AES.h"
+#include "Misc/FileHelper.h"
+#include "Misc/SecureHash.h"
+#include "Serialization/MemoryWriter.h"
+
+enum class ECorpusFormat : uint8
+{
+	Pak,
+	IoStore,
+	/** Even archives are paks, odd ones IoStore containers, like installs that ship both */
+	Mixed
+};
+
+/**
+ * Shape of a synthetic corpus, parsed from the command line. Everything derives from Seed, so the same settings
+ * always produce byte-identical archives.
+ */
+struct FCorpusSettings
+{
+	FString OutputDirectory;
+	FString MountPoint = TEXT("../../../FModelCorpus/");
+	ECorpusFormat Format = ECorpusFormat::Pak;
+	int32 Seed = 0;
+	int32 NumFiles = 10000;
+	/** Base archives the files are split across, by default one per 50k files */
+	int32 NumArchives = 0;
+	/** Average files per directory, directories nest randomly up to MaxDepth */
+	int32 FilesPerDirectory = 32;
+	int32 MaxDepth = 6;
+	int32 MinNameLength = 4;
+	int32 MaxNameLength = 24;
+	/** File sizes are log-uniform between these, raised to SizeSkew first so that small files dominate */
+	int64 MinFileSize = 64;
+	int64 MaxFileSize = 256 * 1024;
+	float SizeSkew = 2.0f;
+	/** Share of file content that is random bytes rather than compressible text */
+	float Entropy = 0.3f;
+	/** Each file picks one at random, NAME_None stores it uncompressed. IoStore containers use the first codec only. */
+	TArray<FName> CompressionMethods;
+	int32 CompressionBlockSize = 64 * 1024;
+	/** Share of archives that are encrypted, cycling through NumKeys keys derived from Seed */
+	float EncryptedFraction = 0.0f;
+	int32 NumKeys = 1;
+	/** -CorpusPlainIndex: encrypted paks keep their entries encrypted but write the index in the clear, as some games do */
+	bool bEncryptIndex = true;
+	/** Share of files that a _P archive overrides with different content */
+	float PatchFraction = 0.0f;
+
+	explicit FCorpusSettings(const TCHAR* CommandLine)
+	{
+		OutputDirectory = FPaths::ProjectSavedDir() / TEXT("Corpus");
+		FParse::Value(CommandLine, TEXT("CorpusOut="), OutputDirectory, false);
+		FString FormatName;
+		if (FParse::Value(CommandLine, TEXT("CorpusFormat="), FormatName))
+		{
+			Format = FormatName == TEXT("IoStore") ? ECorpusFormat::IoStore : FormatName == TEXT("Mixed") ? ECorpusFormat::Mixed : ECorpusFormat::Pak;
+		}
+		FParse::Value(CommandLine, TEXT("CorpusSeed="), Seed);
+		FParse::Value(CommandLine, TEXT("CorpusFiles="), NumFiles);
+		FParse::Value(CommandLine, TEXT("CorpusArchives="), NumArchives);
+		FParse::Value(CommandLine, TEXT("CorpusFilesPerDir="), FilesPerDirectory);
+		FParse::Value(CommandLine, TEXT("CorpusDepth="), MaxDepth);
+		FParse::Value(CommandLine, TEXT("CorpusMinName="), MinNameLength);
+		FParse::Value(CommandLine, TEXT("CorpusMaxName="), MaxNameLength);
+		FParse::Value(CommandLine, TEXT("CorpusMinSize="), MinFileSize);
+		FParse::Value(CommandLine, TEXT("CorpusMaxSize="), MaxFileSize);
+		FParse::Value(CommandLine, TEXT("CorpusSizeSkew="), SizeSkew);
+		FParse::Value(CommandLine, TEXT("CorpusEntropy="), Entropy);
+		FParse::Value(CommandLine, TEXT("CorpusBlockSize="), CompressionBlockSize);
+		FParse::Value(CommandLine, TEXT("CorpusEncrypted="), EncryptedFraction);
+		FParse::Value(CommandLine, TEXT("CorpusKeys="), NumKeys);
+		bEncryptIndex = !FParse::Param(CommandLine, TEXT("CorpusPlainIndex"));
+		FParse::Value(CommandLine, TEXT("CorpusPatch="), PatchFraction);
+
+		// -CorpusCompression=Zlib,LZ4,None
+		FString MethodNames = TEXT("Zlib,None");
+		FParse::Value(CommandLine, TEXT("CorpusCompression="), MethodNames, false);
+		TArray<FString> Methods;
+		MethodNames.ParseIntoArray(Methods, TEXT(","));
+		for (const FString& Method : Methods)
+		{
+			const FName MethodName = Method == TEXT("None") ? NAME_None : FName(*Method);
+			if (MethodName != NAME_None && !FCompression::IsFormatValid(MethodName))
+			{
+				UE_LOG(LogFModel, Warning, TEXT("Compression method %s is not available, skipped"), *Method);
+				continue;
+			}
+			CompressionMethods.AddUnique(MethodName);
+		}
+		if (!CompressionMethods.Num())
+		{
+			CompressionMethods.Add(NAME_None);
+		}
+
+		NumFiles = FMath::Max(NumFiles, 1);
+		if (NumArchives <= 0)
+		{
+			NumArchives = FMath::Clamp(NumFiles / 50000, 1, 256);
+		}
+		NumArchives = FMath::Clamp(NumArchives, 1, NumFiles);
+		FilesPerDirectory = FMath::Max(FilesPerDirectory, 1);
+		MaxDepth = FMath::Max(MaxDepth, 1);
+		MinNameLength = FMath::Max(MinNameLength, 1);
+		MaxNameLength = FMath::Max(MaxNameLength, MinNameLength);
+		MinFileSize = FMath::Max<int64>(MinFileSize, 1);
+		MaxFileSize = FMath::Max(MaxFileSize, MinFileSize);
+		// Encoded pak entries store the block size in units of 2KiB
+		CompressionBlockSize = FMath::Clamp(Align(CompressionBlockSize, 2048), 2048, 4 * 1024 * 1024);
+		NumKeys = FMath::Max(NumKeys, 1);
+	}
+};
+
+struct FCorpusKey
+{
+	FGuid Guid;
+	FAES::FAESKey Key;
+};
+
+/** One generated file, everything about it derived from its index */
+struct FCorpusFile
+{
+	int32 Index;
+	/** Relative to the mount point */
+	FString Path;
+	int64 Size;
+	FName CompressionMethod;
+	bool bPatched;
+};
+
+/**
+ * Writes a synthetic install of .pak and .utoc/.ucas archives, for measuring mounting, listing and reading at a chosen
+ * scale without a game install. Paks are written directly in the latest pak version with an encoded primary index and a
+ * full directory index; there is no path hash index, so readers fall back to the directory index. IoStore containers go
+ * through the engine's IoStore writer. The keys of encrypted archives are written next to them as an -AES= argument.
+ */
+class FCorpusGenerator
+{
+public:
+	explicit FCorpusGenerator(const FCorpusSettings& InSettings)
+		: Settings(InSettings)
+	{
+		FRandomStream Random(Settings.Seed);
+		for (int32 KeyIndex = 0; KeyIndex < Settings.NumKeys; ++KeyIndex)
+		{
+			FCorpusKey& Key = Keys.AddDefaulted_GetRef();
+			Key.Guid = FGuid(0x46434F52, (uint32)Settings.Seed, 0, KeyIndex + 1);
+			for (uint8& Byte : Key.Key.Key)
+			{
+				Byte = (uint8)Random.RandHelper(256);
+			}
+		}
+		BuildDirectories(Random);
+	}
+
+	/** Every key archives may be encrypted with, the same ones Run writes to Keys.txt */
+	const TArray<FCorpusKey>& GetKeys() const { return Keys; }
+
+	/**
+	 * What reading each generated file back has to give, keyed by its mounted path, patched files with their patched
+	 * content. Generates every file again, meant for the tests' small corpora.
+	 */
+	TMap<FString, TArray<uint8>> GetExpectedContents() const
+	{
+		FString MountPoint = Settings.MountPoint;
+		MountPoint.RemoveFromStart(TEXT("../../../"));
+		TMap<FString, TArray<uint8>> Contents;
+		for (int32 FileIndex = 0; FileIndex < Settings.NumFiles; ++FileIndex)
+		{
+			const FCorpusFile File = MakeFile(FileIndex);
+			MakeContent(File, File.bPatched ? 1 : 0, Contents.Add(MountPoint + File.Path));
+		}
+		return Contents;
+	}
+
+	bool Run()
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		IFileManager::Get().MakeDirectory(*Settings.OutputDirectory, true);
+
+		bool bSucceeded = true;
+		int64 TotalBytes = 0;
+		int32 NumWritten = 0;
+		FString KeysArgument;
+		TArray<FCorpusFile> PatchFiles;
+		// Archives take contiguous file index ranges and are generated one at a time, the _P archive comes last
+		for (int32 ArchiveIndex = 0; ArchiveIndex <= Settings.NumArchives; ++ArchiveIndex)
+		{
+			const bool bPatch = ArchiveIndex == Settings.NumArchives;
+			TArray<FCorpusFile> Files;
+			if (bPatch)
+			{
+				Files = MoveTemp(PatchFiles);
+			}
+			else
+			{
+				const int32 FirstFile = (int64)ArchiveIndex * Settings.NumFiles / Settings.NumArchives;
+				const int32 EndFile = (int64)(ArchiveIndex + 1) * Settings.NumFiles / Settings.NumArchives;
+				Files.Reserve(EndFile - FirstFile);
+				for (int32 FileIndex = FirstFile; FileIndex < EndFile; ++FileIndex)
+				{
+					FCorpusFile& File = Files.Add_GetRef(MakeFile(FileIndex));
+					if (File.bPatched)
+					{
+						PatchFiles.Add(File);
+					}
+				}
+			}
+			if (!Files.Num())
+			{
+				continue;
+			}
+			// Sorted by path inside the archive, like a cooked install
+			Files.Sort([](const FCorpusFile& A, const FCorpusFile& B) { return A.Path < B.Path; });
+
+			const FString BaseFilename = Settings.OutputDirectory / (bPatch
+				? TEXT("pakchunk0-Corpus_P")
+				: FString::Printf(TEXT("pakchunk%d-Corpus"), ArchiveIndex));
+			const FCorpusKey* Key = GetArchiveKey(ArchiveIndex);
+			if (Key && !KeysArgument.Contains(Key->Guid.ToString()))
+			{
+				KeysArgument += FString::Printf(TEXT("%s%s:0x%s"), KeysArgument.Len() ? TEXT(",") : TEXT(""), *Key->Guid.ToString(), *BytesToHex(Key->Key.Key, sizeof(Key->Key.Key)));
+			}
+
+			const double ArchiveStartTime = FPlatformTime::Seconds();
+			const bool bIoStore = Settings.Format == ECorpusFormat::IoStore || (Settings.Format == ECorpusFormat::Mixed && (ArchiveIndex & 1));
+			int64 ArchiveBytes = 0;
+			const bool bWritten = bIoStore
+				? WriteIoStore(BaseFilename, Files, bPatch ? 1 : 0, Key, ArchiveBytes)
+				: WritePak(BaseFilename + TEXT(".pak"), Files, bPatch ? 1 : 0, Key, ArchiveBytes);
+			if (!bWritten)
+			{
+				UE_LOG(LogFModel, Error, TEXT("Failed to write %s"), *BaseFilename);
+				bSucceeded = false;
+				continue;
+			}
+			TotalBytes += ArchiveBytes;
+			++NumWritten;
+			UE_LOG(LogFModel, Display, TEXT("Wrote %s.%s: %d files, %.2f MB%s (%.2fs)"), *FPaths::GetCleanFilename(BaseFilename), bIoStore ? TEXT("utoc") : TEXT("pak"),
+				Files.Num(), ArchiveBytes / 1e6, Key ? TEXT(", encrypted") : TEXT(""), FPlatformTime::Seconds() - ArchiveStartTime);
+		}
+
+		if (KeysArgument.Len())
+		{
+			const FString KeysPath = Settings.OutputDirectory / TEXT("Keys.txt");
+			FFileHelper::SaveStringToFile(KeysArgument, *KeysPath);
+			UE_LOG(LogFModel, Display, TEXT("Keys written to %s, mount with -AES=%s"), *KeysPath, *KeysArgument);
+		}
+		UE_LOG(LogFModel, Display, TEXT("Corpus of %d files in %d archives, %.2f MB, written to %s in %.2fs"),
+			Settings.NumFiles, NumWritten, TotalBytes / 1e6, *Settings.OutputDirectory, FPlatformTime::Seconds() - StartTime);
+		return bSucceeded;
+	}
+
+private:
+	/** Payload of one pak entry, compressed and encrypted, ready to be written after its inline header */
+	struct FPreparedPakEntry
+	{
+		FPakEntry Entry;
+		TArray<uint8> Payload;
+	};
+
+	/** Files are generated and compressed in parallel batches of this many, then written in order */
+	static constexpr int32 BatchSize = 256;
+
+	void BuildDirectories(FRandomStream& Random)
+	{
+		// Each directory hangs off a random earlier one, which gives a few wide levels near the root and a long tail
+		const int32 NumDirectories = FMath::Max(Settings.NumFiles / Settings.FilesPerDirectory, 1);
+		DirectoryPaths.Reserve(NumDirectories);
+		TArray<int32> Depths;
+		Depths.Reserve(NumDirectories);
+		DirectoryPaths.Add(TEXT("Content/"));
+		Depths.Add(0);
+		while (DirectoryPaths.Num() < NumDirectories)
+		{
+			const int32 Parent = Random.RandHelper(DirectoryPaths.Num());
+			if (Depths[Parent] >= Settings.MaxDepth)
+			{
+				continue;
+			}
+			DirectoryPaths.Add(FString::Printf(TEXT("%s%s%d/"), *DirectoryPaths[Parent], *MakeName(Random), DirectoryPaths.Num()));
+			Depths.Add(Depths[Parent] + 1);
+		}
+	}
+
+	FString MakeName(FRandomStream& Random) const
+	{
+		static const TCHAR* Syllables[] = { TEXT("Ath"), TEXT("ena"), TEXT("Mat"), TEXT("_"), TEXT("Tex"), TEXT("ture"), TEXT("Mesh"), TEXT("Skel"), TEXT("Anim"), TEXT("BP"), TEXT("LOD"), TEXT("Wid"), TEXT("get") };
+		const int32 Length = Settings.MinNameLength + Random.RandHelper(Settings.MaxNameLength - Settings.MinNameLength + 1);
+		FString Name;
+		Name.Reserve(Length + 4);
+		while (Name.Len() < Length)
+		{
+			Name += Syllables[Random.RandHelper(UE_ARRAY_COUNT(Syllables))];
+		}
+		return Name.Left(Length);
+	}
+
+	FCorpusFile MakeFile(int32 FileIndex) const
+	{
+		static const TCHAR* Extensions[] = { TEXT(".uasset"), TEXT(".uasset"), TEXT(".uexp"), TEXT(".uexp"), TEXT(".ubulk"), TEXT(".json"), TEXT(".ini") };
+		FRandomStream Random((int32)HashCombine(GetTypeHash(Settings.Seed), GetTypeHash(FileIndex)));
+		FCorpusFile File;
+		File.Index = FileIndex;
+		// The index suffix keeps paths unique whatever the names come out as
+		File.Path = FString::Printf(TEXT("%s%s_%d%s"), *DirectoryPaths[Random.RandHelper(DirectoryPaths.Num())], *MakeName(Random), FileIndex, Extensions[Random.RandHelper(UE_ARRAY_COUNT(Extensions))]);
+		const double LogMin = FMath::Loge((double)Settings.MinFileSize);
+		const double LogMax = FMath::Loge((double)Settings.MaxFileSize);
+		File.Size = FMath::Clamp((int64)FMath::Exp(LogMin + (LogMax - LogMin) * FMath::Pow(Random.GetFraction(), Settings.SizeSkew)), Settings.MinFileSize, Settings.MaxFileSize);
+		File.CompressionMethod = Settings.CompressionMethods[Random.RandHelper(Settings.CompressionMethods.Num())];
+		File.bPatched = Random.GetFraction() < Settings.PatchFraction;
+		return File;
+	}
+
+	/** Text-like runs from a small vocabulary mixed with random runs, Variant 1 is the patched content */
+	void MakeContent(const FCorpusFile& File, int32 Variant, TArray<uint8>& OutData) const
+	{
+		static const ANSICHAR* Words[] = { "Texture", "Material", "/Game/", "Mesh", "Athena", "Skeletal", "_LOD0", "Default", "None", "Package", "\0\0\0\0" };
+		FRandomStream Random((int32)HashCombine(GetTypeHash(File.Index), GetTypeHash(Settings.Seed + Variant * 7919)));
+		OutData.Reset(File.Size + 256);
+		while (OutData.Num() < File.Size)
+		{
+			const int32 RunLength = 16 + Random.RandHelper(240);
+			if (Random.GetFraction() < Settings.Entropy)
+			{
+				for (int32 Offset = 0; Offset < RunLength; Offset += sizeof(uint32))
+				{
+					const uint32 Value = Random.GetUnsignedInt();
+					OutData.Append((const uint8*)&Value, sizeof(Value));
+				}
+			}
+			else
+			{
+				for (int32 RunEnd = OutData.Num() + RunLength; OutData.Num() < RunEnd;)
+				{
+					const ANSICHAR* Word = Words[Random.RandHelper(UE_ARRAY_COUNT(Words))];
+					OutData.Append((const uint8*)Word, FMath::Max<int32>(FCStringAnsi::Strlen(Word), 4));
+				}
+			}
+		}
+		OutData.SetNum(File.Size, false);
+		if (File.Path.EndsWith(TEXT(".uasset")) && OutData.Num() >= (int32)sizeof(uint32))
+		{
+			// Packages start with PACKAGE_FILE_TAG, key checks on uncompressed entries look for it
+			const uint32 PackageFileTag = 0x9E2A83C1;
+			FMemory::Memcpy(OutData.GetData(), &PackageFileTag, sizeof(PackageFileTag));
+		}
+	}
+
+	const FCorpusKey* GetArchiveKey(int32 ArchiveIndex) const
+	{
+		// Spread evenly instead of clustering the encrypted archives at the start
+		const int32 NumArchives = Settings.NumArchives + 1;
+		const int32 NumEncrypted = FMath::RoundToInt(NumArchives * Settings.EncryptedFraction);
+		if (NumEncrypted <= 0 || (int64)(ArchiveIndex + 1) * NumEncrypted / NumArchives == (int64)ArchiveIndex * NumEncrypted / NumArchives)
+		{
+			return nullptr;
+		}
+		return &Keys[ArchiveIndex % Keys.Num()];
+	}
+
+	/** Compresses and encrypts the way UnrealPak does, so FPakCompressedReaderPolicy reads it back unchanged */
+	void PreparePakEntry(const FCorpusFile& File, int32 Variant, const FCorpusKey* Key, const FPakInfo& Info, FPreparedPakEntry& Out) const
+	{
+		TArray<uint8> Data;
+		MakeContent(File, Variant, Data);
+		FPakEntry& Entry = Out.Entry;
+		Entry.UncompressedSize = Data.Num();
+		Entry.SetEncrypted(Key != nullptr);
+		const int64 AlignSize = Key ? FAES::AESBlockSize : 1;
+
+		if (File.CompressionMethod != NAME_None)
+		{
+			Entry.CompressionMethodIndex = Info.CompressionMethods.IndexOfByKey(File.CompressionMethod);
+			Entry.CompressionBlockSize = Settings.CompressionBlockSize;
+			for (int64 BlockStart = 0; BlockStart < Data.Num(); BlockStart += Settings.CompressionBlockSize)
+			{
+				const int32 BlockSize = (int32)FMath::Min<int64>(Settings.CompressionBlockSize, Data.Num() - BlockStart);
+				int32 CompressedSize = FCompression::CompressMemoryBound(File.CompressionMethod, BlockSize);
+				const int64 PayloadStart = Out.Payload.Num();
+				Out.Payload.AddUninitialized(Align(CompressedSize, AlignSize));
+				if (!FCompression::CompressMemory(File.CompressionMethod, Out.Payload.GetData() + PayloadStart, CompressedSize, Data.GetData() + BlockStart, BlockSize))
+				{
+					Entry.CompressionBlocks.Reset();
+					break;
+				}
+				// Padding up to the AES block is not part of the block, readers align the read size themselves
+				Out.Payload.SetNum(PayloadStart + Align(CompressedSize, AlignSize), false);
+				FMemory::Memzero(Out.Payload.GetData() + PayloadStart + CompressedSize, Out.Payload.Num() - PayloadStart - CompressedSize);
+				FPakCompressedBlock& Block = Entry.CompressionBlocks.AddDefaulted_GetRef();
+				Block.CompressedStart = PayloadStart;
+				Block.CompressedEnd = PayloadStart + CompressedSize;
+			}
+			if (!Entry.CompressionBlocks.Num() || Out.Payload.Num() >= Data.Num())
+			{
+				// Not worth it, UnrealPak stores these uncompressed as well
+				Entry.CompressionBlocks.Reset();
+				Out.Payload.Reset();
+			}
+		}
+
+		if (Entry.CompressionBlocks.Num())
+		{
+			// Block offsets are relative to the inline header, whose size depends on the block count
+			const int64 HeaderSize = Entry.GetSerializedSize(Info.Version);
+			for (FPakCompressedBlock& Block : Entry.CompressionBlocks)
+			{
+				Block.CompressedStart += HeaderSize;
+				Block.CompressedEnd += HeaderSize;
+			}
+			Entry.Size = Out.Payload.Num();
+		}
+		else
+		{
+			Entry.CompressionMethodIndex = 0;
+			Entry.CompressionBlockSize = 0;
+			Entry.Size = Data.Num();
+			Out.Payload = MoveTemp(Data);
+			Out.Payload.SetNumZeroed(Align(Out.Payload.Num(), AlignSize));
+		}
+
+		FSHA1::HashBuffer(Out.Payload.GetData(), Out.Payload.Num(), Entry.Hash);
+		if (Key)
+		{
+			FAES::EncryptData(Out.Payload.GetData(), Out.Payload.Num(), Key->Key);
+		}
+	}
+
+	/** Pads an index block to the AES block size, hashes the plaintext the reader will see and encrypts it */
+	static void FinalizeIndexBlock(TArray<uint8>& Data, const FCorpusKey* Key, FSHAHash& OutHash)
+	{
+		if (Key)
+		{
+			Data.SetNumZeroed(Align(Data.Num(), FAES::AESBlockSize));
+		}
+		FSHA1::HashBuffer(Data.GetData(), Data.Num(), OutHash.Hash);
+		if (Key)
+		{
+			FAES::EncryptData(Data.GetData(), Data.Num(), Key->Key);
+		}
+	}
+
+	/** Adds Path and every directory above it, readers expect parents to be listed even when they hold no files */
+	static void AddToDirectoryIndex(FPakFile::FDirectoryIndex& DirectoryIndex, const FString& Path, FPakEntryLocation Location)
+	{
+		int32 SlashIndex = INDEX_NONE;
+		Path.FindLastChar(TEXT('/'), SlashIndex);
+		FString Directory = SlashIndex == INDEX_NONE ? FString(TEXT("/")) : Path.Left(SlashIndex + 1);
+		DirectoryIndex.FindOrAdd(Directory).Add(Path.Mid(SlashIndex + 1), Location);
+		// Stops at the first parent already there, its own parents were added along with it
+		while (Directory != TEXT("/"))
+		{
+			const int32 ParentEnd = Directory.Find(TEXT("/"), ESearchCase::CaseSensitive, ESearchDir::FromEnd, Directory.Len() - 2);
+			Directory = ParentEnd == INDEX_NONE ? FString(TEXT("/")) : Directory.Left(ParentEnd + 1);
+			if (DirectoryIndex.Contains(Directory))
+			{
+				break;
+			}
+			DirectoryIndex.Add(Directory);
+		}
+	}
+
+	bool WritePak(const FString& Filename, TArrayView<const FCorpusFile> Files, int32 Variant, const FCorpusKey* Key, int64& OutSize) const
+	{
+		TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*Filename));
+		if (!Writer)
+		{
+			return false;
+		}
+
+		FPakInfo Info;
+		for (FName Method : Settings.CompressionMethods)
+		{
+			if (Method != NAME_None)
+			{
+				Info.GetCompressionMethodIndex(Method);
+			}
+		}
+		if (Key)
+		{
+			Info.bEncryptedIndex = Settings.bEncryptIndex;
+			Info.EncryptionKeyGuid = Key->Guid;
+		}
+		const FCorpusKey* IndexKey = Settings.bEncryptIndex ? Key : nullptr;
+
+		TArray<FPakEntry> Entries;
+		Entries.Reserve(Files.Num());
+		TArray<FPreparedPakEntry> Batch;
+		for (int32 BatchStart = 0; BatchStart < Files.Num(); BatchStart += BatchSize)
+		{
+			Batch.Reset();
+			Batch.SetNum(FMath::Min(BatchSize, Files.Num() - BatchStart));
+			ParallelFor(Batch.Num(), [&](int32 Index)
+			{
+				PreparePakEntry(Files[BatchStart + Index], Variant, Key, Info, Batch[Index]);
+			});
+			for (FPreparedPakEntry& Prepared : Batch)
+			{
+				// The inline copy of the entry leaves Offset at zero, its position is implicit
+				FPakEntry& Entry = Entries.Add_GetRef(Prepared.Entry);
+				Entry.Offset = Writer->Tell();
+				Prepared.Entry.Serialize(*Writer, Info.Version);
+				Writer->Serialize(Prepared.Payload.GetData(), Prepared.Payload.Num());
+			}
+		}
+
+		// Full directory index first, the primary index refers to it
+		TArray<uint8> EncodedEntries;
+		FMemoryWriter EncodedWriter(EncodedEntries);
+		TArray<FPakEntry> UnencodedEntries;
+		FPakFile::FDirectoryIndex DirectoryIndex;
+		for (int32 Index = 0; Index < Files.Num(); ++Index)
+		{
+			const int64 EncodedOffset = EncodedWriter.Tell();
+			FPakEntryLocation Location;
+			if (FPakFile::EncodePakEntry(EncodedWriter, Entries[Index], Info))
+			{
+				Location = FPakEntryLocation::CreateFromOffsetIntoEncoded(EncodedOffset);
+			}
+			else
+			{
+				EncodedWriter.Seek(EncodedOffset);
+				EncodedEntries.SetNum(EncodedOffset, false);
+				Location = FPakEntryLocation::CreateFromListIndex(UnencodedEntries.Num());
+				UnencodedEntries.Add(Entries[Index]);
+			}
+			AddToDirectoryIndex(DirectoryIndex, Files[Index].Path, Location);
+		}
+
+		TArray<uint8> DirectoryIndexData;
+		FMemoryWriter DirectoryIndexWriter(DirectoryIndexData);
+		DirectoryIndexWriter << DirectoryIndex;
+		FSHAHash DirectoryIndexHash;
+		FinalizeIndexBlock(DirectoryIndexData, IndexKey, DirectoryIndexHash);
+		int64 DirectoryIndexOffset = Writer->Tell();
+		int64 DirectoryIndexSize = DirectoryIndexData.Num();
+		Writer->Serialize(DirectoryIndexData.GetData(), DirectoryIndexData.Num());
+
+		TArray<uint8> PrimaryIndexData;
+		FMemoryWriter PrimaryIndexWriter(PrimaryIndexData);
+		FString MountPoint = Settings.MountPoint;
+		int32 NumEntries = Files.Num();
+		uint64 PathHashSeed = 0;
+		bool bHasPathHashIndex = false;
+		bool bHasFullDirectoryIndex = true;
+		int32 NumUnencodedEntries = UnencodedEntries.Num();
+		PrimaryIndexWriter << MountPoint << NumEntries << PathHashSeed << bHasPathHashIndex;
+		PrimaryIndexWriter << bHasFullDirectoryIndex << DirectoryIndexOffset << DirectoryIndexSize << DirectoryIndexHash;
+		PrimaryIndexWriter << EncodedEntries << NumUnencodedEntries;
+		for (FPakEntry& Entry : UnencodedEntries)
+		{
+			Entry.Serialize(PrimaryIndexWriter, Info.Version);
+		}
+		FinalizeIndexBlock(PrimaryIndexData, IndexKey, Info.IndexHash);
+		Info.IndexOffset = Writer->Tell();
+		Info.IndexSize = PrimaryIndexData.Num();
+		Writer->Serialize(PrimaryIndexData.GetData(), PrimaryIndexData.Num());
+
+		Info.Serialize(*Writer, Info.Version);
+		OutSize = Writer->Tell();
+		return Writer->Close() && !Writer->IsError();
+	}
+
+	bool WriteIoStore(const FString& BaseFilename, TArrayView<const FCorpusFile> Files, int32 Variant, const FCorpusKey* Key, int64& OutSize) const
+	{
+		// One codec per container, files that picked None are forced uncompressed
+		FIoStoreWriterSettings WriterSettings;
+		WriterSettings.CompressionMethod = NAME_None;
+		for (FName Method : Settings.CompressionMethods)
+		{
+			if (Method != NAME_None)
+			{
+				WriterSettings.CompressionMethod = Method;
+				break;
+			}
+		}
+		WriterSettings.CompressionBlockSize = Settings.CompressionBlockSize;
+
+		FIoStoreWriterContext Context;
+		if (!Context.Initialize(WriterSettings).IsOk())
+		{
+			return false;
+		}
+		FIoContainerSettings ContainerSettings;
+		ContainerSettings.ContainerId = FIoContainerId::FromName(FName(*FPaths::GetCleanFilename(BaseFilename)));
+		ContainerSettings.ContainerFlags = EIoContainerFlags::Indexed;
+		if (WriterSettings.CompressionMethod != NAME_None)
+		{
+			ContainerSettings.ContainerFlags |= EIoContainerFlags::Compressed;
+		}
+		if (Key)
+		{
+			ContainerSettings.ContainerFlags |= EIoContainerFlags::Encrypted;
+			ContainerSettings.EncryptionKeyGuid = Key->Guid;
+			ContainerSettings.EncryptionKey = Key->Key;
+		}
+		TSharedPtr<IIoStoreWriter> Writer = Context.CreateContainer(*BaseFilename, ContainerSettings);
+		if (!Writer.IsValid())
+		{
+			return false;
+		}
+
+		TArray<TArray<uint8>> Batch;
+		for (int32 BatchStart = 0; BatchStart < Files.Num(); BatchStart += BatchSize)
+		{
+			Batch.Reset();
+			Batch.SetNum(FMath::Min(BatchSize, Files.Num() - BatchStart));
+			ParallelFor(Batch.Num(), [&](int32 Index)
+			{
+				MakeContent(Files[BatchStart + Index], Variant, Batch[Index]);
+			});
+			for (int32 Index = 0; Index < Batch.Num(); ++Index)
+			{
+				const FCorpusFile& File = Files[BatchStart + Index];
+				FIoWriteOptions WriteOptions;
+				WriteOptions.FileName = Settings.MountPoint + File.Path;
+				WriteOptions.bForceUncompressed = File.CompressionMethod == NAME_None;
+				// The file index keeps chunk IDs unique, a patch reuses them to override
+				const EIoChunkType ChunkType = File.Path.EndsWith(TEXT(".ubulk")) ? EIoChunkType::BulkData : EIoChunkType::ExportBundleData;
+				Writer->Append(CreateIoChunkId(File.Index, 0, ChunkType), FIoBuffer(FIoBuffer::Clone, Batch[Index].GetData(), Batch[Index].Num()), WriteOptions);
+			}
+		}
+
+		Context.Flush();
+		TIoStatusOr<FIoStoreWriterResult> Result = Writer->GetResult();
+		if (!Result.IsOk())
+		{
+			return false;
+		}
+		OutSize = IFileManager::Get().FileSize(*(BaseFilename + TEXT(".utoc"))) + IFileManager::Get().FileSize(*(BaseFilename + TEXT(".ucas")));
+		return true;
+	}
+
+	const FCorpusSettings& Settings;
+	TArray<FCorpusKey> Keys;
+	TArray<FString> DirectoryPaths;
+};
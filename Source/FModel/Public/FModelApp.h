@@ -3,17 +3,32 @@
 #include "CoreMinimal.h"
 #include "ISlateReflectorModule.h"
 #include "FModel.h"
+#include "AESKeyHandle.h"
+#include "FModelStats.h"
 #include "Async/ParallelFor.h"
 #include "FilePackageStore.h"
+#include "IoStoreFileHandle.h"
+#include "MappedPakFile.h"
 #include "HAL/FileManager.h"
 #include "HAL/PlatformFileManager.h"
 #include "IO/IoContainerHeader.h"
 #include "IoDispatcherFileBackend.h"
 #include "PakFile/Public/IPlatformFilePak.h"
 #include "Paks.h"
+#include "AtomicSnapshot.h"
+#include "VfsIndexCache.h"
+#include "VfsPathIndex.h"
 #include "Widgets/Docking/SDockTab.h"
 
 int RunApplication(const TCHAR* Commandline);
+/** -Headless: mounts, lists and exports straight through FVfsPlatformFile without starting Slate */
+int RunHeadless(const TCHAR* CommandLine);
+/** FModelBenchmark target or -BenchSuite: read hot path microbenchmarks written out as JSON */
+int RunBenchmarkSuite(const TCHAR* CommandLine);
+/** -GenerateCorpus: writes a synthetic install of paks and IoStore containers, see FCorpusSettings */
+int RunCorpusGenerator(const TCHAR* CommandLine);
+/** FModelTests target: runs the FModel automation tests against generated corpora, see Private/Tests */
+int RunTests(const TCHAR* CommandLine);
 
 enum class EVfsType
 {
@@ -25,6 +40,11 @@ struct FVfs
 {
 	TRefCountPtr<FPakFile> PakFile;
 	TSharedPtr<FIoStoreTocResource> IoStoreToc;
+	FVfsArchiveIndexPtr Index;
+	/** Paks only, with -MapPaks */
+	FMappedPakFilePtr Mapping;
+	/** Key registered for the archive's GUID when it was mounted, if any */
+	FAESKeyHandlePtr KeyHandle;
 	EVfsType Type;
 	FString Path;
 	int64 Size;
@@ -84,6 +104,12 @@ struct FVfs
 		case EVfsType::Pak:
 			MountPoint = PakFile->GetMountPoint();
 			break;
+		case EVfsType::IoStore:
+			if (Index.IsValid())
+			{
+				MountPoint = Index->GetMountPoint();
+			}
+			break;
 		default:
 			check(false);
 		}
@@ -93,41 +119,314 @@ struct FVfs
 	IFileHandle* OpenRead(IPlatformFile* LowerLevel, const FString& Filename) const
 	{
 		FPakEntry Entry;
-		if (PakFile->Find(Filename, &Entry) == FPakFile::EFindResult::Found)
+		if (Index.IsValid())
+		{
+			int32 EntryIndex = Index->Find(Filename);
+			if (EntryIndex != INDEX_NONE)
+			{
+				return OpenEntry(LowerLevel, EntryIndex);
+			}
+		}
+		else if (Type == EVfsType::Pak && PakFile->Find(Filename, &Entry) == FPakFile::EFindResult::Found)
 		{
 			return FPakUtils::CreatePakFileHandle(LowerLevel, PakFile, &Entry);
 		}
 		return nullptr;
 	}
 
+	/** bUseBlockCache false keeps a pak entry's decompressed blocks out of FPakBlockCache, IoStore reads never use it */
+	IFileHandle* OpenEntry(IPlatformFile* LowerLevel, int32 EntryIndex, bool bUseBlockCache = true) const
+	{
+		if (Type == EVfsType::IoStore)
+		{
+			const FVfsIndexEntry& IndexEntry = Index->GetEntry(EntryIndex);
+			return new FIoStoreFileHandle(IoStoreToc->ChunkIds[IndexEntry.Offset], IndexEntry.Size, IndexEntry.CompressionBlockSize);
+		}
+		FPakEntry Entry;
+		Index->GetPakEntry(EntryIndex, Entry);
+		if (Mapping.IsValid() && !Entry.IsEncrypted())
+		{
+			return new FMappedPakEntryHandle(Mapping, *PakFile, Entry, bUseBlockCache);
+		}
+		return FPakUtils::CreatePakFileHandle(LowerLevel, PakFile, &Entry, bUseBlockCache);
+	}
+
+	/**
+	 * Decrypts only the first blocks of the index and checks the mount point FString it starts with, so a wrong key is
+	 * caught before loading the whole index. Paks read the start of the index from disk, IoStore uses the TOC's copy.
+	 */
+	bool IsKeyPlausible(IPlatformFile* LowerLevel, const FAESKeyHandle& Key) const
+	{
+		alignas(16) uint8 Head[8 * FAES::AESBlockSize];
+		int64 HeadSize = 0;
+		if (Type == EVfsType::Pak)
+		{
+			const FPakInfo& Info = PakFile->GetInfo();
+			HeadSize = FMath::Min<int64>(sizeof(Head), AlignDown(Info.IndexSize, FAES::AESBlockSize));
+			TUniquePtr<IFileHandle> Handle(LowerLevel->OpenRead(*Path));
+			if (!Handle.IsValid() || HeadSize <= 0 || !Handle->Seek(Info.IndexOffset) || !Handle->Read(Head, HeadSize))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			const TArray<uint8>& DirectoryIndexBuffer = IoStoreToc->DirectoryIndexBuffer;
+			HeadSize = FMath::Min<int64>(sizeof(Head), AlignDown(DirectoryIndexBuffer.Num(), FAES::AESBlockSize));
+			if (HeadSize <= 0)
+			{
+				return false;
+			}
+			FMemory::Memcpy(Head, DirectoryIndexBuffer.GetData(), HeadSize);
+		}
+		Key.DecryptData(Head, HeadSize);
+		return IsPlausibleMountPoint(Head, HeadSize);
+	}
+
+	enum class EKeyCheck
+	{
+		Accepted,
+		Rejected,
+		/** Nothing in the archive can tell a right key from a wrong one */
+		Unverifiable
+	};
+
+	/**
+	 * For a mounted pak whose index is plaintext, where IsKeyPlausible has nothing to decrypt: decrypts the first block
+	 * of an encrypted compressed entry and has it decompress to its full size, or failing that the start of an
+	 * uncompressed encrypted package and looks for the package file tag.
+	 */
+	EKeyCheck CheckKeyAgainstEntries(IPlatformFile* LowerLevel, const FAESKeyHandle& Key) const
+	{
+		if (Type != EVfsType::Pak || !Index.IsValid())
+		{
+			return EKeyCheck::Unverifiable;
+		}
+		int32 PackageEntryIndex = INDEX_NONE;
+		for (int32 EntryIndex = 0; EntryIndex < Index->Num(); ++EntryIndex)
+		{
+			const FVfsIndexEntry& Entry = Index->GetEntry(EntryIndex);
+			if (!(Entry.Flags & FPakEntry::Flag_Encrypted))
+			{
+				continue;
+			}
+			if (Entry.CompressionMethodIndex != 0 && Entry.NumBlocks > 0)
+			{
+				return CheckKeyAgainstBlock(LowerLevel, Key, EntryIndex) ? EKeyCheck::Accepted : EKeyCheck::Rejected;
+			}
+			const FAnsiStringView EntryPath = Index->GetPathView(EntryIndex);
+			if (PackageEntryIndex == INDEX_NONE && Entry.Size >= (int64)sizeof(uint32) && (EntryPath.EndsWith(".uasset") || EntryPath.EndsWith(".umap")))
+			{
+				PackageEntryIndex = EntryIndex;
+			}
+		}
+		if (PackageEntryIndex == INDEX_NONE)
+		{
+			return EKeyCheck::Unverifiable;
+		}
+		FPakEntry Entry;
+		Index->GetPakEntry(PackageEntryIndex, Entry);
+		alignas(16) uint8 Head[FAES::AESBlockSize];
+		if (!ReadLower(LowerLevel, Entry.Offset + Entry.GetSerializedSize(PakFile->GetInfo().Version), Head, sizeof(Head)))
+		{
+			return EKeyCheck::Unverifiable;
+		}
+		Key.DecryptData(Head, sizeof(Head));
+		// PACKAGE_FILE_TAG in either byte order
+		uint32 Tag = 0;
+		FMemory::Memcpy(&Tag, Head, sizeof(Tag));
+		return Tag == 0x9E2A83C1 || Tag == 0xC1832A9E ? EKeyCheck::Accepted : EKeyCheck::Rejected;
+	}
+
+	/** Decrypts and decompresses the first block of a compressed entry, a wrong key can't produce the whole block */
+	bool CheckKeyAgainstBlock(IPlatformFile* LowerLevel, const FAESKeyHandle& Key, int32 EntryIndex) const
+	{
+		FPakEntry Entry;
+		Index->GetPakEntry(EntryIndex, Entry);
+		const FPakInfo& Info = PakFile->GetInfo();
+		const FPakCompressedBlock& Block = Entry.CompressionBlocks[0];
+		const int64 CompressedSize = Block.CompressedEnd - Block.CompressedStart;
+		const int64 UncompressedBlockSize = FMath::Min<int64>(Entry.CompressionBlockSize, Entry.UncompressedSize);
+		if (CompressedSize <= 0 || UncompressedBlockSize <= 0 || CompressedSize > Entry.Size)
+		{
+			return false;
+		}
+		TArray<uint8> Compressed;
+		Compressed.SetNumUninitialized(Align(CompressedSize, FAES::AESBlockSize));
+		if (!ReadLower(LowerLevel, Block.CompressedStart + (Info.HasRelativeCompressedChunkOffsets() ? Entry.Offset : 0), Compressed.GetData(), Compressed.Num()))
+		{
+			return false;
+		}
+		Key.DecryptData(Compressed.GetData(), Compressed.Num());
+		TArray<uint8> Uncompressed;
+		Uncompressed.SetNumUninitialized(UncompressedBlockSize);
+		return FCompression::UncompressMemory(Info.GetCompressionMethod(Entry.CompressionMethodIndex), Uncompressed.GetData(), UncompressedBlockSize, Compressed.GetData(), CompressedSize);
+	}
+
+	bool ReadLower(IPlatformFile* LowerLevel, int64 Offset, uint8* Destination, int64 Size) const
+	{
+		TUniquePtr<IFileHandle> Handle(LowerLevel->OpenRead(*Path));
+		return Handle.IsValid() && Offset + Size <= Handle->Size() && Handle->Seek(Offset) && Handle->Read(Destination, Size);
+	}
+
+	/** Only mapped paks' uncompressed, unencrypted entries can be looked at in place */
+	bool GetEntryView(int32 EntryIndex, FVfsEntryView& OutView) const
+	{
+		if (!Mapping.IsValid())
+		{
+			return false;
+		}
+		FPakEntry Entry;
+		Index->GetPakEntry(EntryIndex, Entry);
+		if (!FMappedPakEntryHandle::CanView(Entry))
+		{
+			return false;
+		}
+		return FMappedPakEntryHandle::MakeView(Mapping, *PakFile, Entry, OutView);
+	}
+
+	/** Checks the serialized FString at Data as far as Size goes: sane length, printable characters, terminator */
+	static bool IsPlausibleMountPoint(const uint8* Data, int64 Size)
+	{
+		int32 SaveNum = 0;
+		if (Size < (int64)sizeof(SaveNum))
+		{
+			return false;
+		}
+		FMemory::Memcpy(&SaveNum, Data, sizeof(SaveNum));
+		// Negative lengths are UTF-16, both count the terminator
+		const bool bWide = SaveNum < 0;
+		const int64 NumChars = bWide ? -(int64)SaveNum : SaveNum;
+		if (NumChars > 1024)
+		{
+			return false;
+		}
+		const int64 CharSize = bWide ? 2 : 1;
+		const int64 NumToCheck = FMath::Min(NumChars, (Size - (int64)sizeof(SaveNum)) / CharSize);
+		const uint8* Chars = Data + sizeof(SaveNum);
+		for (int64 CharIndex = 0; CharIndex < NumToCheck; ++CharIndex)
+		{
+			const uint32 Char = bWide ? Chars[CharIndex * 2] | (Chars[CharIndex * 2 + 1] << 8) : Chars[CharIndex];
+			if (CharIndex == NumChars - 1)
+			{
+				return Char == 0;
+			}
+			if (Char < 0x20 || Char == 0x7f || (!bWide && Char > 0x7f))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	// Don't care, just use path for comparison
 	friend uint32 GetTypeHash(const FVfs& Vfs) { return GetTypeHash(Vfs.Path); }
 	friend bool operator==(const FVfs& Lhs, const FVfs& Rhs) { return Lhs.Path == Rhs.Path; }
 };
 
+/** Everything readers need, published as a whole whenever archives get mounted */
+struct FVfsMountSnapshot : public FThreadSafeRefCountedObject
+{
+	/** Mounted archives with an index, addressed by FVfsPathLocation::VfsSlot */
+	TArray<FVfs> Archives;
+	FVfsPathIndex PathIndex;
+
+	/**
+	 * Calls Visitor for each file Filter names: a wildcard matched against full paths, otherwise a file or a directory
+	 * whose whole subtree is taken. Paths come from the archive the path index resolves them to, so each comes once.
+	 */
+	void ForEachMatch(const FString& Filter, TFunctionRef<void(const FVfsPathLocation& Location)> Visitor) const
+	{
+		FString Normalized = Filter.Replace(TEXT("\\"), TEXT("/"));
+		while (Normalized.StartsWith(TEXT("/")))
+		{
+			Normalized.RemoveAt(0, 1, false);
+		}
+		int32 WildcardIndex = INDEX_NONE;
+		for (int32 CharIndex = 0; CharIndex < Normalized.Len() && WildcardIndex == INDEX_NONE; ++CharIndex)
+		{
+			WildcardIndex = Normalized[CharIndex] == TEXT('*') || Normalized[CharIndex] == TEXT('?') ? CharIndex : INDEX_NONE;
+		}
+		const bool bWildcard = WildcardIndex != INDEX_NONE;
+		FString Prefix = bWildcard ? Normalized.Left(WildcardIndex) : Normalized;
+		if (!bWildcard)
+		{
+			Prefix.RemoveFromEnd(TEXT("/"));
+		}
+		FTCHARToUTF8 Utf8Prefix(*Prefix, Prefix.Len());
+		const ANSICHAR* PrefixData = (const ANSICHAR*)Utf8Prefix.Get();
+		const int32 PrefixLength = Utf8Prefix.Length();
+
+		for (int32 VfsSlot = 0; VfsSlot < Archives.Num(); ++VfsSlot)
+		{
+			// Indices are sorted, everything under the prefix is one run
+			const FVfsArchiveIndex& Index = *Archives[VfsSlot].Index;
+			for (int32 EntryIndex = Index.LowerBound(PrefixData, PrefixLength); EntryIndex < Index.Num(); ++EntryIndex)
+			{
+				const FAnsiStringView Path = Index.GetPathView(EntryIndex);
+				if (Path.Len() < PrefixLength || FVfsArchiveIndex::Compare(Path.GetData(), PrefixLength, PrefixData, PrefixLength) != 0)
+				{
+					break;
+				}
+				if (bWildcard ? !Index.GetPath(EntryIndex).MatchesWildcard(Normalized) : PrefixLength && Path.Len() > PrefixLength && Path[PrefixLength] != '/')
+				{
+					continue;
+				}
+				FVfsPathLocation Location;
+				if (PathIndex.Find(Path.GetData(), Path.Len(), Location) && Location.VfsSlot == VfsSlot && Location.EntryIndex == EntryIndex)
+				{
+					Visitor(Location);
+				}
+			}
+		}
+	}
+};
+
+/** Called from mounting workers after each archive, returning false leaves the archives not started yet unmounted */
+typedef TFunction<bool(int32 NumMounted, int32 NumToMount)> FVfsMountProgress;
+
+/** Broadcast on the mounting thread once the snapshot holding the newly mounted archives is published */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnVfsMounted, const TArray<FVfs>& /*NewlyMounted*/);
+
 // CUE4Parse & JFortniteParse equivalent: DefaultFileProvider
 class FVfsPlatformFile : public IPlatformFile
 {
 public:
 	TSet<FVfs> UnloadedVfs;
 	TSet<FVfs> MountedVfs;
-	TMap<FGuid, FAES::FAESKey> Keys;
 	TSet<FGuid> RequiredKeys;
 	FCriticalSection CollectionsLock;
+	/** Serializes mounting, readers go through Snapshot and never take it */
+	FCriticalSection MountLock;
+	TAtomicSnapshot<FVfsMountSnapshot> Snapshot;
+	/** Listeners get only the archives a mount added, so they can update in proportion to those */
+	FOnVfsMounted OnMounted;
 
 	TArray<FString> Directories;
 	IPlatformFile* LowerLevel;
+	/** Upper bound on archives being opened at the same time during Initialize */
+	int32 MaxConcurrentOpens = 16;
+	/** -MapPaks: mounted paks are memory mapped and unencrypted entries read out of the mapping */
+	bool bMapPaks = false;
 
 	TSharedPtr<FFileIoStore> IoDispatcherFileBackend;
 	TSharedPtr<FFilePackageStore> FilePackageStore;
+	TUniquePtr<FVfsIndexCache> IndexCache;
 
 	FVfsPlatformFile(const FString& InDirectory)
 	{
 		Directories.Add(InDirectory);
-		FPakPlatformFile::GetPakCustomEncryptionDelegate().BindLambda([this](uint8* InData, uint32 InDataSize, FGuid InEncryptionKeyGuid)
+		if (!FParse::Param(FCommandLine::Get(), TEXT("NoIndexCache")))
 		{
-			FAES::FAESKey& Key = Keys.FindChecked(InEncryptionKeyGuid);
-			FAES::DecryptData(InData, InDataSize, Key);
+			IndexCache = MakeUnique<FVfsIndexCache>(FPaths::ProjectSavedDir() / TEXT("IndexCache"));
+		}
+		FParse::Value(FCommandLine::Get(), TEXT("MaxConcurrentOpens="), MaxConcurrentOpens);
+		bMapPaks = FParse::Param(FCommandLine::Get(), TEXT("MapPaks"));
+		// Engine side decryption such as pak indices, our compressed readers resolve their key once per handle instead
+		FPakPlatformFile::GetPakCustomEncryptionDelegate().BindLambda([](uint8* InData, uint32 InDataSize, FGuid InEncryptionKeyGuid)
+		{
+			FMODEL_STAT_SCOPE(IndexDecrypt, InDataSize);
+			FPakSimpleEncryption::DecryptBlock(InData, InDataSize, InEncryptionKeyGuid);
 		});
 	}
 
@@ -137,53 +436,112 @@ public:
 	virtual bool Initialize(IPlatformFile* Inner, const TCHAR* CmdLine) override
 	{
 		LowerLevel = Inner;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		// Listing is cheap, opening the headers is not, so only collect paths here
+		TArray<FString> ArchivePaths;
+		bool bHasIoStore = false;
 		for (const FString& Directory : Directories)
 		{
-			Inner->IterateDirectory(*Directory, [this](const TCHAR* FilenameOrDirectory, bool bIsDirectory) -> bool
+			FMODEL_STAT_SCOPE(DirectoryScan, 0);
+			Inner->IterateDirectory(*Directory, [&](const TCHAR* FilenameOrDirectory, bool bIsDirectory) -> bool
 			{
 				FString Extension = FPaths::GetExtension(FilenameOrDirectory);
-				if (Extension == TEXT("pak"))
+				if (!bIsDirectory && (Extension == TEXT("pak") || Extension == TEXT("utoc")))
+				{
+					ArchivePaths.Add(FilenameOrDirectory);
+					bHasIoStore |= Extension == TEXT("utoc");
+				}
+				return true;
+			});
+		}
+
+		if (bHasIoStore && !IoDispatcherFileBackend.IsValid())
+		{
+			FIoDispatcher& IoDispatcher = FIoDispatcher::Get();
+			IoDispatcherFileBackend = CreateIoDispatcherFileBackend();
+			IoDispatcher.Mount(IoDispatcherFileBackend.ToSharedRef());
+			FilePackageStore = MakeShared<FFilePackageStore>();
+		}
+
+		// Each task opens every NumTasks-th archive into its own collector, merged once at the end
+		struct FDiscoveryCollector
+		{
+			TArray<FVfs> Vfs;
+			TSet<FGuid> RequiredKeys;
+			TArray<double> OpenLatencies;
+		};
+		const int32 NumTasks = FMath::Clamp(FMath::Min(FTaskGraphInterface::Get().GetNumWorkerThreads() + 1, MaxConcurrentOpens), 1, FMath::Max(ArchivePaths.Num(), 1));
+		TArray<FDiscoveryCollector> Collectors;
+		Collectors.SetNum(NumTasks);
+		ParallelFor(NumTasks, [&](int32 TaskIndex)
+		{
+			FDiscoveryCollector& Collector = Collectors[TaskIndex];
+			for (int32 PathIndex = TaskIndex; PathIndex < ArchivePaths.Num(); PathIndex += NumTasks)
+			{
+				const FString& Filename = ArchivePaths[PathIndex];
+				const uint64 OpenStartCycles = FPlatformTime::Cycles64();
+				if (FPaths::GetExtension(Filename) == TEXT("pak"))
 				{
-					UE_LOG(LogFModel, Display, TEXT("Found pak file %s"), FilenameOrDirectory);
-					FPakFile* PakFile = new FPakFile(LowerLevel, FilenameOrDirectory, false, false);
+					TRefCountPtr<FPakFile> PakFile = new FPakFile(LowerLevel, *Filename, false, false);
 					if (PakFile->IsValid())
 					{
-						FScopeLock Lock(&CollectionsLock);
 						if (PakFile->GetInfo().bEncryptedIndex)
 						{
-							RequiredKeys.Add(PakFile->GetInfo().EncryptionKeyGuid);
+							Collector.RequiredKeys.Add(PakFile->GetInfo().EncryptionKeyGuid);
 						}
-						UnloadedVfs.Emplace(PakFile);
+						Collector.Vfs.Emplace(PakFile);
 					}
 				}
-				else if (Extension == TEXT("utoc"))
+				else
 				{
-					UE_LOG(LogFModel, Display, TEXT("Found IoStore %s"), FilenameOrDirectory);
-					if (!IoDispatcherFileBackend.IsValid())
-					{
-						FIoDispatcher& IoDispatcher = FIoDispatcher::Get();
-						IoDispatcherFileBackend = CreateIoDispatcherFileBackend();
-						IoDispatcher.Mount(IoDispatcherFileBackend.ToSharedRef());
-						FilePackageStore = MakeShared<FFilePackageStore>();
-					}
 					TSharedPtr<FIoStoreTocResource> Toc = MakeShared<FIoStoreTocResource>();
-					if (FIoStoreTocResource::Read(FilenameOrDirectory, EIoStoreTocReadOptions::ReadDirectoryIndex, *Toc).IsOk())
+					if (FIoStoreTocResource::Read(*Filename, EIoStoreTocReadOptions::ReadDirectoryIndex, *Toc).IsOk())
 					{
-						FScopeLock Lock(&CollectionsLock);
 						if (EnumHasAnyFlags(Toc->Header.ContainerFlags, EIoContainerFlags::Encrypted))
 						{
-							RequiredKeys.Add(Toc->Header.EncryptionKeyGuid);
+							Collector.RequiredKeys.Add(Toc->Header.EncryptionKeyGuid);
 						}
-						UnloadedVfs.Add(FVfs(Toc, FilenameOrDirectory));
+						Collector.Vfs.Add(FVfs(Toc, Filename));
 					}
 				}
-				return true;
-			});
+				const double OpenLatency = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - OpenStartCycles);
+				Collector.OpenLatencies.Add(OpenLatency);
+				UE_LOG(LogFModel, Display, TEXT("Found %s in %.2fms"), *Filename, OpenLatency);
+			}
+		}, NumTasks == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+		TArray<double> OpenLatencies;
+		{
+			FScopeLock Lock(&CollectionsLock);
+			for (FDiscoveryCollector& Collector : Collectors)
+			{
+				RequiredKeys.Append(Collector.RequiredKeys);
+				for (FVfs& Vfs : Collector.Vfs)
+				{
+					UnloadedVfs.Add(MoveTemp(Vfs));
+				}
+				OpenLatencies.Append(Collector.OpenLatencies);
+			}
+		}
+
+		if (OpenLatencies.Num())
+		{
+			OpenLatencies.Sort();
+			double TotalLatency = 0.0;
+			for (double Latency : OpenLatencies)
+			{
+				TotalLatency += Latency;
+			}
+			UE_LOG(LogFModel, Display, TEXT("Opened %d archives in %.2fms using %d tasks (per archive: avg %.2fms, p50 %.2fms, p95 %.2fms, max %.2fms)"),
+				OpenLatencies.Num(), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles), NumTasks,
+				TotalLatency / OpenLatencies.Num(), OpenLatencies[OpenLatencies.Num() / 2],
+				OpenLatencies[FMath::Min(OpenLatencies.Num() * 95 / 100, OpenLatencies.Num() - 1)], OpenLatencies.Last());
 		}
 		return true;
 	}
 
-	int32 Mount()
+	int32 Mount(const FVfsMountProgress& OnProgress = nullptr)
 	{
 		TArray<FVfs> VfsToMount;
 		{
@@ -196,102 +554,214 @@ public:
 				}
 			}
 		}
-		TAtomic<int32> CountNewMounts(0);
-		ParallelFor(VfsToMount.Num(), [&](int32 Index)
-		{
-			FVfs& Vfs = VfsToMount[Index];
-			if (Vfs.Type == EVfsType::Pak)
-			{
-				Vfs.PakFile = new FPakFile(LowerLevel, *Vfs.PakFile->GetFilename(), false, true /*load index this time*/);
-				check(Vfs.PakFile->IsValid());
-				FString MountPoint = Vfs.PakFile->GetMountPoint();
-				NormalizeMountPoint(MountPoint);
-				Vfs.PakFile->SetMountPoint(*MountPoint);
-			}
-			else
-			{
-				IoDispatcherFileBackend->Mount(*Vfs.Path, 0, FGuid(), FAES::FAESKey());
-			}
-			{
-				FScopeLock Lock(&CollectionsLock);
-				// @todo: Merge files
-				UnloadedVfs.Remove(Vfs);
-				MountedVfs.Add(Vfs);
-			}
-			++CountNewMounts;
-		});
-		return CountNewMounts;
+		return MountAll(VfsToMount, OnProgress);
 	}
 
-	int32 SubmitKey(const FGuid& EncryptionKeyGuid, const FAES::FAESKey& Key)
+	int32 SubmitKey(const FGuid& EncryptionKeyGuid, const FAES::FAESKey& Key, const FVfsMountProgress& OnProgress = nullptr)
 	{
 		TMap<FGuid, FAES::FAESKey> SingletonMap;
 		SingletonMap.Add(EncryptionKeyGuid, Key);
-		return SubmitKeys(SingletonMap);
+		return SubmitKeys(SingletonMap, OnProgress);
 	}
 
-	int32 SubmitKeys(TMap<FGuid, FAES::FAESKey>& InKeys)
+	/**
+	 * Checks every key in parallel first: against the start of its archives' encrypted indices, or for archives with a
+	 * plaintext index, which may still have encrypted entries, against those entries. Such archives are mounted first,
+	 * they never needed the key for that. A key is rejected if any archive of its GUID rejects it. One no archive could
+	 * check is only taken on trust while no key is registered for its GUID, it never replaces one. Rejected keys are left
+	 * out of the registry and their archives stay unloaded, their GUIDs go to OutRejected if given.
+	 */
+	int32 SubmitKeys(const TMap<FGuid, FAES::FAESKey>& InKeys, const FVfsMountProgress& OnProgress = nullptr, TArray<FGuid>* OutRejected = nullptr)
 	{
-		TArray<FVfs> VfsToMount;
+		int32 NumMounted = 0;
 		{
-			FScopeLock Lock(&CollectionsLock);
-			for (auto Pair : InKeys)
+			TArray<FVfs> PlaintextIndexToMount;
 			{
+				FScopeLock Lock(&CollectionsLock);
 				for (const FVfs& Vfs : UnloadedVfs)
 				{
-					if (Vfs.GetEncryptionKeyGuid() == Pair.Key)
+					if (!Vfs.IsEncrypted() && InKeys.Contains(Vfs.GetEncryptionKeyGuid()))
 					{
-						Keys.Add(Pair.Key, Pair.Value); // @todo: Invalid key handling
-						VfsToMount.Add(Vfs);
+						PlaintextIndexToMount.Add(Vfs);
 					}
 				}
 			}
+			if (PlaintextIndexToMount.Num())
+			{
+				NumMounted += MountAll(PlaintextIndexToMount, OnProgress);
+			}
 		}
-		TAtomic<int32> CountNewMounts(0);
-		ParallelFor(VfsToMount.Num(), [&](int32 Index)
+
+		TArray<FVfs> Candidates;
+		TArray<FAESKeyHandlePtr> CandidateKeys;
+		TArray<bool> AlreadyMounted;
 		{
-			FVfs& Vfs = VfsToMount[Index];
-			if (Vfs.Type == EVfsType::Pak)
+			FScopeLock Lock(&CollectionsLock);
+			for (const TPair<FGuid, FAES::FAESKey>& Pair : InKeys)
+			{
+				FAESKeyHandlePtr Key;
+				for (const TSet<FVfs>* VfsSet : { &UnloadedVfs, &MountedVfs })
+				{
+					for (const FVfs& Vfs : *VfsSet)
+					{
+						if (Vfs.GetEncryptionKeyGuid() == Pair.Key)
+						{
+							if (!Key.IsValid())
+							{
+								Key = new FAESKeyHandle(Pair.Key, Pair.Value);
+							}
+							Candidates.Add(Vfs);
+							CandidateKeys.Add(Key);
+							AlreadyMounted.Add(VfsSet == &MountedVfs);
+						}
+					}
+				}
+			}
+		}
+
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		TArray<FVfs::EKeyCheck> Checks;
+		Checks.SetNumUninitialized(Candidates.Num());
+		ParallelFor(Candidates.Num(), [&](int32 Index)
+		{
+			const FVfs& Vfs = Candidates[Index];
+			const FAESKeyHandle& Key = *CandidateKeys[Index];
+			if (Vfs.IsEncrypted())
 			{
-				Vfs.PakFile = new FPakFile(LowerLevel, *Vfs.PakFile->GetFilename(), false, true /*load index this time*/);
-				check(Vfs.PakFile->IsValid());
-				FString MountPoint = Vfs.PakFile->GetMountPoint();
-				NormalizeMountPoint(MountPoint);
-				Vfs.PakFile->SetMountPoint(*MountPoint);
+				Checks[Index] = Vfs.IsKeyPlausible(LowerLevel, Key) ? FVfs::EKeyCheck::Accepted : FVfs::EKeyCheck::Rejected;
 			}
 			else
 			{
-				FGuid EncryptionKeyGuid = Vfs.GetEncryptionKeyGuid();
-				IoDispatcherFileBackend->Mount(*Vfs.Path, 0, EncryptionKeyGuid, Keys.FindChecked(EncryptionKeyGuid));
+				Checks[Index] = Vfs.CheckKeyAgainstEntries(LowerLevel, Key);
 			}
+		});
+
+		// Any rejection outweighs the acceptances, any acceptance makes the key checked
+		TMap<FGuid, FVfs::EKeyCheck> KeyResults;
+		for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+		{
+			FVfs::EKeyCheck& Result = KeyResults.FindOrAdd(CandidateKeys[Index]->GetGuid(), FVfs::EKeyCheck::Unverifiable);
+			if (Checks[Index] == FVfs::EKeyCheck::Rejected || (Checks[Index] == FVfs::EKeyCheck::Accepted && Result == FVfs::EKeyCheck::Unverifiable))
 			{
-				FScopeLock Lock(&CollectionsLock);
-				// @todo: Merge files
-				UnloadedVfs.Remove(Vfs);
-				MountedVfs.Add(Vfs);
+				Result = Checks[Index];
 			}
-			++CountNewMounts;
-		});
-		return CountNewMounts;
+		}
+		TArray<FVfs> VfsToMount;
+		int32 NumRejected = 0;
+		for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+		{
+			const FAESKeyHandlePtr& Key = CandidateKeys[Index];
+			const FVfs::EKeyCheck Result = KeyResults.FindChecked(Key->GetGuid());
+			// Candidates come grouped by key, each key is decided once with the first of them
+			const bool bFirstOfKey = Index == 0 || CandidateKeys[Index - 1] != Key;
+			if (Result == FVfs::EKeyCheck::Rejected)
+			{
+				if (Checks[Index] == FVfs::EKeyCheck::Rejected)
+				{
+					UE_LOG(LogFModel, Warning, TEXT("%s rejected the key for %s"), *Candidates[Index].GetName(), *Key->GetGuid().ToString());
+				}
+				if (bFirstOfKey)
+				{
+					++NumRejected;
+					if (OutRejected)
+					{
+						OutRejected->Add(Key->GetGuid());
+					}
+				}
+				continue;
+			}
+			if (bFirstOfKey)
+			{
+				FAESKeyHandlePtr Registered = FAESKeyRegistry::Get().Find(Key->GetGuid());
+				if (Result == FVfs::EKeyCheck::Unverifiable && Registered.IsValid())
+				{
+					if (FMemory::Memcmp(Registered->GetKey().Key, Key->GetKey().Key, FAES::FAESKey::KeySize) != 0)
+					{
+						UE_LOG(LogFModel, Warning, TEXT("Nothing in the archives of %s can check the key submitted for it, keeping the key registered before"), *Key->GetGuid().ToString());
+						++NumRejected;
+						if (OutRejected)
+						{
+							OutRejected->Add(Key->GetGuid());
+						}
+					}
+				}
+				else
+				{
+					if (Result == FVfs::EKeyCheck::Unverifiable)
+					{
+						UE_LOG(LogFModel, Display, TEXT("Nothing in the archives of %s can check the key submitted for it, taken on trust"), *Key->GetGuid().ToString());
+					}
+					FAESKeyRegistry::Get().Add(Key);
+				}
+			}
+			// Only encrypted indices can be left, they were checked
+			if (!AlreadyMounted[Index])
+			{
+				VfsToMount.Add(Candidates[Index]);
+			}
+		}
+		if (Candidates.Num())
+		{
+			UE_LOG(LogFModel, Display, TEXT("Validated %d keys against %d archives in %.2fms, %d keys rejected"),
+				KeyResults.Num(), Candidates.Num(), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles), NumRejected);
+		}
+		return NumMounted + MountAll(VfsToMount, OnProgress);
+	}
+
+	/** No-copy access to an entry, fails for anything that is not a plain entry in a mapped pak */
+	bool ReadView(const FString& Path, FVfsEntryView& OutView)
+	{
+		TAtomicSnapshot<FVfsMountSnapshot>::FReadScope Current(Snapshot);
+		FVfsPathLocation Location;
+		return Find(*Current, Path, Location) && Current->Archives[Location.VfsSlot].GetEntryView(Location.EntryIndex, OutView);
 	}
 
 	IFileHandle* Read(const FString& Path)
 	{
-		FScopeLock Lock(&CollectionsLock);
-		for (const FVfs& Vfs : MountedVfs)
+		TAtomicSnapshot<FVfsMountSnapshot>::FReadScope Current(Snapshot);
+		FVfsPathLocation Location;
+		if (Find(*Current, Path, Location))
 		{
-			if (IFileHandle* Handle = Vfs.OpenRead(LowerLevel, Path))
-			{
-				return Handle;
-			}
+			return Current->Archives[Location.VfsSlot].OpenEntry(LowerLevel, Location.EntryIndex);
 		}
 		return nullptr;
 	}
 
+	/** For holders that outlive a lookup, lookups themselves only pin the snapshot for their scope */
+	TRefCountPtr<const FVfsMountSnapshot> GetSnapshot() const { return Snapshot.Get(); }
+
+	/** Path lookup as counted by the Lookup stat */
+	static bool Find(const FVfsMountSnapshot& Current, FStringView Path, FVfsPathLocation& OutLocation)
+	{
+		FMODEL_STAT_SCOPE(Lookup, 0);
+		return Current.PathIndex.Find(Path, OutLocation);
+	}
+
+	/**
+	 * Copies the current snapshot, lets Mutate extend the copy and publishes it. The copy is O(archives): the path index
+	 * shares its layers with the current snapshot and Add only allocates the paths of the archives it is given.
+	 */
+	void PublishSnapshot(TFunctionRef<void(FVfsMountSnapshot&)> Mutate)
+	{
+		FScopeLock Lock(&MountLock);
+		TRefCountPtr<const FVfsMountSnapshot> Current = Snapshot.Get();
+		FVfsMountSnapshot* NewSnapshot = new FVfsMountSnapshot();
+		NewSnapshot->Archives = Current->Archives;
+		NewSnapshot->PathIndex = Current->PathIndex;
+		Mutate(*NewSnapshot);
+		Snapshot.Publish(NewSnapshot);
+	}
+
 	virtual IPlatformFile* GetLowerLevel() /*override*/ { return LowerLevel; }
 	virtual void SetLowerLevel(IPlatformFile* NewLowerLevel) /*override*/ { LowerLevel = NewLowerLevel; }
 	virtual const TCHAR* GetName() const override { return TEXT("Custom"); }
-	virtual bool FileExists(const TCHAR* Filename) override { return false; }
+	virtual bool FileExists(const TCHAR* Filename) override
+	{
+		TAtomicSnapshot<FVfsMountSnapshot>::FReadScope Current(Snapshot);
+		FVfsPathLocation Location;
+		return Find(*Current, Filename, Location);
+	}
+
 	virtual int64 FileSize(const TCHAR* Filename) override { return -1; }
 	virtual bool DeleteFile(const TCHAR* Filename) override { return false; }
 	virtual bool IsReadOnly(const TCHAR* Filename) override { return false; }
@@ -311,6 +781,168 @@ public:
 	virtual bool IterateDirectoryStat(const TCHAR* Directory, FDirectoryStatVisitor& Visitor) override { return false; }
 
 private:
+	int32 MountAll(TArray<FVfs>& VfsToMount, const FVfsMountProgress& OnProgress)
+	{
+		FScopeLock MountScope(&MountLock);
+		TAtomic<bool> bStopped(false);
+		TArray<bool> Processed;
+		Processed.SetNumZeroed(VfsToMount.Num());
+		TAtomic<int32> CountNewMounts(0);
+		TAtomic<int32> CountWarmMounts(0);
+		TAtomic<uint64> ColdCycles(0);
+		TAtomic<uint64> WarmCycles(0);
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		ParallelFor(VfsToMount.Num(), [&](int32 Index)
+		{
+			if (bStopped.Load())
+			{
+				return;
+			}
+			FVfs& Vfs = VfsToMount[Index];
+			const uint64 VfsStartCycles = FPlatformTime::Cycles64();
+			TRACE_CPUPROFILER_EVENT_SCOPE(FModel_IndexLoad);
+			FFModelStatScope IndexLoadStat(EFModelStat::IndexLoad);
+			Vfs.KeyHandle = FAESKeyRegistry::Get().Find(Vfs.GetEncryptionKeyGuid());
+			bool bWarm = false;
+			if (Vfs.Type == EVfsType::Pak)
+			{
+				FVfsIndexKey Key = FVfsIndexKey::Make(LowerLevel, Vfs.Path, Vfs.PakFile->GetInfo().IndexHash);
+				if (IndexCache.IsValid())
+				{
+					Vfs.Index = IndexCache->Load(Vfs.Path, Key);
+				}
+				if (Vfs.Index.IsValid())
+				{
+					// Header-only pak is enough to read entries, the index comes from the cache
+					Vfs.PakFile->SetMountPoint(*Vfs.Index->GetMountPoint());
+					bWarm = true;
+				}
+				else
+				{
+					// Same FPakFile that was opened header-only in Initialize, so Unloaded/MountedVfs never disagree
+					verify(FPakUtils::LoadIndex(*Vfs.PakFile, LowerLevel));
+					FString MountPoint = Vfs.PakFile->GetMountPoint();
+					NormalizeMountPoint(MountPoint);
+					Vfs.PakFile->SetMountPoint(*MountPoint);
+					Vfs.Index = FVfsArchiveIndexBuilder::BuildFromPak(*Vfs.PakFile, Key);
+					if (IndexCache.IsValid())
+					{
+						IndexCache->Save(Vfs.Path, *Vfs.Index);
+					}
+				}
+				if (bMapPaks)
+				{
+					Vfs.Mapping = FMappedPakFile::Open(LowerLevel, Vfs.Path);
+				}
+			}
+			else
+			{
+				FGuid EncryptionKeyGuid;
+				FAES::FAESKey Key;
+				if (Vfs.IsEncrypted())
+				{
+					check(Vfs.KeyHandle.IsValid());
+					EncryptionKeyGuid = Vfs.KeyHandle->GetGuid();
+					Key = Vfs.KeyHandle->GetKey();
+				}
+				// Reads go through the global dispatcher by ChunkId, which has to prefer the same container the path index does
+				IoDispatcherFileBackend->Mount(*Vfs.Path, FVfsPathIndex::GetArchivePriority(Vfs.Path), EncryptionKeyGuid, Key);
+
+				FVfsIndexKey IndexKey = FVfsIndexKey::Make(LowerLevel, Vfs.Path, FVfsArchiveIndexBuilder::HashTocHeader(*Vfs.IoStoreToc));
+				if (IndexCache.IsValid())
+				{
+					Vfs.Index = IndexCache->Load(Vfs.Path, IndexKey);
+				}
+				if (Vfs.Index.IsValid() && !Vfs.Index->AreTocIndicesBelow(Vfs.IoStoreToc->ChunkIds.Num()))
+				{
+					UE_LOG(LogFModel, Warning, TEXT("Index cache for %s points past its TOC, rebuilding"), *Vfs.Path);
+					Vfs.Index.Reset();
+				}
+				if (Vfs.Index.IsValid())
+				{
+					bWarm = true;
+				}
+				else
+				{
+					Vfs.Index = FVfsArchiveIndexBuilder::BuildFromIoStore(*Vfs.IoStoreToc, Key, IndexKey);
+					if (Vfs.Index.IsValid() && IndexCache.IsValid())
+					{
+						IndexCache->Save(Vfs.Path, *Vfs.Index);
+					}
+				}
+			}
+			IndexLoadStat.SetBytes(Vfs.Index.IsValid() ? Vfs.Index->GetAllocatedSize() : 0);
+			const uint64 VfsCycles = FPlatformTime::Cycles64() - VfsStartCycles;
+			if (bWarm)
+			{
+				WarmCycles += VfsCycles;
+				++CountWarmMounts;
+			}
+			else
+			{
+				ColdCycles += VfsCycles;
+			}
+			Processed[Index] = true;
+			const int32 NumMounted = ++CountNewMounts;
+			if (OnProgress && !OnProgress(NumMounted, VfsToMount.Num()))
+			{
+				bStopped = true;
+			}
+		});
+		if (bStopped.Load())
+		{
+			for (int32 Index = VfsToMount.Num(); Index--;)
+			{
+				if (!Processed[Index])
+				{
+					VfsToMount.RemoveAt(Index, 1, false);
+				}
+			}
+		}
+		{
+			FScopeLock Lock(&CollectionsLock);
+			for (const FVfs& Vfs : VfsToMount)
+			{
+				UnloadedVfs.Remove(Vfs);
+				MountedVfs.Add(Vfs);
+			}
+		}
+		const uint64 PathIndexStartCycles = FPlatformTime::Cycles64();
+		int32 NumPaths = 0;
+		TArray<FVfs> NewlyMounted;
+		PublishSnapshot([&](FVfsMountSnapshot& NewSnapshot)
+		{
+			TArray<TPair<int32, FVfsArchiveIndexPtr>> NewArchives;
+			TArray<FString> NewArchivePaths;
+			for (const FVfs& Vfs : VfsToMount)
+			{
+				if (Vfs.Index.IsValid())
+				{
+					NewArchives.Emplace(NewSnapshot.Archives.Add(Vfs), Vfs.Index);
+					NewArchivePaths.Add(Vfs.Path);
+					NewlyMounted.Add(Vfs);
+				}
+			}
+			NewSnapshot.PathIndex.Add(NewArchives, NewArchivePaths);
+			NumPaths = NewSnapshot.PathIndex.Num();
+		});
+		if (VfsToMount.Num())
+		{
+			UE_LOG(LogFModel, Display, TEXT("Merged path index holds %d paths (%.2fms)"), NumPaths, FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - PathIndexStartCycles));
+			UE_LOG(LogFModel, Display, TEXT("Mounted %d archives in %.2fms (%d warm from index cache: %.2fms total, %d cold: %.2fms total)"),
+				CountNewMounts.Load(), FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles),
+				CountWarmMounts.Load(), FPlatformTime::ToMilliseconds64(WarmCycles.Load()),
+				CountNewMounts.Load() - CountWarmMounts.Load(), FPlatformTime::ToMilliseconds64(ColdCycles.Load()));
+		}
+		// Listeners may take a while or mount more themselves
+		MountScope.Unlock();
+		if (NewlyMounted.Num())
+		{
+			OnMounted.Broadcast(NewlyMounted);
+		}
+		return CountNewMounts;
+	}
+
 	static void NormalizeMountPoint(FString& MountPoint)
 	{
 		if (MountPoint.StartsWith(TEXT("../../../")))
@@ -337,8 +969,16 @@ public:
 
 	FFModelApp()
 	{
-		Provider = new FVfsPlatformFile("C:\\Program Files\\Epic Games\\Fortnite\\FortniteGame\\Content\\Paks");
-		// Provider = new FVfsPlatformFile("D:\\Downloads\\TestPak");
+		// -Paks= takes one or more directories separated by ';'
+		FString PaksDirectories = TEXT("C:\\Program Files\\Epic Games\\Fortnite\\FortniteGame\\Content\\Paks");
+		FParse::Value(FCommandLine::Get(), TEXT("Paks="), PaksDirectories, false);
+		TArray<FString> Directories;
+		PaksDirectories.ParseIntoArray(Directories, TEXT(";"));
+		Provider = new FVfsPlatformFile(Directories.Num() ? Directories[0] : PaksDirectories);
+		for (int32 Index = 1; Index < Directories.Num(); ++Index)
+		{
+			Provider->Directories.Add(Directories[Index]);
+		}
 		IPlatformFile* LowerLevelPlatformFile = &FPlatformFileManager::Get().GetPlatformFile();
 		Provider->Initialize(LowerLevelPlatformFile, nullptr);
 	}
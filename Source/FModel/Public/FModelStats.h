@@ -0,0 +1,283 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PakBlockCache.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+#include "Policies/PrettyJsonPrintPolicy.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Serialization/JsonWriter.h"
+
+/** Stages of getting a file out of an archive, each timed by FMODEL_STAT_SCOPE */
+enum class EFModelStat : uint8
+{
+	DirectoryScan,
+	IndexLoad,
+	/** Engine side pak index decryption, also counted under Decrypt */
+	IndexDecrypt,
+	Lookup,
+	BlockRead,
+	Decrypt,
+	Decompress,
+	Count
+};
+
+inline const TCHAR* LexToString(EFModelStat Value)
+{
+	switch (Value)
+	{
+	case EFModelStat::DirectoryScan:	return TEXT("Directory Scan");
+	case EFModelStat::IndexLoad:		return TEXT("Index Load");
+	case EFModelStat::IndexDecrypt:		return TEXT("Index Decrypt");
+	case EFModelStat::Lookup:			return TEXT("Lookup");
+	case EFModelStat::BlockRead:		return TEXT("Block Read");
+	case EFModelStat::Decrypt:			return TEXT("Decrypt");
+	case EFModelStat::Decompress:		return TEXT("Decompress");
+	default:							return TEXT("");
+	}
+}
+
+/** Totals of one stat since the last reset */
+struct FFModelStatValues
+{
+	uint64 Count = 0;
+	int64 Bytes = 0;
+	uint64 Cycles = 0;
+	uint64 MaxCycles = 0;
+
+	double GetAverageMs() const { return Count ? FPlatformTime::ToMilliseconds64(Cycles) / Count : 0.0; }
+	double GetMaxMs() const { return FPlatformTime::ToMilliseconds64(MaxCycles); }
+	/** Throughput over the time spent in the stat itself, not over wall time */
+	double GetMBPerSecond() const { return Cycles ? Bytes / FPlatformTime::ToSeconds64(Cycles) / 1e6 : 0.0; }
+};
+
+/**
+ * Process-wide counters of the read path, cheap enough to stay on in shipping builds: a scope costs two cycle counter
+ * reads and plain stores to counters only its own thread writes, so lookups and block reads on many threads never
+ * share a cache line. Readers sum every thread's counters. Scopes also emit CPU trace events, so running with
+ * -trace=cpu -tracefile=Path records the same stages for Unreal Insights. -StatsOut=Path dumps the totals as JSON on exit.
+ */
+class FFModelStats
+{
+public:
+	static FFModelStats& Get()
+	{
+		static FFModelStats Instance;
+		return Instance;
+	}
+
+	void Add(EFModelStat Stat, int64 Bytes, uint64 Cycles)
+	{
+		FThreadCounters& Thread = GetThreadCounters();
+		const uint32 ResetGeneration = Generation.Load(EMemoryOrder::Relaxed);
+		if (Thread.Generation.Load(EMemoryOrder::Relaxed) != ResetGeneration)
+		{
+			// Maxima can't be rebased like the sums, the first scope after a reset starts them over
+			for (FCounter& Counter : Thread.Counters)
+			{
+				Counter.MaxCycles.Store(0, EMemoryOrder::Relaxed);
+			}
+			Thread.Generation.Store(ResetGeneration, EMemoryOrder::Relaxed);
+		}
+		// Only this thread writes them, readers may see one scope torn across the fields at worst
+		FCounter& Counter = Thread.Counters[(int32)Stat];
+		Counter.Count.Store(Counter.Count.Load(EMemoryOrder::Relaxed) + 1, EMemoryOrder::Relaxed);
+		Counter.Bytes.Store(Counter.Bytes.Load(EMemoryOrder::Relaxed) + Bytes, EMemoryOrder::Relaxed);
+		Counter.Cycles.Store(Counter.Cycles.Load(EMemoryOrder::Relaxed) + Cycles, EMemoryOrder::Relaxed);
+		if (Cycles > Counter.MaxCycles.Load(EMemoryOrder::Relaxed))
+		{
+			Counter.MaxCycles.Store(Cycles, EMemoryOrder::Relaxed);
+		}
+	}
+
+	FFModelStatValues GetValues(EFModelStat Stat) const
+	{
+		FScopeLock Lock(&ThreadsLock);
+		const uint32 ResetGeneration = Generation.Load(EMemoryOrder::Relaxed);
+		FFModelStatValues Values = Retired[(int32)Stat];
+		for (const FThreadCounters* Thread : Threads)
+		{
+			Thread->AddTo(Stat, ResetGeneration, Values);
+		}
+		const FFModelStatValues& Base = Baseline[(int32)Stat];
+		Values.Count -= Base.Count;
+		Values.Bytes -= Base.Bytes;
+		Values.Cycles -= Base.Cycles;
+		return Values;
+	}
+
+	/** Wall time since the last reset, what busy time is measured against */
+	double GetElapsedSeconds() const
+	{
+		return FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles.Load(EMemoryOrder::Relaxed));
+	}
+
+	/** Share of all cores' time since the last reset spent in Stat */
+	double GetUtilization(const FFModelStatValues& Values) const
+	{
+		const double CoreSeconds = GetElapsedSeconds() * FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+		return CoreSeconds > 0.0 ? FPlatformTime::ToSeconds64(Values.Cycles) / CoreSeconds : 0.0;
+	}
+
+	/** Threads keep counting, the totals so far become the baseline later values are measured from */
+	void Reset()
+	{
+		FScopeLock Lock(&ThreadsLock);
+		const uint32 NewGeneration = Generation.Load(EMemoryOrder::Relaxed) + 1;
+		for (int32 Index = 0; Index < (int32)EFModelStat::Count; ++Index)
+		{
+			FFModelStatValues& Base = Baseline[Index];
+			Base = Retired[Index];
+			for (const FThreadCounters* Thread : Threads)
+			{
+				Thread->AddTo((EFModelStat)Index, NewGeneration, Base);
+			}
+			Retired[Index].MaxCycles = 0;
+		}
+		Generation = NewGeneration;
+		StartCycles = FPlatformTime::Cycles64();
+	}
+
+	bool Dump(const FString& Path) const
+	{
+		FString Json;
+		TSharedRef<TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create(&Json);
+		Writer->WriteObjectStart();
+		Writer->WriteValue(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+		Writer->WriteValue(TEXT("elapsed_s"), GetElapsedSeconds());
+		Writer->WriteValue(TEXT("cores"), FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+		Writer->WriteArrayStart(TEXT("stats"));
+		for (int32 Index = 0; Index < (int32)EFModelStat::Count; ++Index)
+		{
+			const FFModelStatValues Values = GetValues((EFModelStat)Index);
+			Writer->WriteObjectStart();
+			Writer->WriteValue(TEXT("name"), LexToString((EFModelStat)Index));
+			Writer->WriteValue(TEXT("count"), (int64)Values.Count);
+			Writer->WriteValue(TEXT("bytes"), Values.Bytes);
+			Writer->WriteValue(TEXT("busy_s"), FPlatformTime::ToSeconds64(Values.Cycles));
+			Writer->WriteValue(TEXT("avg_ms"), Values.GetAverageMs());
+			Writer->WriteValue(TEXT("max_ms"), Values.GetMaxMs());
+			Writer->WriteValue(TEXT("mb_per_s"), Values.GetMBPerSecond());
+			Writer->WriteValue(TEXT("utilization"), GetUtilization(Values));
+			Writer->WriteObjectEnd();
+		}
+		Writer->WriteArrayEnd();
+		const FPakBlockCacheStats CacheStats = FPakBlockCache::Get().GetStats();
+		Writer->WriteObjectStart(TEXT("block_cache"));
+		Writer->WriteValue(TEXT("hits"), (int64)CacheStats.Hits);
+		Writer->WriteValue(TEXT("misses"), (int64)CacheStats.Misses);
+		Writer->WriteValue(TEXT("evictions"), (int64)CacheStats.Evictions);
+		Writer->WriteValue(TEXT("used_bytes"), CacheStats.UsedBytes);
+		Writer->WriteValue(TEXT("blocks"), CacheStats.NumBlocks);
+		Writer->WriteValue(TEXT("budget_bytes"), FPakBlockCache::Get().GetBudget());
+		Writer->WriteObjectEnd();
+		Writer->WriteObjectEnd();
+		Writer->Close();
+		return FFileHelper::SaveStringToFile(Json, *Path);
+	}
+
+private:
+	struct FCounter
+	{
+		TAtomic<uint64> Count { 0 };
+		TAtomic<int64> Bytes { 0 };
+		TAtomic<uint64> Cycles { 0 };
+		TAtomic<uint64> MaxCycles { 0 };
+	};
+
+	/** Written by one thread only, on cache lines of their own */
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FThreadCounters
+	{
+		FCounter Counters[(int32)EFModelStat::Count];
+		/** Reset the maxima were last cleared for */
+		TAtomic<uint32> Generation { 0 };
+
+		void AddTo(EFModelStat Stat, uint32 ResetGeneration, FFModelStatValues& Values) const
+		{
+			const FCounter& Counter = Counters[(int32)Stat];
+			Values.Count += Counter.Count.Load(EMemoryOrder::Relaxed);
+			Values.Bytes += Counter.Bytes.Load(EMemoryOrder::Relaxed);
+			Values.Cycles += Counter.Cycles.Load(EMemoryOrder::Relaxed);
+			if (Generation.Load(EMemoryOrder::Relaxed) == ResetGeneration)
+			{
+				Values.MaxCycles = FMath::Max(Values.MaxCycles, Counter.MaxCycles.Load(EMemoryOrder::Relaxed));
+			}
+		}
+	};
+
+	/** Registers the thread's counters on its first scope, folds them into Retired when the thread exits */
+	class FThreadRegistration
+	{
+	public:
+		FThreadRegistration()
+		{
+			FFModelStats& Stats = FFModelStats::Get();
+			FScopeLock Lock(&Stats.ThreadsLock);
+			Counters.Generation = Stats.Generation.Load(EMemoryOrder::Relaxed);
+			Stats.Threads.Add(&Counters);
+		}
+
+		~FThreadRegistration()
+		{
+			FFModelStats& Stats = FFModelStats::Get();
+			FScopeLock Lock(&Stats.ThreadsLock);
+			Stats.Threads.RemoveSwap(&Counters);
+			for (int32 Index = 0; Index < (int32)EFModelStat::Count; ++Index)
+			{
+				Counters.AddTo((EFModelStat)Index, Stats.Generation.Load(EMemoryOrder::Relaxed), Stats.Retired[Index]);
+			}
+		}
+
+		FThreadCounters Counters;
+	};
+
+	static FThreadCounters& GetThreadCounters()
+	{
+		thread_local FThreadRegistration Registration;
+		return Registration.Counters;
+	}
+
+	FFModelStats()
+		: StartCycles(FPlatformTime::Cycles64())
+	{
+	}
+
+	mutable FCriticalSection ThreadsLock;
+	TArray<FThreadCounters*> Threads;
+	/** Totals of exited threads */
+	FFModelStatValues Retired[(int32)EFModelStat::Count];
+	/** Totals at the last reset, subtracted from the sums */
+	FFModelStatValues Baseline[(int32)EFModelStat::Count];
+	TAtomic<uint32> Generation { 0 };
+	TAtomic<uint64> StartCycles;
+};
+
+class FFModelStatScope
+{
+public:
+	explicit FFModelStatScope(EFModelStat InStat, int64 InBytes = 0)
+		: Stat(InStat)
+		, Bytes(InBytes)
+		, StartCycles(FPlatformTime::Cycles64())
+	{
+	}
+
+	~FFModelStatScope()
+	{
+		FFModelStats::Get().Add(Stat, Bytes, FPlatformTime::Cycles64() - StartCycles);
+	}
+
+	/** For stages that only know their size once done */
+	void SetBytes(int64 InBytes) { Bytes = InBytes; }
+
+private:
+	EFModelStat Stat;
+	int64 Bytes;
+	uint64 StartCycles;
+};
+
+/** Times the rest of the enclosing scope as Stat, moving Bytes, and marks it in CPU traces */
+#define FMODEL_STAT_SCOPE(Stat, Bytes) \
+	TRACE_CPUPROFILER_EVENT_SCOPE(FModel_##Stat); \
+	FFModelStatScope PREPROCESSOR_JOIN(FModelStatScope_, __LINE__)(EFModelStat::Stat, Bytes)
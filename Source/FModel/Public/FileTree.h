@@ -0,0 +1,408 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Algo/Sort.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * Bump allocator for the file tree. Everything allocated here lives until Reset, so only trivially destructible
+ * types may be put in it.
+ */
+class FFileTreeArena
+{
+public:
+	static constexpr SIZE_T BlockSize = 256 * 1024;
+
+	void* Allocate(SIZE_T Size, SIZE_T Alignment)
+	{
+		uint8* Result = Align(Cursor, Alignment);
+		if (!Cursor || Result + Size > End)
+		{
+			const SIZE_T NewBlockSize = FMath::Max<SIZE_T>(BlockSize, Size + Alignment);
+			Blocks.Emplace(new uint8[NewBlockSize]);
+			Cursor = Blocks.Last().Get();
+			End = Cursor + NewBlockSize;
+			AllocatedSize += NewBlockSize;
+			Result = Align(Cursor, Alignment);
+		}
+		Cursor = Result + Size;
+		return Result;
+	}
+
+	template <typename T, typename... ArgsType>
+	T* New(ArgsType&&... Args)
+	{
+		static_assert(TIsTriviallyDestructible<T>::Value, "Arena allocations are never destructed");
+		return new (Allocate(sizeof(T), alignof(T))) T(Forward<ArgsType>(Args)...);
+	}
+
+	void Reset()
+	{
+		Blocks.Reset();
+		Cursor = nullptr;
+		End = nullptr;
+		AllocatedSize = 0;
+	}
+
+	int64 GetAllocatedSize() const { return AllocatedSize + Blocks.GetAllocatedSize(); }
+
+private:
+	TArray<TUniquePtr<uint8[]>> Blocks;
+	uint8* Cursor = nullptr;
+	uint8* End = nullptr;
+	int64 AllocatedSize = 0;
+};
+
+struct FFileTreeNode
+{
+	/** Interned, not null terminated */
+	const TCHAR* Name = nullptr;
+	FFileTreeNode* Parent = nullptr;
+	/** Unsorted child chain, only walked when (re)sorting a directory */
+	FFileTreeNode* FirstChild = nullptr;
+	FFileTreeNode* NextSibling = nullptr;
+	/** Sorted children, range in FFileTree::Children */
+	uint32 ChildrenStart = 0;
+	uint32 NumChildren = 0;
+	int32 NameLen = 0;
+	bool bIsDirectory = false;
+	bool bDirty = false;
+	/** Lazily filled trees only: the directory's children have been listed */
+	bool bPopulated = false;
+
+	bool IsFile() const { return !bIsDirectory; }
+	FStringView GetNameView() const { return FStringView(Name, NameLen); }
+	FString GetName() const { return FString(NameLen, Name); }
+};
+
+/**
+ * File tree with nodes and path segments in an arena. Segments are interned, children are index ranges into a
+ * single array, and full paths are only rebuilt when asked for.
+ */
+class FFileTree
+{
+public:
+	FFileTree()
+	{
+		Reset();
+	}
+
+	FFileTree(const FFileTree&) = delete;
+	FFileTree& operator=(const FFileTree&) = delete;
+
+	FFileTree(FFileTree&& Other)
+	{
+		*this = MoveTemp(Other);
+	}
+
+	/** Nodes live in heap blocks owned by the arena, so they keep their addresses */
+	FFileTree& operator=(FFileTree&& Other)
+	{
+		if (this != &Other)
+		{
+			Arena = MoveTemp(Other.Arena);
+			Names = MoveTemp(Other.Names);
+			ChildLookup = MoveTemp(Other.ChildLookup);
+			Children = MoveTemp(Other.Children);
+			RootItems = MoveTemp(Other.RootItems);
+			DirtyDirectories = MoveTemp(Other.DirtyDirectories);
+			Root = Other.Root;
+			NumNodes = Other.NumNodes;
+			NumWastedChildren = Other.NumWastedChildren;
+			LegacySizeEstimate = Other.LegacySizeEstimate;
+			Other.Reset();
+		}
+		return *this;
+	}
+
+	void Reset()
+	{
+		Arena.Reset();
+		Names.Reset();
+		ChildLookup.Reset();
+		Children.Reset();
+		RootItems.Reset();
+		DirtyDirectories.Reset();
+		Root = Arena.New<FFileTreeNode>();
+		Root->Name = TEXT("");
+		Root->bIsDirectory = true;
+		NumNodes = 0;
+		NumWastedChildren = 0;
+		LegacySizeEstimate = 0;
+	}
+
+	void AddEntry(FStringView Path)
+	{
+		FFileTreeNode* Node = Root;
+		int32 SegmentStart = 0;
+		while (SegmentStart < Path.Len())
+		{
+			int32 SegmentEnd = SegmentStart;
+			while (SegmentEnd < Path.Len() && Path[SegmentEnd] != TEXT('/'))
+			{
+				++SegmentEnd;
+			}
+			if (SegmentEnd > SegmentStart)
+			{
+				const bool bIsDirectory = SegmentEnd < Path.Len();
+				Node = FindOrAddChild(Node, Path.Mid(SegmentStart, SegmentEnd - SegmentStart), bIsDirectory, SegmentEnd);
+			}
+			SegmentStart = SegmentEnd + 1;
+		}
+	}
+
+	/** Finds or adds one child of Parent, for trees filled one directory at a time */
+	FFileTreeNode* AddChild(FFileTreeNode* Parent, FStringView Name, bool bIsDirectory)
+	{
+		int32 PathLength = Name.Len();
+		for (const FFileTreeNode* Node = Parent; Node != Root; Node = Node->Parent)
+		{
+			PathLength += Node->NameLen + 1;
+		}
+		return FindOrAddChild(Parent, Name, bIsDirectory, PathLength);
+	}
+
+	/** Adds every node of Other that is not in this tree yet, names are copied into this tree's arena */
+	void Merge(const FFileTree& Other)
+	{
+		MergeChildren(Root, Other.Root, 0);
+	}
+
+	/**
+	 * Merges a set of partial trees pairwise in parallel, the larger tree of each pair absorbing the smaller one.
+	 * The result ends up in Trees[0].
+	 */
+	static void MergeAll(TArray<FFileTree>& Trees)
+	{
+		for (int32 Stride = 1; Stride < Trees.Num(); Stride *= 2)
+		{
+			const int32 NumPairs = (Trees.Num() + 2 * Stride - 1) / (2 * Stride);
+			ParallelFor(NumPairs, [&Trees, Stride](int32 PairIndex)
+			{
+				const int32 A = PairIndex * 2 * Stride;
+				const int32 B = A + Stride;
+				if (B < Trees.Num())
+				{
+					if (Trees[A].Num() < Trees[B].Num())
+					{
+						Swap(Trees[A], Trees[B]);
+					}
+					Trees[A].Merge(Trees[B]);
+					Trees[B].Reset();
+				}
+			});
+		}
+	}
+
+	/** Sorts the children of every directory that changed since the last call, directories first */
+	void Finalize()
+	{
+		if (NumWastedChildren > Children.Num() / 2)
+		{
+			// Mostly stale ranges left behind by incremental updates, lay everything out again
+			Children.Reset();
+			NumWastedChildren = 0;
+			MarkAllDirty(Root);
+		}
+
+		// Views may be iterating RootItems while a lazily filled directory gets finalized, leave it alone unless it changed
+		const bool bRootDirty = Root->bDirty;
+		TArray<FFileTreeNode*> Sorted;
+		for (FFileTreeNode* Directory : DirtyDirectories)
+		{
+			Sorted.Reset();
+			for (FFileTreeNode* Child = Directory->FirstChild; Child; Child = Child->NextSibling)
+			{
+				Sorted.Add(Child);
+			}
+			Algo::Sort(Sorted, [](const FFileTreeNode* A, const FFileTreeNode* B)
+			{
+				if (A->bIsDirectory != B->bIsDirectory)
+				{
+					return A->bIsDirectory;
+				}
+				return A->GetNameView().Compare(B->GetNameView(), ESearchCase::IgnoreCase) < 0;
+			});
+			NumWastedChildren += Directory->NumChildren;
+			Directory->ChildrenStart = Children.Num();
+			Directory->NumChildren = Sorted.Num();
+			Directory->bDirty = false;
+			Children.Append(Sorted);
+		}
+		DirtyDirectories.Reset();
+
+		if (bRootDirty)
+		{
+			RootItems.Reset();
+			RootItems.Append(Children.GetData() + Root->ChildrenStart, Root->NumChildren);
+		}
+	}
+
+	FFileTreeNode* GetRoot() const { return Root; }
+	const TArray<FFileTreeNode*>* GetRootItems() const { return &RootItems; }
+
+	TArrayView<FFileTreeNode* const> GetChildren(const FFileTreeNode* Node) const
+	{
+		return TArrayView<FFileTreeNode* const>(Children.GetData() + Node->ChildrenStart, Node->NumChildren);
+	}
+
+	FString GetPath(const FFileTreeNode* Node) const
+	{
+		TArray<const FFileTreeNode*, TInlineAllocator<32>> Chain;
+		int32 Length = 0;
+		for (; Node && Node != Root; Node = Node->Parent)
+		{
+			Chain.Add(Node);
+			Length += Node->NameLen + 1;
+		}
+		FString Path;
+		Path.Reserve(Length);
+		for (int32 i = Chain.Num(); i--;)
+		{
+			Path.AppendChars(Chain[i]->Name, Chain[i]->NameLen);
+			if (i)
+			{
+				Path.AppendChar(TEXT('/'));
+			}
+		}
+		return Path;
+	}
+
+	int32 Num() const { return NumNodes; }
+
+	int64 GetAllocatedSize() const
+	{
+		return Arena.GetAllocatedSize() + Names.GetAllocatedSize() + ChildLookup.GetAllocatedSize()
+			+ Children.GetAllocatedSize() + RootItems.GetAllocatedSize() + DirtyDirectories.GetAllocatedSize();
+	}
+
+	/**
+	 * What the previous TMap<FString, TSharedPtr<FFileTreeNode>> based tree would have allocated for the same nodes:
+	 * per node a shared node with an empty TMap, FString path and TArray pointer plus its reference controller
+	 * (~128 bytes), the full path, the parent's map element and key (~44 bytes + name) and the sorted entries list (~16 bytes).
+	 */
+	int64 GetLegacyAllocatedSizeEstimate() const { return LegacySizeEstimate; }
+
+private:
+	struct FNameKeyFuncs : BaseKeyFuncs<FStringView, FStringView, false>
+	{
+		static FORCEINLINE FStringView GetSetKey(FStringView Element) { return Element; }
+		static FORCEINLINE bool Matches(FStringView A, FStringView B) { return A.Equals(B, ESearchCase::CaseSensitive); }
+		static FORCEINLINE uint32 GetKeyHash(FStringView Key) { return FCrc::MemCrc32(Key.GetData(), Key.Len() * sizeof(TCHAR)); }
+	};
+
+	/** Parent and child name, the name viewing the child's interned spelling */
+	typedef TPair<const FFileTreeNode*, FStringView> FChildKey;
+
+	/**
+	 * Siblings match case-insensitively like the archives' own lookups, so Content/Athena and Content/athena from
+	 * different archives share one node, spelled the way it was first seen. Names stay interned as spelled.
+	 */
+	struct FChildKeyFuncs : TDefaultMapKeyFuncs<FChildKey, FFileTreeNode*, false>
+	{
+		static FORCEINLINE bool Matches(const FChildKey& A, const FChildKey& B)
+		{
+			return A.Key == B.Key && A.Value.Equals(B.Value, ESearchCase::IgnoreCase);
+		}
+
+		/** FNV-1a over lowered characters, equal for any two names IgnoreCase matches */
+		static FORCEINLINE uint32 GetKeyHash(const FChildKey& Key)
+		{
+			uint32 Hash = 2166136261u;
+			for (TCHAR Char : Key.Value)
+			{
+				Hash = (Hash ^ (uint32)FChar::ToLower(Char)) * 16777619u;
+			}
+			return HashCombine(GetTypeHash(Key.Key), Hash);
+		}
+	};
+
+	const TCHAR* InternName(FStringView Name)
+	{
+		if (const FStringView* Existing = Names.Find(Name))
+		{
+			return Existing->GetData();
+		}
+		TCHAR* Interned = (TCHAR*)Arena.Allocate(Name.Len() * sizeof(TCHAR), alignof(TCHAR));
+		FMemory::Memcpy(Interned, Name.GetData(), Name.Len() * sizeof(TCHAR));
+		Names.Add(FStringView(Interned, Name.Len()));
+		return Interned;
+	}
+
+	FFileTreeNode* FindOrAddChild(FFileTreeNode* Parent, FStringView Name, bool bIsDirectory, int32 PathLength)
+	{
+		const FChildKey Key(Parent, Name);
+		const uint32 KeyHash = FChildKeyFuncs::GetKeyHash(Key);
+		FFileTreeNode* Child = nullptr;
+		if (FFileTreeNode** Existing = ChildLookup.FindByHash(KeyHash, Key))
+		{
+			Child = *Existing;
+		}
+		else
+		{
+			Child = Arena.New<FFileTreeNode>();
+			Child->Name = InternName(Name);
+			Child->NameLen = Name.Len();
+			Child->Parent = Parent;
+			Child->NextSibling = Parent->FirstChild;
+			Parent->FirstChild = Child;
+			// Name may be a caller's buffer, the key has to outlive it
+			ChildLookup.AddByHash(KeyHash, FChildKey(Parent, Child->GetNameView()), Child);
+			MarkDirty(Parent);
+			++NumNodes;
+			LegacySizeEstimate += 188 + (PathLength + 1) * sizeof(TCHAR) + (Name.Len() + 1) * sizeof(TCHAR);
+		}
+		if (bIsDirectory && !Child->bIsDirectory)
+		{
+			Child->bIsDirectory = true;
+			MarkDirty(Parent);
+		}
+		return Child;
+	}
+
+	void MergeChildren(FFileTreeNode* Into, const FFileTreeNode* From, int32 PathLength)
+	{
+		for (const FFileTreeNode* Child = From->FirstChild; Child; Child = Child->NextSibling)
+		{
+			const int32 ChildPathLength = PathLength + (PathLength ? 1 : 0) + Child->NameLen;
+			FFileTreeNode* Merged = FindOrAddChild(Into, Child->GetNameView(), Child->bIsDirectory, ChildPathLength);
+			if (Child->bIsDirectory)
+			{
+				MergeChildren(Merged, Child, ChildPathLength);
+			}
+		}
+	}
+
+	void MarkDirty(FFileTreeNode* Directory)
+	{
+		if (!Directory->bDirty)
+		{
+			Directory->bDirty = true;
+			DirtyDirectories.Add(Directory);
+		}
+	}
+
+	void MarkAllDirty(FFileTreeNode* Directory)
+	{
+		Directory->NumChildren = 0;
+		MarkDirty(Directory);
+		for (FFileTreeNode* Child = Directory->FirstChild; Child; Child = Child->NextSibling)
+		{
+			if (Child->bIsDirectory)
+			{
+				MarkAllDirty(Child);
+			}
+		}
+	}
+
+	FFileTreeArena Arena;
+	TSet<FStringView, FNameKeyFuncs> Names;
+	TMap<FChildKey, FFileTreeNode*, FDefaultSetAllocator, FChildKeyFuncs> ChildLookup;
+	TArray<FFileTreeNode*> Children;
+	TArray<FFileTreeNode*> RootItems;
+	TArray<FFileTreeNode*> DirtyDirectories;
+	FFileTreeNode* Root = nullptr;
+	int32 NumNodes = 0;
+	int32 NumWastedChildren = 0;
+	int64 LegacySizeEstimate = 0;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "FModelStats.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/Event.h"
+#include "IO/IoDispatcher.h"
+
+/**
+ * Reads one IoStore chunk through the IoDispatcher. Small reads are served from a window of whole compression blocks,
+ * and the window after it is requested in the background while the current one is being consumed. Reads covering
+ * whole windows go straight into the caller's buffer. The dispatcher reads, decrypts and decompresses on its own
+ * threads, so the time spent waiting on it is counted as BlockRead.
+ */
+class FIoStoreFileHandle : public IFileHandle
+{
+public:
+	FIoStoreFileHandle(const FIoChunkId& InChunkId, int64 InSize, int64 InCompressionBlockSize)
+		: ChunkId(InChunkId)
+		, ChunkSize(InSize)
+		, WindowSize(Align(FMath::Max<int64>(InCompressionBlockSize, 256 * 1024), FMath::Max<int64>(InCompressionBlockSize, 1)))
+	{
+	}
+
+	virtual ~FIoStoreFileHandle() override
+	{
+		WaitForPrefetch();
+	}
+
+	virtual int64 Tell() override { return Pos; }
+	virtual int64 Size() override { return ChunkSize; }
+
+	virtual bool Seek(int64 NewPosition) override
+	{
+		if (NewPosition < 0 || NewPosition > ChunkSize)
+		{
+			return false;
+		}
+		Pos = NewPosition;
+		return true;
+	}
+
+	virtual bool SeekFromEnd(int64 NewPositionRelativeToEnd = 0) override { return Seek(ChunkSize + NewPositionRelativeToEnd); }
+
+	virtual bool Read(uint8* Destination, int64 BytesToRead) override
+	{
+		if (BytesToRead < 0 || Pos + BytesToRead > ChunkSize)
+		{
+			return false;
+		}
+		while (BytesToRead > 0)
+		{
+			if (Pos >= WindowOffset && Pos < WindowOffset + (int64)Window.DataSize())
+			{
+				const int64 CopySize = FMath::Min<int64>(BytesToRead, WindowOffset + Window.DataSize() - Pos);
+				FMemory::Memcpy(Destination, Window.Data() + (Pos - WindowOffset), CopySize);
+				Destination += CopySize;
+				BytesToRead -= CopySize;
+				Pos += CopySize;
+				continue;
+			}
+
+			const int64 WindowStart = AlignDown(Pos, WindowSize);
+			if (Pos == WindowStart && BytesToRead >= WindowSize && Prefetch.Offset != WindowStart)
+			{
+				const int64 DirectSize = AlignDown(BytesToRead, WindowSize);
+				if (!ReadChunk(Pos, DirectSize, Destination).IsOk())
+				{
+					return false;
+				}
+				Destination += DirectSize;
+				BytesToRead -= DirectSize;
+				Pos += DirectSize;
+				continue;
+			}
+
+			if (!FillWindow(WindowStart))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	virtual bool Write(const uint8* Source, int64 BytesToWrite) override { return false; }
+	virtual bool Flush(const bool bFullFlush = false) override { return false; }
+	virtual bool Truncate(int64 NewSize) override { return false; }
+
+private:
+	struct FPrefetch
+	{
+		FIoRequest Request;
+		FEvent* Event = nullptr;
+		int64 Offset = -1;
+	};
+
+	bool FillWindow(int64 WindowStart)
+	{
+		if (Prefetch.Event && Prefetch.Offset == WindowStart)
+		{
+			{
+				// Whatever is left of the prefetch after the time the caller spent on the previous window
+				FMODEL_STAT_SCOPE(BlockRead, FMath::Min(WindowSize, ChunkSize - WindowStart));
+				Prefetch.Event->Wait();
+			}
+			TIoStatusOr<FIoBuffer> Result = Prefetch.Request.GetResult();
+			ReleasePrefetch();
+			if (!Result.IsOk())
+			{
+				UE_LOG(LogFModel, Warning, TEXT("IoStore read failed: %s"), *Result.Status().ToString());
+				return false;
+			}
+			Window = Result.ConsumeValueOrDie();
+		}
+		else
+		{
+			WaitForPrefetch();
+			TIoStatusOr<FIoBuffer> Result = ReadChunk(WindowStart, FMath::Min(WindowSize, ChunkSize - WindowStart));
+			if (!Result.IsOk())
+			{
+				return false;
+			}
+			Window = Result.ConsumeValueOrDie();
+		}
+		WindowOffset = WindowStart;
+
+		const int64 NextWindowStart = WindowStart + WindowSize;
+		if (NextWindowStart < ChunkSize)
+		{
+			FIoBatch Batch = FIoDispatcher::Get().NewBatch();
+			Prefetch.Request = Batch.Read(ChunkId, FIoReadOptions(NextWindowStart, FMath::Min(WindowSize, ChunkSize - NextWindowStart)), IoDispatcherPriority_Medium);
+			Prefetch.Event = FPlatformProcess::GetSynchEventFromPool();
+			Prefetch.Offset = NextWindowStart;
+			Batch.IssueAndTriggerEvent(Prefetch.Event);
+		}
+		return true;
+	}
+
+	TIoStatusOr<FIoBuffer> ReadChunk(int64 Offset, int64 Size, uint8* Target = nullptr)
+	{
+		FIoReadOptions Options(Offset, Size);
+		if (Target)
+		{
+			Options.SetTargetVa(Target);
+		}
+		FIoBatch Batch = FIoDispatcher::Get().NewBatch();
+		FIoRequest Request = Batch.Read(ChunkId, Options, IoDispatcherPriority_High);
+		FEvent* Event = FPlatformProcess::GetSynchEventFromPool();
+		{
+			FMODEL_STAT_SCOPE(BlockRead, Size);
+			Batch.IssueAndTriggerEvent(Event);
+			Event->Wait();
+		}
+		FPlatformProcess::ReturnSynchEventToPool(Event);
+		TIoStatusOr<FIoBuffer> Result = Request.GetResult();
+		if (!Result.IsOk())
+		{
+			UE_LOG(LogFModel, Warning, TEXT("IoStore read failed: %s"), *Result.Status().ToString());
+		}
+		return Result;
+	}
+
+	void WaitForPrefetch()
+	{
+		if (Prefetch.Event)
+		{
+			Prefetch.Event->Wait();
+			ReleasePrefetch();
+		}
+	}
+
+	void ReleasePrefetch()
+	{
+		FPlatformProcess::ReturnSynchEventToPool(Prefetch.Event);
+		Prefetch = FPrefetch();
+	}
+
+	FIoChunkId ChunkId;
+	int64 ChunkSize;
+	int64 WindowSize;
+	int64 Pos = 0;
+
+	FIoBuffer Window;
+	int64 WindowOffset = 0;
+	FPrefetch Prefetch;
+};
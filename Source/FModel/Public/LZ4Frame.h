@@ -0,0 +1,390 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "Compression/lz4.h"
+#include "Serialization/Archive.h"
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+/** 0x184D2A50 to 0x184D2A5F, frames with user data that decoders skip */
+#define LZ4_SKIPPABLE_FRAME_MAGIC 0x184D2A50
+#define LZ4_SKIPPABLE_FRAME_MASK 0xFFFFFFF0
+
+/** XXH32, which the LZ4 frame format uses for its header and optional content checksums */
+inline uint32 LZ4FrameHash(const void* Data, int64 Size, uint32 Seed = 0)
+{
+	constexpr uint32 Prime1 = 2654435761u, Prime2 = 2246822519u, Prime3 = 3266489917u, Prime4 = 668265263u, Prime5 = 374761393u;
+	const uint8* Bytes = (const uint8*)Data;
+	const uint8* End = Bytes + Size;
+	auto ReadLane = [](const uint8* P) { uint32 Value; FMemory::Memcpy(&Value, P, sizeof(Value)); return Value; };
+	auto Rotate = [](uint32 Value, uint32 Shift) { return (Value << Shift) | (Value >> (32 - Shift)); };
+	auto Round = [Rotate](uint32 Acc, uint32 Lane) { return Rotate(Acc + Lane * Prime2, 13) * Prime1; };
+
+	uint32 Hash;
+	if (Size >= 16)
+	{
+		uint32 V1 = Seed + Prime1 + Prime2, V2 = Seed + Prime2, V3 = Seed, V4 = Seed - Prime1;
+		for (; Bytes + 16 <= End; Bytes += 16)
+		{
+			V1 = Round(V1, ReadLane(Bytes));
+			V2 = Round(V2, ReadLane(Bytes + 4));
+			V3 = Round(V3, ReadLane(Bytes + 8));
+			V4 = Round(V4, ReadLane(Bytes + 12));
+		}
+		Hash = Rotate(V1, 1) + Rotate(V2, 7) + Rotate(V3, 12) + Rotate(V4, 18);
+	}
+	else
+	{
+		Hash = Seed + Prime5;
+	}
+	Hash += (uint32)Size;
+	for (; Bytes + 4 <= End; Bytes += 4)
+	{
+		Hash = Rotate(Hash + ReadLane(Bytes) * Prime3, 17) * Prime4;
+	}
+	for (; Bytes < End; ++Bytes)
+	{
+		Hash = Rotate(Hash + *Bytes * Prime5, 11) * Prime1;
+	}
+	Hash ^= Hash >> 15;
+	Hash *= Prime2;
+	Hash ^= Hash >> 13;
+	Hash *= Prime3;
+	Hash ^= Hash >> 16;
+	return Hash;
+}
+
+/**
+ * Loading archive over a stream of LZ4 frames, decoded one block at a time. Memory is one compressed block and one
+ * decoded block plus the 64KiB window linked blocks refer back into, whatever the size of the stream. Skippable frames
+ * are skipped, checksums are read past but not verified apart from the header's. Malformed or truncated input sets
+ * the archive error.
+ */
+class FLZ4FrameReader : public FArchive
+{
+public:
+	static constexpr int64 WindowSize = 64 * 1024;
+
+	explicit FLZ4FrameReader(FArchive& InInner)
+		: Inner(InInner)
+	{
+		SetIsLoading(true);
+		SetIsPersistent(true);
+	}
+
+	virtual void Serialize(void* Data, int64 Length) override
+	{
+		uint8* Dest = (uint8*)Data;
+		while (Length > 0)
+		{
+			if (BlockPosition == BlockEnd && !DecodeNextBlock())
+			{
+				SetError();
+				FMemory::Memzero(Dest, Length);
+				return;
+			}
+			const int64 CopySize = FMath::Min(Length, BlockEnd - BlockPosition);
+			FMemory::Memcpy(Dest, Decoded.GetData() + BlockPosition, CopySize);
+			BlockPosition += CopySize;
+			Position += CopySize;
+			Dest += CopySize;
+			Length -= CopySize;
+		}
+	}
+
+	virtual bool AtEnd() override
+	{
+		return BlockPosition == BlockEnd && !DecodeNextBlock();
+	}
+
+	virtual int64 Tell() override { return Position; }
+	virtual FString GetArchiveName() const override { return TEXT("FLZ4FrameReader"); }
+
+private:
+	/** Decodes the next non-empty block into Decoded, crossing frame boundaries. False at the end or on an error. */
+	bool DecodeNextBlock()
+	{
+		while (!IsError())
+		{
+			if (!bInFrame && !ReadFrameHeader())
+			{
+				return false;
+			}
+
+			uint32 BlockHeader = 0;
+			Inner << BlockHeader;
+			if (Inner.IsError())
+			{
+				return Fail(TEXT("truncated block"));
+			}
+			if (BlockHeader == 0)
+			{
+				// End mark, the content checksum follows if the frame has one
+				if (bContentChecksum)
+				{
+					uint32 ContentChecksum;
+					Inner << ContentChecksum;
+				}
+				bInFrame = false;
+				continue;
+			}
+
+			const bool bUncompressed = (BlockHeader & 0x80000000u) != 0;
+			const int64 DataSize = BlockHeader & 0x7FFFFFFFu;
+			if (DataSize > BlockMaxSize)
+			{
+				return Fail(TEXT("block larger than the frame's block size"));
+			}
+
+			// Linked blocks may refer back into the last WindowSize bytes, which are kept in front of the new block
+			int64 DictionarySize = 0;
+			if (!bIndependentBlocks && BlockEnd > 0)
+			{
+				DictionarySize = FMath::Min<int64>(BlockEnd, WindowSize);
+				FMemory::Memmove(Decoded.GetData(), Decoded.GetData() + BlockEnd - DictionarySize, DictionarySize);
+			}
+			uint8* BlockStart = Decoded.GetData() + DictionarySize;
+
+			int64 DecodedSize = DataSize;
+			if (bUncompressed)
+			{
+				Inner.Serialize(BlockStart, DataSize);
+			}
+			else
+			{
+				Inner.Serialize(Compressed.GetData(), DataSize);
+				DecodedSize = DictionarySize
+					? LZ4_decompress_safe_usingDict((const char*)Compressed.GetData(), (char*)BlockStart, DataSize, BlockMaxSize, (const char*)Decoded.GetData(), DictionarySize)
+					: LZ4_decompress_safe((const char*)Compressed.GetData(), (char*)BlockStart, DataSize, BlockMaxSize);
+			}
+			if (bBlockChecksum)
+			{
+				uint32 BlockChecksum;
+				Inner << BlockChecksum;
+			}
+			if (Inner.IsError() || DecodedSize < 0)
+			{
+				return Fail(TEXT("corrupt block"));
+			}
+
+			BlockPosition = DictionarySize;
+			BlockEnd = DictionarySize + DecodedSize;
+			if (DecodedSize > 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ReadFrameHeader()
+	{
+		for (;;)
+		{
+			if (Inner.AtEnd())
+			{
+				return false;
+			}
+			uint32 Magic = 0;
+			Inner << Magic;
+			if ((Magic & LZ4_SKIPPABLE_FRAME_MASK) == LZ4_SKIPPABLE_FRAME_MAGIC)
+			{
+				uint32 SkipSize = 0;
+				Inner << SkipSize;
+				Inner.Seek(Inner.Tell() + SkipSize);
+				continue;
+			}
+			if (Magic != LZ4_FRAME_MAGIC)
+			{
+				return Fail(TEXT("not an LZ4 frame"));
+			}
+			break;
+		}
+
+		// FLG, BD, then the optional content size and dictionary ID, all covered by the header checksum
+		uint8 Descriptor[14];
+		Inner.Serialize(Descriptor, 2);
+		const uint8 Flags = Descriptor[0];
+		const uint8 BlockDescriptor = Descriptor[1];
+		if ((Flags >> 6) != 1)
+		{
+			return Fail(TEXT("unsupported frame version"));
+		}
+		int32 DescriptorSize = 2 + ((Flags & 0x08) ? 8 : 0) + ((Flags & 0x01) ? 4 : 0);
+		Inner.Serialize(Descriptor + 2, DescriptorSize - 2);
+		uint8 HeaderChecksum = 0;
+		Inner << HeaderChecksum;
+		if (Inner.IsError() || HeaderChecksum != (uint8)(LZ4FrameHash(Descriptor, DescriptorSize) >> 8))
+		{
+			return Fail(TEXT("frame header checksum mismatch"));
+		}
+		if (Flags & 0x01)
+		{
+			return Fail(TEXT("frames with a dictionary are not supported"));
+		}
+
+		const int32 BlockSizeId = (BlockDescriptor >> 4) & 0x7;
+		if (BlockSizeId < 4)
+		{
+			return Fail(TEXT("invalid block size"));
+		}
+		bIndependentBlocks = (Flags & 0x20) != 0;
+		bBlockChecksum = (Flags & 0x10) != 0;
+		bContentChecksum = (Flags & 0x04) != 0;
+		BlockMaxSize = (int64)1 << (8 + 2 * BlockSizeId);
+		// Buffers only grow, and only up to 4MiB blocks
+		if (Compressed.Num() < BlockMaxSize)
+		{
+			Compressed.SetNumUninitialized(BlockMaxSize);
+		}
+		if (Decoded.Num() < WindowSize + BlockMaxSize)
+		{
+			Decoded.SetNumUninitialized(WindowSize + BlockMaxSize);
+		}
+		// A new frame starts without history
+		BlockPosition = BlockEnd = 0;
+		bInFrame = true;
+		return true;
+	}
+
+	bool Fail(const TCHAR* Reason)
+	{
+		UE_LOG(LogFModel, Warning, TEXT("LZ4 frame stream at %lld of %s: %s"), Inner.Tell(), *Inner.GetArchiveName(), Reason);
+		SetError();
+		return false;
+	}
+
+	FArchive& Inner;
+	TArray<uint8> Compressed;
+	/** [dictionary carried over from the previous block][current block] */
+	TArray<uint8> Decoded;
+	int64 BlockPosition = 0;
+	int64 BlockEnd = 0;
+	int64 Position = 0;
+	int64 BlockMaxSize = 0;
+	bool bInFrame = false;
+	bool bIndependentBlocks = true;
+	bool bBlockChecksum = false;
+	bool bContentChecksum = false;
+};
+
+/**
+ * Saving archive that writes one LZ4 frame of independent blocks, without block or content checksums. Blocks depending
+ * on nothing before them is what lets CompressBlocks run on any thread, with AppendBlocks splicing its output into the
+ * frame in order. Bytes serialized directly are buffered up to a block and compressed on this thread.
+ */
+class FLZ4FrameWriter : public FArchive
+{
+public:
+	/** BlockSizeId is the frame's BD field, 4 to 7 for 64KiB, 256KiB, 1MiB or 4MiB blocks */
+	explicit FLZ4FrameWriter(FArchive& InInner, int32 BlockSizeId = 6)
+		: Inner(InInner)
+		, BlockMaxSize(GetBlockMaxSize(BlockSizeId))
+	{
+		SetIsSaving(true);
+		SetIsPersistent(true);
+
+		uint32 Magic = LZ4_FRAME_MAGIC;
+		uint8 Descriptor[2] = { 0x40 | 0x20, (uint8)(FMath::Clamp(BlockSizeId, 4, 7) << 4) };
+		uint8 HeaderChecksum = (uint8)(LZ4FrameHash(Descriptor, sizeof(Descriptor)) >> 8);
+		Inner << Magic;
+		Inner.Serialize(Descriptor, sizeof(Descriptor));
+		Inner << HeaderChecksum;
+	}
+
+	virtual ~FLZ4FrameWriter() override
+	{
+		Close();
+	}
+
+	static int64 GetBlockMaxSize(int32 BlockSizeId)
+	{
+		return (int64)1 << (8 + 2 * FMath::Clamp(BlockSizeId, 4, 7));
+	}
+
+	/**
+	 * Appends Data to Out as blocks of at most BlockMaxSize, each with its size header. Blocks compression doesn't shrink
+	 * are stored as they are. Safe to call from any thread.
+	 */
+	static void CompressBlocks(const uint8* Data, int64 Size, int64 BlockMaxSize, TArray<uint8>& Out)
+	{
+		while (Size > 0)
+		{
+			const int32 BlockSize = (int32)FMath::Min(Size, BlockMaxSize);
+			const int32 HeaderOffset = Out.AddUninitialized(sizeof(uint32) + LZ4_compressBound(BlockSize));
+			uint8* BlockData = Out.GetData() + HeaderOffset + sizeof(uint32);
+			int32 DataSize = LZ4_compress_default((const char*)Data, (char*)BlockData, BlockSize, LZ4_compressBound(BlockSize));
+			uint32 BlockHeader = DataSize;
+			if (DataSize <= 0 || DataSize >= BlockSize)
+			{
+				FMemory::Memcpy(BlockData, Data, BlockSize);
+				DataSize = BlockSize;
+				BlockHeader = BlockSize | 0x80000000u;
+			}
+			FMemory::Memcpy(Out.GetData() + HeaderOffset, &BlockHeader, sizeof(BlockHeader));
+			Out.SetNum(HeaderOffset + sizeof(uint32) + DataSize, false);
+			Data += BlockSize;
+			Size -= BlockSize;
+		}
+	}
+
+	virtual void Serialize(void* Data, int64 Length) override
+	{
+		const uint8* Source = (const uint8*)Data;
+		while (Length > 0)
+		{
+			const int64 CopySize = FMath::Min(Length, BlockMaxSize - Pending.Num());
+			Pending.Append(Source, CopySize);
+			Position += CopySize;
+			Source += CopySize;
+			Length -= CopySize;
+			if (Pending.Num() == BlockMaxSize)
+			{
+				FlushPending();
+			}
+		}
+	}
+
+	/** Writes blocks CompressBlocks made with this writer's BlockMaxSize, DecodedSize being what they decode to */
+	void AppendBlocks(const TArray<uint8>& Blocks, int64 DecodedSize)
+	{
+		FlushPending();
+		Inner.Serialize((void*)Blocks.GetData(), Blocks.Num());
+		Position += DecodedSize;
+	}
+
+	/** Writes what is buffered and the end mark, nothing can be added afterwards */
+	void Close()
+	{
+		if (!bClosed)
+		{
+			FlushPending();
+			uint32 EndMark = 0;
+			Inner << EndMark;
+			bClosed = true;
+		}
+	}
+
+	virtual int64 Tell() override { return Position; }
+	virtual FString GetArchiveName() const override { return TEXT("FLZ4FrameWriter"); }
+	int64 GetBlockMaxSize() const { return BlockMaxSize; }
+
+private:
+	void FlushPending()
+	{
+		if (Pending.Num())
+		{
+			Compressed.Reset();
+			CompressBlocks(Pending.GetData(), Pending.Num(), BlockMaxSize, Compressed);
+			Inner.Serialize(Compressed.GetData(), Compressed.Num());
+			Pending.Reset();
+		}
+	}
+
+	FArchive& Inner;
+	int64 BlockMaxSize;
+	TArray<uint8> Pending;
+	TArray<uint8> Compressed;
+	int64 Position = 0;
+	bool bClosed = false;
+};
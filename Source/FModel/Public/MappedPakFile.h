@@ -0,0 +1,217 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "FModelStats.h"
+#include "PakBlockCache.h"
+#include "Async/MappedFileHandle.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "IPlatformFilePak.h"
+
+/** A whole pak mapped read-only, kept alive by every handle and view reading from it */
+class FMappedPakFile
+{
+public:
+	static TSharedPtr<FMappedPakFile, ESPMode::ThreadSafe> Open(IPlatformFile* LowerLevel, const FString& Path)
+	{
+		if (!FPlatformProperties::SupportsMemoryMappedFiles())
+		{
+			return nullptr;
+		}
+		TUniquePtr<IMappedFileHandle> Handle(LowerLevel->OpenMapped(*Path));
+		if (!Handle.IsValid())
+		{
+			return nullptr;
+		}
+		TUniquePtr<IMappedFileRegion> Region(Handle->MapRegion(0, Handle->GetFileSize()));
+		if (!Region.IsValid())
+		{
+			UE_LOG(LogFModel, Warning, TEXT("Failed to map %s, reading it through the pak reader"), *Path);
+			return nullptr;
+		}
+		return MakeShareable(new FMappedPakFile(MoveTemp(Handle), MoveTemp(Region)));
+	}
+
+	~FMappedPakFile()
+	{
+		// Region must go before the handle
+		Region.Reset();
+		Handle.Reset();
+	}
+
+	const uint8* GetData() const { return Region->GetMappedPtr(); }
+	int64 GetSize() const { return Region->GetMappedSize(); }
+
+private:
+	FMappedPakFile(TUniquePtr<IMappedFileHandle>&& InHandle, TUniquePtr<IMappedFileRegion>&& InRegion)
+		: Handle(MoveTemp(InHandle))
+		, Region(MoveTemp(InRegion))
+	{
+	}
+
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region;
+};
+
+typedef TSharedPtr<FMappedPakFile, ESPMode::ThreadSafe> FMappedPakFilePtr;
+
+/** Entry bytes inside a mapping, valid as long as the view is held */
+struct FVfsEntryView
+{
+	FMappedPakFilePtr Mapping;
+	TArrayView<const uint8> Data;
+};
+
+/**
+ * Reads one unencrypted pak entry out of a mapping. Uncompressed data is copied straight from the mapped pages,
+ * compressed blocks are decoded from the mapping into the destination without staging the compressed bytes.
+ */
+class FMappedPakEntryHandle : public IFileHandle
+{
+public:
+	/** bInUseBlockCache false keeps decoded blocks out of FPakBlockCache, for one-pass readers such as bulk exports */
+	FMappedPakEntryHandle(const FMappedPakFilePtr& InMapping, const FPakFile& PakFile, const FPakEntry& InEntry, bool bInUseBlockCache = true)
+		: Mapping(InMapping)
+		, Entry(InEntry)
+		, IndexHash(PakFile.GetInfo().IndexHash)
+		, CompressionMethod(PakFile.GetInfo().GetCompressionMethod(InEntry.CompressionMethodIndex))
+		, DataOffset(InEntry.Offset + InEntry.GetSerializedSize(PakFile.GetInfo().Version))
+		, BlocksOffset(PakFile.GetInfo().HasRelativeCompressedChunkOffsets() ? InEntry.Offset : 0)
+		, bUseBlockCache(bInUseBlockCache)
+	{
+		check(!Entry.IsEncrypted());
+	}
+
+	/** Pak entries whose bytes can be used in place */
+	static bool CanView(const FPakEntry& Entry)
+	{
+		return Entry.CompressionMethodIndex == 0 && !Entry.IsEncrypted();
+	}
+
+	/** False if the index puts the entry outside the mapping, as Read does for a truncated or corrupt pak */
+	static bool MakeView(const FMappedPakFilePtr& Mapping, const FPakFile& PakFile, const FPakEntry& Entry, FVfsEntryView& OutView)
+	{
+		check(CanView(Entry));
+		const int64 Offset = Entry.Offset + Entry.GetSerializedSize(PakFile.GetInfo().Version);
+		if (Entry.Offset < 0 || Entry.UncompressedSize < 0 || Offset + Entry.UncompressedSize > Mapping->GetSize())
+		{
+			return false;
+		}
+		OutView = FVfsEntryView { Mapping, TArrayView<const uint8>(Mapping->GetData() + Offset, Entry.UncompressedSize) };
+		return true;
+	}
+
+	virtual int64 Tell() override { return Pos; }
+	virtual int64 Size() override { return Entry.UncompressedSize; }
+
+	virtual bool Seek(int64 NewPosition) override
+	{
+		if (NewPosition < 0 || NewPosition > Entry.UncompressedSize)
+		{
+			return false;
+		}
+		Pos = NewPosition;
+		return true;
+	}
+
+	virtual bool SeekFromEnd(int64 NewPositionRelativeToEnd = 0) override { return Seek(Entry.UncompressedSize + NewPositionRelativeToEnd); }
+
+	virtual bool Read(uint8* Destination, int64 BytesToRead) override
+	{
+		if (BytesToRead < 0 || Pos + BytesToRead > Entry.UncompressedSize)
+		{
+			return false;
+		}
+		if (Entry.CompressionMethodIndex == 0)
+		{
+			if (DataOffset + Pos + BytesToRead > Mapping->GetSize())
+			{
+				return false;
+			}
+			// Page faults on the mapping are where the disk reads happen
+			FMODEL_STAT_SCOPE(BlockRead, BytesToRead);
+			FMemory::Memcpy(Destination, Mapping->GetData() + DataOffset + Pos, BytesToRead);
+			Pos += BytesToRead;
+			return true;
+		}
+
+		const int64 CompressionBlockSize = Entry.CompressionBlockSize;
+		FPakBlockCache& BlockCache = FPakBlockCache::Get();
+		const bool bCacheBlocks = bUseBlockCache && BlockCache.IsEnabled();
+		while (BytesToRead > 0)
+		{
+			const uint32 BlockIndex = Pos / CompressionBlockSize;
+			const int64 BlockStart = BlockIndex * CompressionBlockSize;
+			const int64 UncompressedBlockSize = FMath::Min<int64>(Entry.UncompressedSize - BlockStart, CompressionBlockSize);
+			const int64 CopyOffset = Pos - BlockStart;
+			const int64 CopySize = FMath::Min<int64>(UncompressedBlockSize - CopyOffset, BytesToRead);
+			const FPakBlockKey CacheKey(IndexHash, Entry.Offset, BlockIndex);
+
+			if (BlockIndex == StagedBlock)
+			{
+				FMemory::Memcpy(Destination, StagingBlock.GetData() + CopyOffset, CopySize);
+			}
+			else if (!bCacheBlocks || !BlockCache.CopyOut(CacheKey, CopyOffset, CopySize, Destination))
+			{
+				const FPakCompressedBlock& Block = Entry.CompressionBlocks[BlockIndex];
+				const int64 CompressedStart = BlocksOffset + Block.CompressedStart;
+				const int64 CompressedSize = Block.CompressedEnd - Block.CompressedStart;
+				if (CompressedStart + CompressedSize > Mapping->GetSize())
+				{
+					return false;
+				}
+				// Whole blocks decode right into the destination, partial ones are kept for the next small read
+				const bool bWholeBlock = CopyOffset == 0 && CopySize == UncompressedBlockSize;
+				uint8* Target = Destination;
+				if (!bWholeBlock)
+				{
+					StagingBlock.SetNumUninitialized(CompressionBlockSize, false);
+					Target = StagingBlock.GetData();
+				}
+				bool bDecompressed;
+				{
+					// Includes faulting the compressed bytes in, there is no separate read to time
+					FMODEL_STAT_SCOPE(Decompress, UncompressedBlockSize);
+					bDecompressed = FCompression::UncompressMemory(CompressionMethod, Target, UncompressedBlockSize, Mapping->GetData() + CompressedStart, CompressedSize);
+				}
+				if (!bDecompressed)
+				{
+					UE_LOG(LogFModel, Warning, TEXT("Failed to decompress block %u of the entry at %lld"), BlockIndex, Entry.Offset);
+					StagedBlock = MAX_uint32;
+					return false;
+				}
+				if (bCacheBlocks)
+				{
+					BlockCache.Add(CacheKey, Target, UncompressedBlockSize);
+				}
+				if (!bWholeBlock)
+				{
+					StagedBlock = BlockIndex;
+					FMemory::Memcpy(Destination, StagingBlock.GetData() + CopyOffset, CopySize);
+				}
+			}
+
+			Destination += CopySize;
+			BytesToRead -= CopySize;
+			Pos += CopySize;
+		}
+		return true;
+	}
+
+	virtual bool Write(const uint8* Source, int64 BytesToWrite) override { return false; }
+	virtual bool Flush(const bool bFullFlush = false) override { return false; }
+	virtual bool Truncate(int64 NewSize) override { return false; }
+
+private:
+	FMappedPakFilePtr Mapping;
+	FPakEntry Entry;
+	FSHAHash IndexHash;
+	FName CompressionMethod;
+	int64 DataOffset;
+	int64 BlocksOffset;
+	bool bUseBlockCache;
+	int64 Pos = 0;
+
+	TArray<uint8> StagingBlock;
+	uint32 StagedBlock = MAX_uint32;
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/List.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+
+/** One compression block of one pak entry, the pak being told apart by its index hash */
+struct FPakBlockKey
+{
+	FSHAHash IndexHash;
+	int64 EntryOffset = 0;
+	uint32 BlockIndex = 0;
+
+	FPakBlockKey() = default;
+	FPakBlockKey(const FSHAHash& InIndexHash, int64 InEntryOffset, uint32 InBlockIndex)
+		: IndexHash(InIndexHash)
+		, EntryOffset(InEntryOffset)
+		, BlockIndex(InBlockIndex)
+	{
+	}
+
+	friend bool operator==(const FPakBlockKey& A, const FPakBlockKey& B)
+	{
+		return A.EntryOffset == B.EntryOffset && A.BlockIndex == B.BlockIndex && A.IndexHash == B.IndexHash;
+	}
+
+	friend uint32 GetTypeHash(const FPakBlockKey& Key)
+	{
+		return HashCombine(HashCombine(GetTypeHash(Key.IndexHash), GetTypeHash(Key.EntryOffset)), Key.BlockIndex);
+	}
+};
+
+struct FPakBlockCacheStats
+{
+	uint64 Hits = 0;
+	uint64 Misses = 0;
+	uint64 Evictions = 0;
+	int64 UsedBytes = 0;
+	int32 NumBlocks = 0;
+};
+
+/**
+ * Process-wide cache of decompressed pak blocks. Keys are spread over shards with their own lock and LRU list, each
+ * shard holding an equal part of the budget. -PakBlockCacheMB= sets the budget, 0 disables the cache.
+ */
+class FPakBlockCache
+{
+public:
+	static constexpr int32 NumShards = 16;
+
+	static FPakBlockCache& Get()
+	{
+		static FPakBlockCache Instance;
+		return Instance;
+	}
+
+	bool IsEnabled() const { return ShardBudget.Load() > 0; }
+	int64 GetBudget() const { return ShardBudget.Load() * NumShards; }
+
+	void SetBudget(int64 Bytes)
+	{
+		ShardBudget = Bytes / NumShards;
+		for (FShard& Shard : Shards)
+		{
+			FScopeLock Lock(&Shard.Lock);
+			Shard.EvictToBudget(ShardBudget.Load());
+		}
+	}
+
+	/** Copies Size bytes at Offset of a cached block to Dest, false on a miss */
+	bool CopyOut(const FPakBlockKey& Key, int64 Offset, int64 Size, void* Dest)
+	{
+		FShard& Shard = GetShard(Key);
+		FScopeLock Lock(&Shard.Lock);
+		FShard::FNode** Found = Shard.Lookup.Find(Key);
+		if (!Found)
+		{
+			++Shard.Misses;
+			return false;
+		}
+		FShard::FNode* Node = *Found;
+		check(Offset + Size <= Node->GetValue().Data.Num());
+		FMemory::Memcpy(Dest, Node->GetValue().Data.GetData() + Offset, Size);
+		Shard.Lru.RemoveNode(Node, false);
+		Shard.Lru.AddHead(Node);
+		++Shard.Hits;
+		return true;
+	}
+
+	void Add(const FPakBlockKey& Key, const uint8* Data, int64 Size)
+	{
+		const int64 Budget = ShardBudget.Load();
+		if (Size > Budget)
+		{
+			return;
+		}
+		// Copy outside the lock, losing a race to another reader of the same block only costs the copy
+		FShard::FNode* Node = new FShard::FNode(FCachedBlock { Key, TArray<uint8>(Data, Size) });
+		FShard& Shard = GetShard(Key);
+		FScopeLock Lock(&Shard.Lock);
+		if (Shard.Lookup.Contains(Key))
+		{
+			delete Node;
+			return;
+		}
+		Shard.Lookup.Add(Key, Node);
+		Shard.Lru.AddHead(Node);
+		Shard.UsedBytes += Size;
+		Shard.EvictToBudget(Budget);
+	}
+
+	/** Drops every cached block along with the stats */
+	void Reset()
+	{
+		for (FShard& Shard : Shards)
+		{
+			FScopeLock Lock(&Shard.Lock);
+			Shard.EvictToBudget(0);
+			Shard.Hits = Shard.Misses = Shard.Evictions = 0;
+		}
+	}
+
+	/** Starts hits, misses and evictions over, the cached blocks stay */
+	void ResetStats()
+	{
+		for (FShard& Shard : Shards)
+		{
+			FScopeLock Lock(&Shard.Lock);
+			Shard.Hits = Shard.Misses = Shard.Evictions = 0;
+		}
+	}
+
+	FPakBlockCacheStats GetStats() const
+	{
+		FPakBlockCacheStats Stats;
+		for (const FShard& Shard : Shards)
+		{
+			FScopeLock Lock(&Shard.Lock);
+			Stats.Hits += Shard.Hits;
+			Stats.Misses += Shard.Misses;
+			Stats.Evictions += Shard.Evictions;
+			Stats.UsedBytes += Shard.UsedBytes;
+			Stats.NumBlocks += Shard.Lookup.Num();
+		}
+		return Stats;
+	}
+
+private:
+	struct FCachedBlock
+	{
+		FPakBlockKey Key;
+		TArray<uint8> Data;
+	};
+
+	struct FShard
+	{
+		typedef TDoubleLinkedList<FCachedBlock>::TDoubleLinkedListNode FNode;
+
+		mutable FCriticalSection Lock;
+		TMap<FPakBlockKey, FNode*> Lookup;
+		/** Most recently used first */
+		TDoubleLinkedList<FCachedBlock> Lru;
+		int64 UsedBytes = 0;
+		uint64 Hits = 0;
+		uint64 Misses = 0;
+		uint64 Evictions = 0;
+
+		~FShard()
+		{
+			EvictToBudget(0);
+		}
+
+		void EvictToBudget(int64 Budget)
+		{
+			while (UsedBytes > Budget && Lru.GetTail())
+			{
+				FNode* Tail = Lru.GetTail();
+				UsedBytes -= Tail->GetValue().Data.Num();
+				Lookup.Remove(Tail->GetValue().Key);
+				Lru.RemoveNode(Tail, true);
+				++Evictions;
+			}
+		}
+	};
+
+	FPakBlockCache()
+	{
+		int64 BudgetMB = 256;
+		FParse::Value(FCommandLine::Get(), TEXT("PakBlockCacheMB="), BudgetMB);
+		ShardBudget = BudgetMB * 1024 * 1024 / NumShards;
+	}
+
+	FShard& GetShard(const FPakBlockKey& Key)
+	{
+		// Low bits go to the TMap, take shards from the top
+		return Shards[(GetTypeHash(Key) >> 28) % NumShards];
+	}
+
+	FShard Shards[NumShards];
+	TAtomic<int64> ShardBudget;
+};
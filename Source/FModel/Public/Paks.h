@@ -1,6 +1,45 @@
 ﻿#pragma once
 
 #include "IPlatformFilePak.h"
+#include "AESKeyHandle.h"
+#include "FModelStats.h"
+#include "PakBlockCache.h"
+#include "Async/TaskGraphInterfaces.h"
+
+/**
+ * Tuning for reads of compressed pak entries. Parsed from the command line once, benchmarks change it in between runs.
+ */
+/**
+ * How FPakCompressedReaderPolicy batches a read. Each handle takes a copy when it is created, so code comparing settings
+ * passes its own to FPakUtils::CreatePakFileHandle instead of changing what every other reader uses.
+ */
+struct FPakReadSettings
+{
+	/** Reads spanning at least this many compression blocks decompress them as a batch across the worker pool, 0 disables */
+	int32 ParallelDecompressMinBlocks = 4;
+	/** Block tasks one read may have in flight */
+	int32 MaxDecompressTasksInFlight = 8;
+	/** Adjacent compressed blocks are fetched with one read of up to this many bytes, 0 reads block by block */
+	int64 MaxCoalescedReadSize = 4 * 1024 * 1024;
+
+	FPakReadSettings()
+	{
+		MaxDecompressTasksInFlight = FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1);
+		FParse::Value(FCommandLine::Get(), TEXT("ParallelDecompressMinBlocks="), ParallelDecompressMinBlocks);
+		FParse::Value(FCommandLine::Get(), TEXT("MaxDecompressTasksInFlight="), MaxDecompressTasksInFlight);
+		int64 MaxCoalescedReadKB = MaxCoalescedReadSize / 1024;
+		FParse::Value(FCommandLine::Get(), TEXT("MaxCoalescedReadKB="), MaxCoalescedReadKB);
+		MaxCoalescedReadSize = FMath::Max<int64>(MaxCoalescedReadKB, 0) * 1024;
+		MaxDecompressTasksInFlight = FMath::Max(MaxDecompressTasksInFlight, 1);
+	}
+
+	/** Parsed from the command line once, never changed afterwards */
+	static const FPakReadSettings& GetDefault()
+	{
+		static const FPakReadSettings Settings;
+		return Settings;
+	}
+};
 
 /**
  * Class to handle correctly reading from a compressed file within a compressed package
@@ -18,9 +57,18 @@ public:
 		return Align(Size, Alignment);
 	}
 
+	static FORCEINLINE void DecryptBlock(void* Data, int64 Size, const FAESKeyHandle& Key)
+	{
+		FMODEL_STAT_SCOPE(Decrypt, Size);
+		Key.DecryptData((uint8*)Data, Size);
+	}
+
+	/** For readers that only know the GUID, costs a registry lookup per block */
 	static FORCEINLINE void DecryptBlock(void* Data, int64 Size, const FGuid& EncryptionKeyGuid)
 	{
-		FPakPlatformFile::GetPakCustomEncryptionDelegate().Execute((uint8*)Data, Size, EncryptionKeyGuid);
+		FAESKeyHandlePtr Key = FAESKeyRegistry::Get().Find(EncryptionKeyGuid);
+		checkf(Key.IsValid(), TEXT("No key submitted for %s"), *EncryptionKeyGuid.ToString());
+		DecryptBlock(Data, Size, *Key);
 	}
 };
 
@@ -43,6 +91,10 @@ struct FCompressionScratchBuffers
 	FSHAHash LastPakIndexHash;
 	uint32 LastDecompressedBlock;
 
+	/** Staging for batched reads: compressed block runs, then one block per in-flight task for partial edges */
+	int64				BatchBufferSize = 0;
+	TUniquePtr<uint8[]>	BatchBuffer;
+
 	FCompressionScratchBuffers* Next;
 
 	void EnsureBufferSpace(int64 CompressionBlockSize, int64 ScrachSize)
@@ -58,6 +110,15 @@ struct FCompressionScratchBuffers
 			ScratchBuffer = MakeUnique<uint8[]>(ScratchBufferSize);
 		}
 	}
+
+	void EnsureBatchBufferSpace(int64 Size)
+	{
+		if (BatchBufferSize < Size)
+		{
+			BatchBufferSize = Size;
+			BatchBuffer = MakeUnique<uint8[]>(BatchBufferSize);
+		}
+	}
 };
 
 /**
@@ -130,9 +191,10 @@ private:
 };
 
 /**
- * Class to handle correctly reading from a compressed file within a pak
+ * Class to handle correctly reading from a compressed file within a pak. With bCacheBlocks false the handle neither
+ * looks blocks up in FPakBlockCache nor adds them, for one-pass readers that would only evict blocks others reuse.
  */
-template< typename EncryptionPolicy = FPakNoEncryption >
+template< typename EncryptionPolicy = FPakNoEncryption, bool bCacheBlocks = true >
 class FPakCompressedReaderPolicy
 {
 public:
@@ -147,14 +209,28 @@ public:
 		void*				CopyOut;
 		int64				CopyOffset;
 		int64				CopyLength;
-		FGuid				EncryptionKeyGuid;
+		/** Set for encrypted entries, owned by the reader policy */
+		const FAESKeyHandle*	KeyHandle = nullptr;
+		/** Offer the decompressed block to FPakBlockCache under CacheKey */
+		bool				bAddToCache = false;
+		FPakBlockKey		CacheKey;
 
 		void DoWork()
 		{
 			// Decrypt and Uncompress from memory to memory.
-			int64 EncryptionSize = EncryptionPolicy::AlignReadRequest(CompressedSize);
-			EncryptionPolicy::DecryptBlock(CompressedBuffer, EncryptionSize, EncryptionKeyGuid);
-			FCompression::UncompressMemory(CompressionFormat, UncompressedBuffer, UncompressedSize, CompressedBuffer, CompressedSize);
+			if (KeyHandle)
+			{
+				int64 EncryptionSize = EncryptionPolicy::AlignReadRequest(CompressedSize);
+				FPakSimpleEncryption::DecryptBlock(CompressedBuffer, EncryptionSize, *KeyHandle);
+			}
+			{
+				FMODEL_STAT_SCOPE(Decompress, UncompressedSize);
+				FCompression::UncompressMemory(CompressionFormat, UncompressedBuffer, UncompressedSize, CompressedBuffer, CompressedSize);
+			}
+			if (bAddToCache)
+			{
+				FPakBlockCache::Get().Add(CacheKey, UncompressedBuffer, UncompressedSize);
+			}
 			if (CopyOut)
 			{
 				FMemory::Memcpy(CopyOut, UncompressedBuffer + CopyOffset, CopyLength);
@@ -169,11 +245,18 @@ public:
 		}
 	};
 
-	FPakCompressedReaderPolicy(const FPakFile& InPakFile, const FPakEntry& InPakEntry, TAcquirePakReaderFunction& InAcquirePakReader)
+	FPakCompressedReaderPolicy(const FPakFile& InPakFile, const FPakEntry& InPakEntry, TAcquirePakReaderFunction& InAcquirePakReader, const FPakReadSettings& InSettings = FPakReadSettings::GetDefault())
 		: PakFile(InPakFile)
 		, PakEntry(InPakEntry)
 		, AcquirePakReader(InAcquirePakReader)
+		, Settings(InSettings)
 	{
+		if (PakEntry.IsEncrypted())
+		{
+			// Resolved once per handle, block tasks use it without going through the registry
+			KeyHandle = FAESKeyRegistry::Get().Find(PakFile.GetInfo().EncryptionKeyGuid);
+			checkf(KeyHandle.IsValid(), TEXT("No key submitted for %s"), *PakFile.GetInfo().EncryptionKeyGuid.ToString());
+		}
 	}
 
 	~FPakCompressedReaderPolicy()
@@ -186,6 +269,10 @@ public:
 	FPakEntry			PakEntry;
 	/** Function that gives us an FArchive to read from. The result should never be cached, but acquired and used within the function doing the serialization operation */
 	TAcquirePakReaderFunction AcquirePakReader;
+	/** Key of an encrypted entry, kept alive for as long as the handle even if the key gets resubmitted */
+	FAESKeyHandlePtr	KeyHandle;
+	/** Copied when the handle is created */
+	FPakReadSettings	Settings;
 
 	FORCEINLINE int64 FileSize() const
 	{
@@ -221,6 +308,17 @@ public:
 		}
 
 		WorkingBufferRequiredSize = EncryptionPolicy::AlignReadRequest(WorkingBufferRequiredSize);
+
+		FPakBlockCache& BlockCache = FPakBlockCache::Get();
+		const bool bUseBlockCache = bCacheBlocks && BlockCache.IsEnabled();
+		const int64 NumBlocksToRead = (DirectCopyStart + Length + CompressionBlockSize - 1) / CompressionBlockSize;
+		const bool bParallel = Settings.ParallelDecompressMinBlocks > 0 && NumBlocksToRead >= Settings.ParallelDecompressMinBlocks;
+		if (bParallel || (Settings.MaxCoalescedReadSize > 0 && NumBlocksToRead > 1))
+		{
+			SerializeBatched(CompressionBlockIndex, DirectCopyStart, (uint8*)V, Length, CompressionMethod, WorkingBufferRequiredSize, ScratchSpace, bParallel ? Settings.MaxDecompressTasksInFlight : 1, bUseBlockCache);
+			return;
+		}
+
 		const bool bExistingScratchBufferValid = ScratchSpace->TempBufferSize >= CompressionBlockSize;
 		ScratchSpace->EnsureBufferSpace(CompressionBlockSize, WorkingBufferRequiredSize * 2);
 		WorkingBuffers[0] = ScratchSpace->ScratchBuffer.Get();
@@ -253,15 +351,28 @@ public:
 				// ensure the previous decompression destination was the scratch buffer.
 				&& !(DirectCopyStart == 0 && Length >= CompressionBlockSize);
 
+			const FPakBlockKey CacheKey(PakFile.GetInfo().IndexHash, PakEntry.Offset, CompressionBlockIndex);
 			if (bCurrentScratchTempBufferValid)
 			{
 				// Reuse the existing scratch buffer to avoid repeatedly deserializing and decompressing the same block.
 				FMemory::Memcpy(V, ScratchSpace->TempBuffer.Get() + DirectCopyStart, WriteSize);
 			}
+			else if (bUseBlockCache && BlockCache.CopyOut(CacheKey, DirectCopyStart, WriteSize, V))
+			{
+				// The next block read goes to the working buffer the pending task may still be decrypting
+				if (bStartedUncompress)
+				{
+					UncompressTask.EnsureCompletion();
+					bStartedUncompress = false;
+				}
+			}
 			else
 			{
-				PakReader->Seek(Block.CompressedStart + (PakFile.GetInfo().HasRelativeCompressedChunkOffsets() ? PakEntry.Offset : 0));
-				PakReader->Serialize(WorkingBuffers[CompressionBlockIndex & 1], ReadSize);
+				{
+					FMODEL_STAT_SCOPE(BlockRead, ReadSize);
+					PakReader->Seek(Block.CompressedStart + (PakFile.GetInfo().HasRelativeCompressedChunkOffsets() ? PakEntry.Offset : 0));
+					PakReader->Serialize(WorkingBuffers[CompressionBlockIndex & 1], ReadSize);
+				}
 				if (bStartedUncompress)
 				{
 					UncompressTask.EnsureCompletion();
@@ -269,7 +380,9 @@ public:
 				}
 
 				FPakUncompressTask& TaskDetails = UncompressTask.GetTask();
-				TaskDetails.EncryptionKeyGuid = PakFile.GetInfo().EncryptionKeyGuid;
+				TaskDetails.KeyHandle = KeyHandle.GetReference();
+				TaskDetails.bAddToCache = bUseBlockCache;
+				TaskDetails.CacheKey = CacheKey;
 
 				if (DirectCopyStart == 0 && Length >= CompressionBlockSize)
 				{
@@ -323,11 +436,290 @@ public:
 			UncompressTask.EnsureCompletion();
 		}
 	}
+
+private:
+	/**
+	 * Reads runs of adjacent compressed blocks with one request each, capped at FPakReadSettings::MaxCoalescedReadSize,
+	 * and hands every block to its own task decoding from its slice of the run, up to MaxInFlight tasks at a time.
+	 * Whole blocks decompress straight into their slice of V, only the partial first and last block go through
+	 * a staging block.
+	 */
+	void SerializeBatched(uint32 CompressionBlockIndex, int64 DirectCopyStart, uint8* V, int64 Length, FName CompressionMethod, int64 WorkingBufferSize, FScopedCompressionScratchBuffers& ScratchSpace, int32 MaxInFlight, bool bUseBlockCache)
+	{
+		const int64 CompressionBlockSize = PakEntry.CompressionBlockSize;
+		const uint32 LastBlockIndex = CompressionBlockIndex + (DirectCopyStart + Length - 1) / CompressionBlockSize;
+		const int64 BlocksOffset = PakFile.GetInfo().HasRelativeCompressedChunkOffsets() ? PakEntry.Offset : 0;
+
+		// Coalesced runs are double buffered; without coalescing every in-flight block needs a run buffer of its own
+		const int64 MaxCoalescedReadSize = Settings.MaxCoalescedReadSize;
+		const int32 NumRunBuffers = MaxCoalescedReadSize > 0 ? 2 : MaxInFlight + 1;
+		const int64 RunBufferSize = FMath::Max(WorkingBufferSize, EncryptionPolicy::AlignReadRequest(MaxCoalescedReadSize));
+		ScratchSpace->EnsureBatchBufferSpace(NumRunBuffers * RunBufferSize + MaxInFlight * CompressionBlockSize);
+		uint8* StagingBlocks = ScratchSpace->BatchBuffer.Get() + NumRunBuffers * RunBufferSize;
+
+		TArray<TUniquePtr<FAsyncTask<FPakUncompressTask>>, TInlineAllocator<16>> Tasks;
+		TArray<int32, TInlineAllocator<16>> TaskRunBuffers;
+		Tasks.SetNum(MaxInFlight);
+		TaskRunBuffers.Init(INDEX_NONE, MaxInFlight);
+
+		uint8* RunBuffer = nullptr;
+		int64 RunStart = 0;
+		uint32 RunEndBlockIndex = CompressionBlockIndex;
+		int32 NumRuns = 0;
+
+		FSharedPakReader PakReader = AcquirePakReader();
+		for (int32 BlockNumber = 0; Length > 0; ++BlockNumber, ++CompressionBlockIndex)
+		{
+			const FPakCompressedBlock& Block = PakEntry.CompressionBlocks[CompressionBlockIndex];
+			const int64 CompressedBlockSize = Block.CompressedEnd - Block.CompressedStart;
+			const int64 UncompressedBlockSize = FMath::Min<int64>(PakEntry.UncompressedSize - CompressionBlockIndex * CompressionBlockSize, CompressionBlockSize);
+			const int64 WriteSize = FMath::Min<int64>(UncompressedBlockSize - DirectCopyStart, Length);
+
+			const FPakBlockKey CacheKey(PakFile.GetInfo().IndexHash, PakEntry.Offset, CompressionBlockIndex);
+			if (bUseBlockCache && FPakBlockCache::Get().CopyOut(CacheKey, DirectCopyStart, WriteSize, V))
+			{
+				V += WriteSize;
+				Length -= WriteSize;
+				DirectCopyStart = 0;
+				continue;
+			}
+
+			if (CompressionBlockIndex >= RunEndBlockIndex)
+			{
+				// Extend the run over following blocks that sit right behind each other on disk
+				const int32 RunBufferIndex = NumRuns++ % NumRunBuffers;
+				RunBuffer = ScratchSpace->BatchBuffer.Get() + RunBufferIndex * RunBufferSize;
+				RunStart = Block.CompressedStart;
+				int64 RunEnd = Block.CompressedStart + EncryptionPolicy::AlignReadRequest(CompressedBlockSize);
+				RunEndBlockIndex = CompressionBlockIndex + 1;
+				while (MaxCoalescedReadSize > 0 && RunEndBlockIndex <= LastBlockIndex)
+				{
+					const FPakCompressedBlock& Next = PakEntry.CompressionBlocks[RunEndBlockIndex];
+					const int64 NextEnd = Next.CompressedStart + EncryptionPolicy::AlignReadRequest(Next.CompressedEnd - Next.CompressedStart);
+					if (Next.CompressedStart != RunEnd || NextEnd - RunStart > RunBufferSize)
+					{
+						break;
+					}
+					RunEnd = NextEnd;
+					++RunEndBlockIndex;
+				}
+
+				// Tasks still decoding out of this buffer's previous run must finish first
+				for (int32 Slot = 0; Slot < MaxInFlight; ++Slot)
+				{
+					if (TaskRunBuffers[Slot] == RunBufferIndex)
+					{
+						Tasks[Slot]->EnsureCompletion();
+						TaskRunBuffers[Slot] = INDEX_NONE;
+					}
+				}
+				FMODEL_STAT_SCOPE(BlockRead, RunEnd - RunStart);
+				PakReader->Seek(BlocksOffset + RunStart);
+				PakReader->Serialize(RunBuffer, RunEnd - RunStart);
+			}
+
+			// The slot's previous block must be done with its staging block before it is reused
+			const int32 Slot = BlockNumber % MaxInFlight;
+			TUniquePtr<FAsyncTask<FPakUncompressTask>>& Task = Tasks[Slot];
+			if (Task.IsValid())
+			{
+				Task->EnsureCompletion();
+			}
+			else
+			{
+				Task = MakeUnique<FAsyncTask<FPakUncompressTask>>();
+			}
+			TaskRunBuffers[Slot] = (NumRuns - 1) % NumRunBuffers;
+
+			FPakUncompressTask& TaskDetails = Task->GetTask();
+			TaskDetails.KeyHandle = KeyHandle.GetReference();
+			TaskDetails.CompressionFormat = CompressionMethod;
+			TaskDetails.UncompressedSize = UncompressedBlockSize;
+			TaskDetails.CompressedBuffer = RunBuffer + (Block.CompressedStart - RunStart);
+			TaskDetails.CompressedSize = CompressedBlockSize;
+			TaskDetails.bAddToCache = bUseBlockCache;
+			TaskDetails.CacheKey = CacheKey;
+			if (DirectCopyStart == 0 && WriteSize == UncompressedBlockSize)
+			{
+				TaskDetails.UncompressedBuffer = V;
+				TaskDetails.CopyOut = nullptr;
+			}
+			else
+			{
+				TaskDetails.UncompressedBuffer = StagingBlocks + Slot * CompressionBlockSize;
+				TaskDetails.CopyOut = V;
+				TaskDetails.CopyOffset = DirectCopyStart;
+				TaskDetails.CopyLength = WriteSize;
+			}
+
+			if (Length == WriteSize)
+			{
+				Task->StartSynchronousTask();
+			}
+			else
+			{
+				Task->StartBackgroundTask();
+			}
+
+			V += WriteSize;
+			Length -= WriteSize;
+			DirectCopyStart = 0;
+		}
+
+		for (TUniquePtr<FAsyncTask<FPakUncompressTask>>& Task : Tasks)
+		{
+			if (Task.IsValid())
+			{
+				Task->EnsureCompletion();
+			}
+		}
+	}
+};
+
+/**
+ * Reads an uncompressed pak entry the way the engine's FPakReaderPolicy does, with the reads timed as BlockRead apart
+ * from decryption. Encrypted entries are padded to whole AES blocks, partial ones at either end of a read go through a
+ * staging block. The key is resolved once per handle.
+ */
+class FPakUncompressedReaderPolicy
+{
+public:
+	FPakUncompressedReaderPolicy(const FPakFile& InPakFile, const FPakEntry& InPakEntry, TAcquirePakReaderFunction& InAcquirePakReader)
+		: PakFile(InPakFile)
+		, PakEntry(InPakEntry)
+		, AcquirePakReader(InAcquirePakReader)
+		, OffsetToFile(InPakEntry.Offset + InPakEntry.GetSerializedSize(InPakFile.GetInfo().Version))
+	{
+		if (PakEntry.IsEncrypted())
+		{
+			KeyHandle = FAESKeyRegistry::Get().Find(PakFile.GetInfo().EncryptionKeyGuid);
+			checkf(KeyHandle.IsValid(), TEXT("No key submitted for %s"), *PakFile.GetInfo().EncryptionKeyGuid.ToString());
+		}
+	}
+
+	const FPakFile&		PakFile;
+	FPakEntry			PakEntry;
+	TAcquirePakReaderFunction AcquirePakReader;
+	int64				OffsetToFile;
+	FAESKeyHandlePtr	KeyHandle;
+
+	FORCEINLINE int64 FileSize() const
+	{
+		return PakEntry.Size;
+	}
+
+	void Serialize(int64 DesiredPosition, void* V, int64 Length)
+	{
+		FSharedPakReader PakReader = AcquirePakReader();
+		uint8* Data = (uint8*)V;
+		if (!KeyHandle.IsValid())
+		{
+			FMODEL_STAT_SCOPE(BlockRead, Length);
+			PakReader->Seek(OffsetToFile + DesiredPosition);
+			PakReader->Serialize(Data, Length);
+			return;
+		}
+
+		alignas(16) uint8 StagingBlock[FAES::AESBlockSize];
+		while (Length > 0)
+		{
+			const int64 BlockStart = AlignDown(DesiredPosition, (int64)FAES::AESBlockSize);
+			const int64 CopyOffset = DesiredPosition - BlockStart;
+			const bool bPartial = CopyOffset != 0 || Length < FAES::AESBlockSize;
+			const int64 ReadSize = bPartial ? FAES::AESBlockSize : AlignDown(Length, (int64)FAES::AESBlockSize);
+			uint8* Target = bPartial ? StagingBlock : Data;
+			{
+				FMODEL_STAT_SCOPE(BlockRead, ReadSize);
+				PakReader->Seek(OffsetToFile + BlockStart);
+				PakReader->Serialize(Target, ReadSize);
+			}
+			FPakSimpleEncryption::DecryptBlock(Target, ReadSize, *KeyHandle);
+			const int64 CopySize = bPartial ? FMath::Min<int64>(FAES::AESBlockSize - CopyOffset, Length) : ReadSize;
+			if (bPartial)
+			{
+				FMemory::Memcpy(Data, StagingBlock + CopyOffset, CopySize);
+			}
+			Data += CopySize;
+			DesiredPosition += CopySize;
+			Length -= CopySize;
+		}
+	}
+};
+
+/**
+ * FPakFileHandle with the policy constructed from whatever follows the pak file, so policies can take more than the
+ * entry and the reader function. Holds a reference to the pak file like the engine's handle does.
+ */
+template <typename ReaderPolicy>
+class TPakEntryHandle : public IFileHandle
+{
+public:
+	template <typename... ArgTypes>
+	TPakEntryHandle(const TRefCountPtr<const FPakFile>& InPakFile, ArgTypes&&... Args)
+		: PakFile(InPakFile)
+		, Reader(*InPakFile, Forward<ArgTypes>(Args)...)
+	{
+	}
+
+	virtual int64 Tell() override { return ReadPos; }
+	virtual int64 Size() override { return Reader.FileSize(); }
+
+	virtual bool Seek(int64 NewPosition) override
+	{
+		if (NewPosition < 0 || NewPosition > Reader.FileSize())
+		{
+			return false;
+		}
+		ReadPos = NewPosition;
+		return true;
+	}
+
+	virtual bool SeekFromEnd(int64 NewPositionRelativeToEnd = 0) override { return Seek(Reader.FileSize() + NewPositionRelativeToEnd); }
+
+	virtual bool Read(uint8* Destination, int64 BytesToRead) override
+	{
+		if (BytesToRead < 0 || ReadPos + BytesToRead > Reader.FileSize())
+		{
+			return false;
+		}
+		if (BytesToRead)
+		{
+			Reader.Serialize(ReadPos, Destination, BytesToRead);
+			ReadPos += BytesToRead;
+		}
+		return true;
+	}
+
+	virtual bool Write(const uint8* Source, int64 BytesToWrite) override { return false; }
+	virtual bool Flush(const bool bFullFlush = false) override { return false; }
+	virtual bool Truncate(int64 NewSize) override { return false; }
+
+private:
+	TRefCountPtr<const FPakFile> PakFile;
+	ReaderPolicy Reader;
+	int64 ReadPos = 0;
+};
+
+/** Tag for reaching FPakFile::LoadIndex, which is private and only called from the FPakFile constructor */
+struct FPakFileLoadIndexAccess
+{
+	typedef bool (FPakFile::*FType)(FArchive&);
+	friend FType GetPrivateMember(FPakFileLoadIndexAccess);
 };
 
 struct FPakUtils
 {
-	static IFileHandle* CreatePakFileHandle(IPlatformFile* LowerLevel, const TRefCountPtr<FPakFile>& PakFile, const FPakEntry* FileEntry)
+	/**
+	 * Loads the index of a pak that was opened header-only, reusing its reader and parsed FPakInfo instead of
+	 * constructing a second FPakFile for the same archive.
+	 */
+	static bool LoadIndex(FPakFile& PakFile, IPlatformFile* LowerLevel);
+
+	/**
+	 * bUseBlockCache false keeps the handle's decompressed blocks out of FPakBlockCache, see FPakCompressedReaderPolicy.
+	 * Compressed entries are read with Settings, the command line's unless given.
+	 */
+	static IFileHandle* CreatePakFileHandle(IPlatformFile* LowerLevel, const TRefCountPtr<FPakFile>& PakFile, const FPakEntry* FileEntry, bool bUseBlockCache = true, const FPakReadSettings& Settings = FPakReadSettings::GetDefault())
 	{
 		IFileHandle* Result = nullptr;
 		TAcquirePakReaderFunction AcquirePakReader = [StoredPakFile=TRefCountPtr<FPakFile>(PakFile), LowerLevelPlatformFile = LowerLevel]() -> FSharedPakReader
@@ -341,20 +733,20 @@ struct FPakUtils
 		{
 			if (FileEntry->IsEncrypted())
 			{
-				Result = new FPakFileHandle<FPakCompressedReaderPolicy<FPakSimpleEncryption>>(ConstPakFile, *FileEntry, AcquirePakReader);
+				Result = bUseBlockCache
+					? (IFileHandle*)new TPakEntryHandle<FPakCompressedReaderPolicy<FPakSimpleEncryption>>(ConstPakFile, *FileEntry, AcquirePakReader, Settings)
+					: (IFileHandle*)new TPakEntryHandle<FPakCompressedReaderPolicy<FPakSimpleEncryption, false>>(ConstPakFile, *FileEntry, AcquirePakReader, Settings);
 			}
 			else
 			{
-				Result = new FPakFileHandle<FPakCompressedReaderPolicy<>>(ConstPakFile, *FileEntry, AcquirePakReader);
+				Result = bUseBlockCache
+					? (IFileHandle*)new TPakEntryHandle<FPakCompressedReaderPolicy<>>(ConstPakFile, *FileEntry, AcquirePakReader, Settings)
+					: (IFileHandle*)new TPakEntryHandle<FPakCompressedReaderPolicy<FPakNoEncryption, false>>(ConstPakFile, *FileEntry, AcquirePakReader, Settings);
 			}
 		}
-		else if (FileEntry->IsEncrypted())
-		{
-			Result = new FPakFileHandle<FPakReaderPolicy<FPakSimpleEncryption>>(ConstPakFile, *FileEntry, AcquirePakReader);
-		}
 		else
 		{
-			Result = new FPakFileHandle<>(ConstPakFile, *FileEntry, AcquirePakReader);
+			Result = new TPakEntryHandle<FPakUncompressedReaderPolicy>(ConstPakFile, *FileEntry, AcquirePakReader);
 		}
 
 		return Result;
@@ -0,0 +1,527 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FModel.h"
+#include "Algo/Sort.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "IO/IoDirectoryIndex.h"
+#include "IO/IoStore.h"
+#include "IPlatformFilePak.h"
+#include "Misc/FileHelper.h"
+#include "Misc/SecureHash.h"
+
+#define VFS_INDEX_MAGIC 0x58444946 // "FIDX"
+#define VFS_INDEX_VERSION 1
+
+/**
+ * Everything that has to match for a cached index to still describe an archive on disk
+ */
+struct FVfsIndexKey
+{
+	int64 ArchiveSize = -1;
+	int64 ArchiveTimestamp = 0;
+	/** FPakInfo::IndexHash for paks, SHA1 of the FIoStoreTocHeader for IoStore containers */
+	FSHAHash ArchiveHash;
+
+	static FVfsIndexKey Make(IPlatformFile* LowerLevel, const FString& ArchivePath, const FSHAHash& ArchiveHash)
+	{
+		FFileStatData StatData = LowerLevel->GetStatData(*ArchivePath);
+		FVfsIndexKey Key;
+		Key.ArchiveSize = StatData.FileSize;
+		Key.ArchiveTimestamp = StatData.ModificationTime.GetTicks();
+		Key.ArchiveHash = ArchiveHash;
+		return Key;
+	}
+};
+
+// On-disk layout, also used as-is in memory: [Header][Entries][Blocks][Strings]
+struct FVfsIndexHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	int64 ArchiveSize;
+	int64 ArchiveTimestamp;
+	uint8 ArchiveHash[20];
+	uint32 NumEntries;
+	uint32 NumBlocks;
+	uint32 StringsSize;
+	uint32 MountPointOffset;
+	uint32 MountPointLength;
+};
+static_assert(sizeof(FVfsIndexHeader) == 64, "FVfsIndexHeader layout changed, bump VFS_INDEX_VERSION");
+
+struct FVfsIndexEntry
+{
+	/** Full path including the mount point, UTF-8, not null terminated */
+	uint32 PathOffset;
+	uint32 PathLength;
+	/** TOC entry index for IoStore containers */
+	int64 Offset;
+	int64 Size;
+	int64 UncompressedSize;
+	uint8 Hash[20];
+	uint32 FirstBlock;
+	uint32 NumBlocks;
+	uint32 CompressionBlockSize;
+	uint8 CompressionMethodIndex;
+	uint8 Flags;
+	uint8 Padding[6];
+};
+static_assert(sizeof(FVfsIndexEntry) == 80, "FVfsIndexEntry layout changed, bump VFS_INDEX_VERSION");
+static_assert(sizeof(FPakCompressedBlock) == 16, "FPakCompressedBlock layout changed, bump VFS_INDEX_VERSION");
+
+/**
+ * Flat, immutable file index of one archive. Entries are sorted by case-insensitive path so lookups are a binary
+ * search and the whole thing can be memory mapped straight from the cache file.
+ */
+class FVfsArchiveIndex
+{
+public:
+	explicit FVfsArchiveIndex(TArray<uint8>&& InData)
+		: OwnedData(MoveTemp(InData))
+	{
+		SetData(OwnedData.GetData(), OwnedData.Num());
+	}
+
+	FVfsArchiveIndex(IMappedFileHandle* InMappedHandle, IMappedFileRegion* InMappedRegion)
+		: MappedHandle(InMappedHandle)
+		, MappedRegion(InMappedRegion)
+	{
+		SetData(MappedRegion->GetMappedPtr(), MappedRegion->GetMappedSize());
+	}
+
+	~FVfsArchiveIndex()
+	{
+		// Region must go before the handle
+		MappedRegion.Reset();
+		MappedHandle.Reset();
+	}
+
+	bool IsValid() const { return Header != nullptr; }
+	bool IsMapped() const { return MappedRegion.IsValid(); }
+	const FVfsIndexHeader& GetHeader() const { return *Header; }
+	int64 GetAllocatedSize() const { return DataSize; }
+
+	/** IoStore entries address the TOC by Offset, which a cache file can only be checked against once the TOC is read */
+	bool AreTocIndicesBelow(int32 NumTocEntries) const
+	{
+		for (int32 Index = 0; Index < Num(); ++Index)
+		{
+			if (Entries[Index].Offset >= NumTocEntries)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Matches(const FVfsIndexKey& Key) const
+	{
+		return Header->ArchiveSize == Key.ArchiveSize
+			&& Header->ArchiveTimestamp == Key.ArchiveTimestamp
+			&& FMemory::Memcmp(Header->ArchiveHash, Key.ArchiveHash.Hash, sizeof(Header->ArchiveHash)) == 0;
+	}
+
+	int32 Num() const { return Header->NumEntries; }
+	const FVfsIndexEntry& GetEntry(int32 Index) const { return Entries[Index]; }
+
+	FString GetPath(int32 Index) const
+	{
+		const FVfsIndexEntry& Entry = Entries[Index];
+		return ToString(Entry.PathOffset, Entry.PathLength);
+	}
+
+	FAnsiStringView GetPathView(int32 Index) const
+	{
+		const FVfsIndexEntry& Entry = Entries[Index];
+		return FAnsiStringView(Strings + Entry.PathOffset, Entry.PathLength);
+	}
+
+	FString GetMountPoint() const { return ToString(Header->MountPointOffset, Header->MountPointLength); }
+
+	void GetPakEntry(int32 Index, FPakEntry& OutEntry) const
+	{
+		const FVfsIndexEntry& Entry = Entries[Index];
+		OutEntry.Offset = Entry.Offset;
+		OutEntry.Size = Entry.Size;
+		OutEntry.UncompressedSize = Entry.UncompressedSize;
+		FMemory::Memcpy(OutEntry.Hash, Entry.Hash, sizeof(OutEntry.Hash));
+		OutEntry.CompressionBlocks = TArray<FPakCompressedBlock>(Blocks + Entry.FirstBlock, Entry.NumBlocks);
+		OutEntry.CompressionBlockSize = Entry.CompressionBlockSize;
+		OutEntry.CompressionMethodIndex = Entry.CompressionMethodIndex;
+		OutEntry.Flags = Entry.Flags;
+	}
+
+	int32 Find(const FString& Path) const
+	{
+		FTCHARToUTF8 Utf8Path(*Path, Path.Len());
+		const ANSICHAR* Query = (const ANSICHAR*)Utf8Path.Get();
+		const int32 QueryLength = Utf8Path.Length();
+		int32 Low = 0;
+		int32 High = Num();
+		while (Low < High)
+		{
+			const int32 Mid = Low + (High - Low) / 2;
+			const int32 Result = Compare(Strings + Entries[Mid].PathOffset, Entries[Mid].PathLength, Query, QueryLength);
+			if (Result == 0)
+			{
+				return Mid;
+			}
+			if (Result < 0)
+			{
+				Low = Mid + 1;
+			}
+			else
+			{
+				High = Mid;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+	/** First entry not ordered before Path */
+	int32 LowerBound(const ANSICHAR* Path, int32 Length) const
+	{
+		int32 Low = 0;
+		int32 High = Num();
+		while (Low < High)
+		{
+			const int32 Mid = Low + (High - Low) / 2;
+			if (Compare(Strings + Entries[Mid].PathOffset, Entries[Mid].PathLength, Path, Length) < 0)
+			{
+				Low = Mid + 1;
+			}
+			else
+			{
+				High = Mid;
+			}
+		}
+		return Low;
+	}
+
+	/**
+	 * Calls Visitor once per direct child of Directory, which is empty for the root and ends with '/' otherwise.
+	 * Subdirectories are stepped over with one binary search each, so this never walks a whole subtree.
+	 */
+	void ListDirectory(FAnsiStringView Directory, TFunctionRef<void(FAnsiStringView Name, bool bIsDirectory)> Visitor) const
+	{
+		TArray<ANSICHAR, TInlineAllocator<256>> SkipTo;
+		int32 Index = LowerBound(Directory.GetData(), Directory.Len());
+		while (Index < Num())
+		{
+			const FAnsiStringView Path = GetPathView(Index);
+			if (Path.Len() <= Directory.Len() || Compare(Path.GetData(), Directory.Len(), Directory.GetData(), Directory.Len()) != 0)
+			{
+				break;
+			}
+			const FAnsiStringView Rest = Path.RightChop(Directory.Len());
+			int32 SlashIndex;
+			if (!Rest.FindChar('/', SlashIndex))
+			{
+				Visitor(Rest, false);
+				++Index;
+				continue;
+			}
+			if (SlashIndex > 0)
+			{
+				Visitor(Rest.Left(SlashIndex), true);
+			}
+			// '0' is the character right after '/', so this lands on the first path past the subdirectory
+			SkipTo.Reset();
+			SkipTo.Append(Path.GetData(), Directory.Len() + SlashIndex);
+			SkipTo.Add('0');
+			Index = LowerBound(SkipTo.GetData(), SkipTo.Num());
+		}
+	}
+
+	/** Case-insensitive (ASCII) ordinal comparison, the order entries are sorted in */
+	static int32 Compare(const ANSICHAR* A, int32 ALength, const ANSICHAR* B, int32 BLength)
+	{
+		const int32 Length = FMath::Min(ALength, BLength);
+		for (int32 i = 0; i < Length; ++i)
+		{
+			const ANSICHAR CharA = FChar::ToLower(A[i]);
+			const ANSICHAR CharB = FChar::ToLower(B[i]);
+			if (CharA != CharB)
+			{
+				return (uint8)CharA < (uint8)CharB ? -1 : 1;
+			}
+		}
+		return ALength - BLength;
+	}
+
+private:
+	void SetData(const uint8* InData, int64 InDataSize)
+	{
+		if (InDataSize < (int64)sizeof(FVfsIndexHeader))
+		{
+			return;
+		}
+		const FVfsIndexHeader* InHeader = (const FVfsIndexHeader*)InData;
+		const int64 ExpectedSize = sizeof(FVfsIndexHeader)
+			+ (int64)InHeader->NumEntries * sizeof(FVfsIndexEntry)
+			+ (int64)InHeader->NumBlocks * sizeof(FPakCompressedBlock)
+			+ InHeader->StringsSize;
+		if (InHeader->Magic != VFS_INDEX_MAGIC || InHeader->Version != VFS_INDEX_VERSION || ExpectedSize != InDataSize || InHeader->NumEntries > MAX_int32)
+		{
+			return;
+		}
+		const FVfsIndexEntry* InEntries = (const FVfsIndexEntry*)(InData + sizeof(FVfsIndexHeader));
+		if (!AreRangesValid(*InHeader, InEntries))
+		{
+			return;
+		}
+		Header = InHeader;
+		Entries = InEntries;
+		Blocks = (const FPakCompressedBlock*)(Entries + InHeader->NumEntries);
+		Strings = (const ANSICHAR*)(Blocks + InHeader->NumBlocks);
+		DataSize = InDataSize;
+	}
+
+	/**
+	 * Cache files are only checked against their archive, not their contents, so every range lookups dereference
+	 * without checks is validated here once instead: paths and the mount point against the strings, blocks against
+	 * the block table. One pass over the entries, which hashing them for the path index does anyway.
+	 */
+	static bool AreRangesValid(const FVfsIndexHeader& InHeader, const FVfsIndexEntry* InEntries)
+	{
+		if ((uint64)InHeader.MountPointOffset + InHeader.MountPointLength > InHeader.StringsSize)
+		{
+			return false;
+		}
+		for (uint32 Index = 0; Index < InHeader.NumEntries; ++Index)
+		{
+			const FVfsIndexEntry& Entry = InEntries[Index];
+			if ((uint64)Entry.PathOffset + Entry.PathLength > InHeader.StringsSize
+				|| (uint64)Entry.FirstBlock + Entry.NumBlocks > InHeader.NumBlocks
+				|| Entry.Offset < 0 || Entry.Size < 0 || Entry.UncompressedSize < 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	FString ToString(uint32 Offset, uint32 Length) const
+	{
+		FUTF8ToTCHAR Converted(Strings + Offset, Length);
+		return FString(Converted.Length(), Converted.Get());
+	}
+
+	TArray<uint8> OwnedData;
+	TUniquePtr<IMappedFileHandle> MappedHandle;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+
+	const FVfsIndexHeader* Header = nullptr;
+	const FVfsIndexEntry* Entries = nullptr;
+	const FPakCompressedBlock* Blocks = nullptr;
+	const ANSICHAR* Strings = nullptr;
+	int64 DataSize = 0;
+};
+
+typedef TSharedPtr<const FVfsArchiveIndex, ESPMode::ThreadSafe> FVfsArchiveIndexPtr;
+
+/**
+ * Collects entries of one archive and lays them out in the flat FVfsArchiveIndex format
+ */
+class FVfsArchiveIndexBuilder
+{
+public:
+	explicit FVfsArchiveIndexBuilder(const FString& InMountPoint)
+	{
+		MountPointOffset = AddString(InMountPoint, MountPointLength);
+	}
+
+	void Add(const FString& FullPath, const FPakEntry& PakEntry)
+	{
+		FVfsIndexEntry& Entry = Entries.AddZeroed_GetRef();
+		Entry.PathOffset = AddString(FullPath, Entry.PathLength);
+		Entry.Offset = PakEntry.Offset;
+		Entry.Size = PakEntry.Size;
+		Entry.UncompressedSize = PakEntry.UncompressedSize;
+		FMemory::Memcpy(Entry.Hash, PakEntry.Hash, sizeof(Entry.Hash));
+		Entry.FirstBlock = Blocks.Num();
+		Entry.NumBlocks = PakEntry.CompressionBlocks.Num();
+		Entry.CompressionBlockSize = PakEntry.CompressionBlockSize;
+		Entry.CompressionMethodIndex = PakEntry.CompressionMethodIndex;
+		Entry.Flags = PakEntry.Flags;
+		Blocks.Append(PakEntry.CompressionBlocks);
+	}
+
+	FVfsArchiveIndexPtr Finalize(const FVfsIndexKey& Key)
+	{
+		const ANSICHAR* StringData = Strings.GetData();
+		Algo::Sort(Entries, [StringData](const FVfsIndexEntry& A, const FVfsIndexEntry& B)
+		{
+			return FVfsArchiveIndex::Compare(StringData + A.PathOffset, A.PathLength, StringData + B.PathOffset, B.PathLength) < 0;
+		});
+
+		FVfsIndexHeader Header;
+		FMemory::Memzero(Header);
+		Header.Magic = VFS_INDEX_MAGIC;
+		Header.Version = VFS_INDEX_VERSION;
+		Header.ArchiveSize = Key.ArchiveSize;
+		Header.ArchiveTimestamp = Key.ArchiveTimestamp;
+		FMemory::Memcpy(Header.ArchiveHash, Key.ArchiveHash.Hash, sizeof(Header.ArchiveHash));
+		Header.NumEntries = Entries.Num();
+		Header.NumBlocks = Blocks.Num();
+		Header.StringsSize = Strings.Num();
+		Header.MountPointOffset = MountPointOffset;
+		Header.MountPointLength = MountPointLength;
+
+		TArray<uint8> Data;
+		Data.Reserve(sizeof(Header) + Entries.Num() * sizeof(FVfsIndexEntry) + Blocks.Num() * sizeof(FPakCompressedBlock) + Strings.Num());
+		Data.Append((const uint8*)&Header, sizeof(Header));
+		Data.Append((const uint8*)Entries.GetData(), Entries.Num() * sizeof(FVfsIndexEntry));
+		Data.Append((const uint8*)Blocks.GetData(), Blocks.Num() * sizeof(FPakCompressedBlock));
+		Data.Append((const uint8*)Strings.GetData(), Strings.Num());
+		return MakeShared<FVfsArchiveIndex, ESPMode::ThreadSafe>(MoveTemp(Data));
+	}
+
+	static FVfsArchiveIndexPtr BuildFromIoStore(const FIoStoreTocResource& Toc, const FAES::FAESKey& DecryptionKey, const FVfsIndexKey& Key)
+	{
+		// Reader decrypts in place, leave the TOC's copy alone
+		TArray<uint8> DirectoryIndexBuffer = Toc.DirectoryIndexBuffer;
+		FIoDirectoryIndexReader Reader;
+		if (!DirectoryIndexBuffer.Num() || !Reader.Initialize(DirectoryIndexBuffer, DecryptionKey).IsOk())
+		{
+			return nullptr;
+		}
+
+		FString MountPoint = Reader.GetMountPoint();
+		if (MountPoint.StartsWith(TEXT("../../../")))
+		{
+			MountPoint = MountPoint.Mid(9);
+		}
+		FVfsArchiveIndexBuilder Builder(MountPoint);
+		Reader.IterateDirectoryIndex(FIoDirectoryIndexHandle::RootDirectory(), TEXT(""), [&](FStringView Filename, uint32 TocEntryIndex) -> bool
+		{
+			FPakEntry Entry;
+			Entry.Offset = TocEntryIndex;
+			Entry.Size = Toc.ChunkOffsetLengths[TocEntryIndex].GetLength();
+			Entry.UncompressedSize = Entry.Size;
+			Entry.CompressionBlockSize = Toc.Header.CompressionBlockSize;
+			Builder.Add(MountPoint / FString(Filename), Entry);
+			return true;
+		});
+		return Builder.Finalize(Key);
+	}
+
+	static FSHAHash HashTocHeader(const FIoStoreTocResource& Toc)
+	{
+		FSHAHash Hash;
+		FSHA1::HashBuffer(&Toc.Header, sizeof(Toc.Header), Hash.Hash);
+		return Hash;
+	}
+
+	static FVfsArchiveIndexPtr BuildFromPak(FPakFile& PakFile, const FVfsIndexKey& Key)
+	{
+		const FString MountPoint = PakFile.GetMountPoint();
+		FVfsArchiveIndexBuilder Builder(MountPoint);
+		for (FPakFile::FPakEntryIterator It(PakFile, false); It; ++It)
+		{
+			if (const FString* Filename = It.TryGetFilename())
+			{
+				Builder.Add(MountPoint / *Filename, It.Info());
+			}
+		}
+		return Builder.Finalize(Key);
+	}
+
+private:
+	uint32 AddString(const FString& String, uint32& OutLength)
+	{
+		FTCHARToUTF8 Converted(*String, String.Len());
+		const uint32 Offset = Strings.Num();
+		Strings.Append((const ANSICHAR*)Converted.Get(), Converted.Length());
+		OutLength = Converted.Length();
+		return Offset;
+	}
+
+	TArray<FVfsIndexEntry> Entries;
+	TArray<FPakCompressedBlock> Blocks;
+	TArray<ANSICHAR> Strings;
+	uint32 MountPointOffset;
+	uint32 MountPointLength;
+};
+
+/**
+ * Persists archive indices between runs, one memory-mappable file per archive
+ */
+class FVfsIndexCache
+{
+public:
+	explicit FVfsIndexCache(const FString& InDirectory)
+		: Directory(InDirectory)
+	{
+	}
+
+	FVfsArchiveIndexPtr Load(const FString& ArchivePath, const FVfsIndexKey& Key) const
+	{
+		const FString CacheFilename = GetCacheFilename(ArchivePath);
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		if (!PlatformFile.FileExists(*CacheFilename))
+		{
+			return nullptr;
+		}
+
+		TSharedPtr<FVfsArchiveIndex, ESPMode::ThreadSafe> Index;
+		if (FPlatformProperties::SupportsMemoryMappedFiles())
+		{
+			if (IMappedFileHandle* MappedHandle = PlatformFile.OpenMapped(*CacheFilename))
+			{
+				if (IMappedFileRegion* MappedRegion = MappedHandle->MapRegion(0, MappedHandle->GetFileSize()))
+				{
+					Index = MakeShared<FVfsArchiveIndex, ESPMode::ThreadSafe>(MappedHandle, MappedRegion);
+				}
+				else
+				{
+					delete MappedHandle;
+				}
+			}
+		}
+		if (!Index.IsValid())
+		{
+			TArray<uint8> Data;
+			if (FFileHelper::LoadFileToArray(Data, *CacheFilename, FILEREAD_Silent))
+			{
+				Index = MakeShared<FVfsArchiveIndex, ESPMode::ThreadSafe>(MoveTemp(Data));
+			}
+		}
+
+		if (!Index.IsValid() || !Index->IsValid() || !Index->Matches(Key))
+		{
+			UE_LOG(LogFModel, Verbose, TEXT("Index cache for %s is stale, discarding"), *ArchivePath);
+			Index.Reset(); // Unmap before deleting
+			PlatformFile.DeleteFile(*CacheFilename);
+			return nullptr;
+		}
+		return Index;
+	}
+
+	void Save(const FString& ArchivePath, const FVfsArchiveIndex& Index) const
+	{
+		check(!Index.IsMapped());
+		const FString CacheFilename = GetCacheFilename(ArchivePath);
+		const FString TempFilename = CacheFilename + TEXT(".tmp");
+		TArrayView<const uint8> Data((const uint8*)&Index.GetHeader(), Index.GetAllocatedSize());
+		if (!FFileHelper::SaveArrayToFile(Data, *TempFilename) || !IFileManager::Get().Move(*CacheFilename, *TempFilename, true, true))
+		{
+			UE_LOG(LogFModel, Warning, TEXT("Failed to write index cache for %s"), *ArchivePath);
+			IFileManager::Get().Delete(*TempFilename, false, false, true);
+		}
+	}
+
+private:
+	FString GetCacheFilename(const FString& ArchivePath) const
+	{
+		const FString LowerPath = ArchivePath.ToLower();
+		FSHAHash PathHash;
+		FSHA1::HashBuffer(*LowerPath, LowerPath.Len() * sizeof(TCHAR), PathHash.Hash);
+		return Directory / PathHash.ToString() + TEXT(".fidx");
+	}
+
+	FString Directory;
+};
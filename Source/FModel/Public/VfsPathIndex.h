@@ -0,0 +1,258 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+#include "VfsIndexCache.h"
+
+/** Where a path resolved to: archive slot in the provider and entry in that archive's FVfsArchiveIndex */
+struct FVfsPathLocation
+{
+	int32 VfsSlot = INDEX_NONE;
+	int32 EntryIndex = INDEX_NONE;
+};
+
+/**
+ * Merged path -> (archive, entry) map over every mounted archive. Paths are keyed by a 64-bit case-insensitive hash,
+ * the same trade-off FPackageId makes; a hit is still verified against the archive's own path. The map is a stack of
+ * immutable layers, one per mount batch, so extending a copy costs the new archives' paths only.
+ */
+class FVfsPathIndex
+{
+public:
+	/** FNV-1a over ASCII-lowercased UTF-8 with '\' treated as '/' */
+	static uint64 HashPath(const ANSICHAR* Path, int32 Length)
+	{
+		uint64 Hash = 0xcbf29ce484222325ull;
+		for (int32 i = 0; i < Length; ++i)
+		{
+			ANSICHAR Char = Path[i] == '\\' ? '/' : FChar::ToLower(Path[i]);
+			Hash = (Hash ^ (uint8)Char) * 0x100000001b3ull;
+		}
+		return Hash;
+	}
+
+	static bool PathsEqual(const ANSICHAR* A, int32 ALength, const ANSICHAR* B, int32 BLength)
+	{
+		if (ALength != BLength)
+		{
+			return false;
+		}
+		for (int32 i = 0; i < ALength; ++i)
+		{
+			const ANSICHAR CharA = A[i] == '\\' ? '/' : FChar::ToLower(A[i]);
+			const ANSICHAR CharB = B[i] == '\\' ? '/' : FChar::ToLower(B[i]);
+			if (CharA != CharB)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/** Same ordering FPakPlatformFile uses: _P patches override base archives, later patch versions override earlier ones */
+	static int32 GetArchivePriority(const FString& ArchivePath)
+	{
+		const FString BaseFilename = FPaths::GetBaseFilename(ArchivePath);
+		int32 Priority = 0;
+		if (BaseFilename.EndsWith(TEXT("_P")))
+		{
+			int32 ChunkVersionNumber = 1;
+			const int32 VersionEndIndex = BaseFilename.Len() - 2;
+			const int32 VersionStartIndex = BaseFilename.Find(TEXT("_"), ESearchCase::CaseSensitive, ESearchDir::FromEnd, VersionEndIndex);
+			if (VersionStartIndex != INDEX_NONE)
+			{
+				const FString VersionString = BaseFilename.Mid(VersionStartIndex + 1, VersionEndIndex - VersionStartIndex - 1);
+				if (VersionString.IsNumeric() && FCString::Atoi(*VersionString) >= 1)
+				{
+					// First numbered patch still has to beat an unnumbered one
+					ChunkVersionNumber = FCString::Atoi(*VersionString) + 1;
+				}
+			}
+			Priority += 100 * ChunkVersionNumber;
+		}
+		return Priority;
+	}
+
+	int32 Num() const { return NumPaths; }
+
+	/**
+	 * Merges newly mounted archives in, existing paths only move to an archive that wins ResolveConflict. Only the new
+	 * archives' paths are hashed and inserted, into a layer of their own; earlier layers are shared with the snapshots
+	 * that already hold them, so copying the index for the next snapshot copies layer pointers, not paths.
+	 */
+	void Add(const TArray<TPair<int32, FVfsArchiveIndexPtr>>& NewArchives, const TArray<FString>& NewArchivePaths)
+	{
+		check(NewArchives.Num() == NewArchivePaths.Num());
+		TArray<TArray<uint64>> Hashes;
+		Hashes.SetNum(NewArchives.Num());
+		ParallelFor(NewArchives.Num(), [&](int32 Index)
+		{
+			const FVfsArchiveIndex& ArchiveIndex = *NewArchives[Index].Value;
+			TArray<uint64>& ArchiveHashes = Hashes[Index];
+			ArchiveHashes.SetNumUninitialized(ArchiveIndex.Num());
+			for (int32 EntryIndex = 0; EntryIndex < ArchiveIndex.Num(); ++EntryIndex)
+			{
+				const FAnsiStringView Path = ArchiveIndex.GetPathView(EntryIndex);
+				ArchiveHashes[EntryIndex] = HashPath(Path.GetData(), Path.Len());
+			}
+		});
+
+		for (int32 Index = 0; Index < NewArchives.Num(); ++Index)
+		{
+			const int32 VfsSlot = NewArchives[Index].Key;
+			if (Slots.Num() <= VfsSlot)
+			{
+				Slots.SetNum(VfsSlot + 1);
+			}
+			FSlot& Slot = Slots[VfsSlot];
+			Slot.Index = NewArchives[Index].Value;
+			Slot.Name = FPaths::GetCleanFilename(NewArchivePaths[Index]);
+			Slot.Priority = GetArchivePriority(NewArchivePaths[Index]);
+		}
+
+		int32 NumNewEntries = 0;
+		for (const TArray<uint64>& ArchiveHashes : Hashes)
+		{
+			NumNewEntries += ArchiveHashes.Num();
+		}
+		if (!NumNewEntries)
+		{
+			return;
+		}
+		TSharedRef<FLayer, ESPMode::ThreadSafe> Layer = MakeShared<FLayer, ESPMode::ThreadSafe>();
+		Layer->Locations.Reserve(NumNewEntries);
+		for (int32 Index = 0; Index < NewArchives.Num(); ++Index)
+		{
+			const int32 VfsSlot = NewArchives[Index].Key;
+			const TArray<uint64>& ArchiveHashes = Hashes[Index];
+			for (int32 EntryIndex = 0; EntryIndex < ArchiveHashes.Num(); ++EntryIndex)
+			{
+				const uint64 Hash = ArchiveHashes[EntryIndex];
+				if (FVfsPathLocation* Pending = Layer->Locations.Find(Hash))
+				{
+					if (ResolveConflict(VfsSlot, Pending->VfsSlot))
+					{
+						Pending->VfsSlot = VfsSlot;
+						Pending->EntryIndex = EntryIndex;
+					}
+					continue;
+				}
+				// Earlier layers hold the winner among everything mounted before, a path only goes in this layer if it beats that
+				const FVfsPathLocation* Existing = FindLocation(Hash);
+				if (!Existing || ResolveConflict(VfsSlot, Existing->VfsSlot))
+				{
+					NumPaths += Existing ? 0 : 1;
+					FVfsPathLocation Location;
+					Location.VfsSlot = VfsSlot;
+					Location.EntryIndex = EntryIndex;
+					Layer->Locations.Add(Hash, Location);
+				}
+			}
+		}
+		Layers.Add(Layer);
+		Compact();
+	}
+
+	bool Find(FStringView Path, FVfsPathLocation& OutLocation) const
+	{
+		FTCHARToUTF8 Utf8Path(Path.GetData(), Path.Len());
+		return Find((const ANSICHAR*)Utf8Path.Get(), Utf8Path.Length(), OutLocation);
+	}
+
+	/** Same for a UTF-8 path, such as one straight out of an archive index */
+	bool Find(const ANSICHAR* Query, int32 QueryLength, FVfsPathLocation& OutLocation) const
+	{
+		while (QueryLength && (*Query == '/' || *Query == '\\'))
+		{
+			++Query;
+			--QueryLength;
+		}
+
+		const FVfsPathLocation* Location = FindLocation(HashPath(Query, QueryLength));
+		if (!Location)
+		{
+			return false;
+		}
+		const FAnsiStringView Found = Slots[Location->VfsSlot].Index->GetPathView(Location->EntryIndex);
+		if (!PathsEqual(Found.GetData(), Found.Len(), Query, QueryLength))
+		{
+			return false;
+		}
+		OutLocation = *Location;
+		return true;
+	}
+
+	void Reset()
+	{
+		Layers.Reset();
+		Slots.Reset();
+		NumPaths = 0;
+	}
+
+private:
+	/** Paths resolved by one Add, or several once compacted. Immutable once published, shared between snapshots. */
+	struct FLayer
+	{
+		TMap<uint64, FVfsPathLocation> Locations;
+	};
+	typedef TSharedPtr<const FLayer, ESPMode::ThreadSafe> FLayerPtr;
+
+	/** Layers beyond this are merged whatever their sizes, bounding the probes of a lookup that misses */
+	static constexpr int32 MaxLayers = 8;
+
+	/** Newest layer first, a path's newest entry is its winner */
+	const FVfsPathLocation* FindLocation(uint64 Hash) const
+	{
+		for (int32 LayerIndex = Layers.Num(); LayerIndex--;)
+		{
+			if (const FVfsPathLocation* Location = Layers[LayerIndex]->Locations.Find(Hash))
+			{
+				return Location;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Merges the newest layer into the one below while it is at least half that one's size, so each path gets copied
+	 * O(log n) times over any sequence of mounts. The merged layer is new, snapshots holding the old ones keep them.
+	 */
+	void Compact()
+	{
+		while (Layers.Num() >= 2 && (Layers.Num() > MaxLayers || Layers.Last()->Locations.Num() * 2 >= Layers[Layers.Num() - 2]->Locations.Num()))
+		{
+			const FLayer& Newer = *Layers.Last();
+			const FLayer& Older = *Layers[Layers.Num() - 2];
+			TSharedRef<FLayer, ESPMode::ThreadSafe> Merged = MakeShared<FLayer, ESPMode::ThreadSafe>();
+			Merged->Locations.Reserve(Older.Locations.Num() + Newer.Locations.Num());
+			Merged->Locations.Append(Older.Locations);
+			Merged->Locations.Append(Newer.Locations);
+			Layers.Pop(false);
+			Layers.Last() = Merged;
+		}
+	}
+
+	/** True if archive A overrides archive B for a path both contain */
+	bool ResolveConflict(int32 A, int32 B) const
+	{
+		const FSlot& SlotA = Slots[A];
+		const FSlot& SlotB = Slots[B];
+		if (SlotA.Priority != SlotB.Priority)
+		{
+			return SlotA.Priority > SlotB.Priority;
+		}
+		// Deterministic regardless of mount order
+		return SlotA.Name.Compare(SlotB.Name, ESearchCase::IgnoreCase) > 0;
+	}
+
+	struct FSlot
+	{
+		FVfsArchiveIndexPtr Index;
+		FString Name;
+		int32 Priority = 0;
+	};
+
+	TArray<FLayerPtr> Layers;
+	TArray<FSlot> Slots;
+	int32 NumPaths = 0;
+};
@@ -0,0 +1,36 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+/**
+ * Same module as FModel, built with FMODEL_BENCHMARK so the program runs the microbenchmark suite and exits.
+ * FModelBenchmark -Paks=Dir [-AES=Guid:Key] [-BenchSeconds=1] [-BenchOut=results.json]
+ */
+[SupportedPlatforms(UnrealPlatformClass.Desktop)]
+public class FModelBenchmarkTarget : TargetRules
+{
+	public FModelBenchmarkTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Program;
+		LinkType = TargetLinkType.Monolithic;
+		DefaultBuildSettings = BuildSettingsVersion.V2;
+
+		LaunchModuleName = "FModel";
+		ExtraModuleNames.Add("EditorStyle");
+
+		bCompileAgainstEngine = false;
+		bCompileAgainstCoreUObject = true;
+		bHasExports = false;
+		bBuildDeveloperTools = true;
+
+		bUseLoggingInShipping = true;
+		bCompileWithPluginSupport = false;
+
+		// FModel stat scopes show up in Unreal Insights with -trace=cpu
+		bEnableTrace = true;
+
+		GlobalDefinitions.Add("USE_IO_DISPATCHER=1");
+		GlobalDefinitions.Add("FMODEL_BENCHMARK=1");
+	}
+}
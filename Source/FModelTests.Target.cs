@@ -0,0 +1,36 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+/**
+ * Same module as FModel with the automation tests compiled in, built with FMODEL_TESTS so the program runs them and
+ * exits with non-zero if any failed. FModelTests [-TestFilter=FModel.SubmitKeys]
+ */
+[SupportedPlatforms(UnrealPlatformClass.Desktop)]
+public class FModelTestsTarget : TargetRules
+{
+	public FModelTestsTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Program;
+		LinkType = TargetLinkType.Monolithic;
+		DefaultBuildSettings = BuildSettingsVersion.V2;
+
+		LaunchModuleName = "FModel";
+		ExtraModuleNames.Add("EditorStyle");
+
+		bCompileAgainstEngine = false;
+		bCompileAgainstCoreUObject = true;
+		bHasExports = false;
+		bBuildDeveloperTools = true;
+
+		bUseLoggingInShipping = true;
+		bCompileWithPluginSupport = false;
+
+		// Private/Tests, run by FModelTests.cpp
+		bForceCompileDevelopmentAutomationTests = true;
+
+		GlobalDefinitions.Add("USE_IO_DISPATCHER=1");
+		GlobalDefinitions.Add("FMODEL_TESTS=1");
+	}
+}